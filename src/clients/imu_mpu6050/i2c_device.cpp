@@ -0,0 +1,43 @@
+#include "i2c_device.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/i2c-dev.h>
+#include <sys/ioctl.h>
+#include <glog/logging.h>
+
+namespace {
+
+class LinuxI2cDevice final : public I2cDevice {
+  public:
+    LinuxI2cDevice(const std::string& device_path, int address) {
+        i2c_fd = open(device_path.c_str(), O_RDWR);
+        CHECK_ERR(i2c_fd) << "Error opening I2C device";
+        CHECK_ERR(ioctl(i2c_fd, I2C_SLAVE, address)) << "Error configuring I2C device";
+    }
+
+    ~LinuxI2cDevice() override {
+        close(i2c_fd);
+    }
+
+    LinuxI2cDevice(const LinuxI2cDevice&) = delete;
+    LinuxI2cDevice& operator=(const LinuxI2cDevice&) = delete;
+
+    void WriteRegister(unsigned char reg, unsigned char value) override {
+        const unsigned char buf[2] = {reg, value};
+        CHECK_ERR(write(i2c_fd, buf, 2)) << "Error writing register " << static_cast<int>(reg);
+    }
+
+    void ReadRegisters(unsigned char reg, unsigned char* buf, std::size_t length) override {
+        CHECK_ERR(write(i2c_fd, &reg, 1));
+        CHECK_ERR(read(i2c_fd, buf, length));
+    }
+
+  private:
+    int i2c_fd;
+};
+
+}  // namespace
+
+std::unique_ptr<I2cDevice> I2cDevice::OpenLinuxI2cDevice(const std::string& device_path, int address) {
+    return std::make_unique<LinuxI2cDevice>(device_path, address);
+}
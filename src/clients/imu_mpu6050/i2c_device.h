@@ -0,0 +1,23 @@
+#ifndef WHISKER_I2C_DEVICE_H
+#define WHISKER_I2C_DEVICE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+// Register access to a device on an I2C bus, which tests can replace with a simulated device.
+
+class I2cDevice {
+  public:
+    virtual ~I2cDevice() = default;
+
+    virtual void WriteRegister(unsigned char reg, unsigned char value) = 0;
+
+    // reads 'length' bytes starting at 'reg' (registers that are FIFOs return successive bytes of the FIFO)
+    virtual void ReadRegisters(unsigned char reg, unsigned char* buf, std::size_t length) = 0;
+
+    // opens a Linux i2c-dev device node (e.g. /dev/i2c-1) for the device at 'address'
+    static std::unique_ptr<I2cDevice> OpenLinuxI2cDevice(const std::string& device_path, int address);
+};
+
+#endif  // WHISKER_I2C_DEVICE_H
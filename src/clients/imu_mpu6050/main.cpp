@@ -2,6 +2,7 @@
 #include <utility>
 #include <gflags/gflags.h>
 #include <json/json.h>
+#include <whisker/credit_stream.h>
 #include <whisker/init.h>
 #include <whisker/server_connection.h>
 #include <whisker/zmq_connection.h>
@@ -14,6 +15,13 @@ class Client final : public whisker::Init::Context {
   public:
     using whisker::Init::Context::Context;
 
+    ~Client() override {
+        // the message handlers reference the observation stream, so stop them before destruction
+        if (server_connection) {
+            server_connection->StopMessageHandling();
+        }
+    }
+
   private:
     void InitContext(Json::Value&& config) override {
         const auto& vehicle_config = config["vehicle"];
@@ -24,16 +32,27 @@ class Client final : public whisker::Init::Context {
         init_msg.set_vehicle_id(vehicle_config["id"].asString());
         init_msg.set_keep_out_radius(vehicle_config["keep_out_radius"].asFloat());
         *init_msg.mutable_imu_properties() = mpu6050->GetSensorProperties();
+        init_msg.set_use_streaming(true);
+
+        // push observations as they're acquired while the server has granted credits for them
+        observation_stream = std::make_unique<whisker::CreditStream>([this, mpu6050] {
+            server_connection->SendMessage(mpu6050->GetObservationBatch());
+            return true;
+        });
 
         whisker::ServerEventHandlers event_handlers;
-        event_handlers.disconnect_handler = [init_msg](auto& connection) {
+        event_handlers.disconnect_handler = [this, init_msg](auto& connection) {
+            observation_stream->ResetCredits();
             // enqueue init msg to send when reconnected
             connection.SendMessage(init_msg);
         };
+        // servers without observation streaming request each observation instead
         event_handlers.SetMessageHandler<whisker::proto::RequestObservationMessage>(
                 [mpu6050](auto&& message, auto& connection) {
-                    connection.SendMessage(mpu6050->GetLatestObservation());
+                    connection.SendMessage(mpu6050->GetObservationBatch());
                 });
+        event_handlers.SetMessageHandler<whisker::proto::GrantObservationCreditsMessage>(
+                [this](auto&& message, auto& connection) { observation_stream->AddCredits(message.num_credits()); });
 
         server_connection = whisker::ZmqConnection::CreateServerConnection(vehicle_config["server_address"].asString(),
                                                                            vehicle_config["id"].asString() + FLAGS_id,
@@ -42,6 +61,7 @@ class Client final : public whisker::Init::Context {
     }
 
     std::shared_ptr<whisker::ServerConnection> server_connection;
+    std::unique_ptr<whisker::CreditStream> observation_stream;  // declared last so it's destroyed before the connection
 };
 
 int main(int argc, char* argv[]) {
@@ -1,23 +1,40 @@
 #include "mpu6050.h"
+#include <algorithm>
 #include <cmath>
-#include <fcntl.h>
-#include <unistd.h>
-#include <linux/i2c-dev.h>
-#include <sys/ioctl.h>
+#include <utility>
+#include <vector>
 #include <glog/logging.h>
+#include <whisker/sensor_time_sync.h>
 
+constexpr unsigned char sample_rate_divider_register = 0x19;
+constexpr unsigned char config_register = 0x1a;
+constexpr unsigned char fifo_enable_register = 0x23;
+constexpr unsigned char interrupt_status_register = 0x3a;
 constexpr unsigned char readings_register_base = 0x3b;
+constexpr unsigned char user_control_register = 0x6a;
+constexpr unsigned char power_management_register = 0x6b;
+constexpr unsigned char fifo_count_register_base = 0x72;
+constexpr unsigned char fifo_data_register = 0x74;
 
-Mpu6050::Mpu6050(const Json::Value& config) {
+constexpr int fifo_capacity = 1024;  // bytes
+
+namespace {
+
+std::unique_ptr<I2cDevice> OpenI2cDevice(const Json::Value& config) {
     const auto i2c_device = config["i2c_device"].asString();
     const auto address = config["address"].asString();
 
     LOG(INFO) << "Connecting to MPU-6050 with I2C device " << i2c_device << " at address " << address;
 
-    i2c_fd = open(i2c_device.c_str(), O_RDWR);
-    CHECK_ERR(i2c_fd) << "Error opening I2C device";
-    CHECK_ERR(ioctl(i2c_fd, I2C_SLAVE, std::stoi(address, nullptr, 0))) << "Error configuring I2C device";
+    return I2cDevice::OpenLinuxI2cDevice(i2c_device, std::stoi(address, nullptr, 0));
+}
+
+}  // namespace
 
+Mpu6050::Mpu6050(const Json::Value& config) : Mpu6050(config, OpenI2cDevice(config)) {}
+
+Mpu6050::Mpu6050(const Json::Value& config, std::unique_ptr<I2cDevice> i2c_device)
+        : i2c_device(std::move(i2c_device)) {
     const auto& offsets = config["zero_offsets"];
     offset_accel_x = offsets["accel_x"].asDouble();
     offset_accel_y = offsets["accel_y"].asDouble();
@@ -28,75 +45,190 @@ Mpu6050::Mpu6050(const Json::Value& config) {
 
     PopulateSensorProperties(config);
 
-    unsigned char buf[2];
-    buf[0] = 0x6b;  // select PWR_MGMT_1 configuration register
-    buf[1] = 1;     // disable sleep, use gyroscope clock reference
-    CHECK_ERR(write(i2c_fd, buf, 2));
+    this->i2c_device->WriteRegister(power_management_register, 1);  // disable sleep, use gyroscope clock reference
 
-    sensor_thread = std::thread{&Mpu6050::ProcessSensorData, this};
+    const auto& fifo_config = config["fifo"];
+    if (fifo_config.isObject()) {
+        ConfigureFifo(fifo_config);
+        is_using_fifo = true;
+        sensor_thread = std::thread{&Mpu6050::ProcessFifoData, this};
+    } else {
+        sensor_thread = std::thread{&Mpu6050::ProcessSensorData, this};
+    }
 }
 
 Mpu6050::~Mpu6050() {
     run_sensor_thread = false;
     sensor_thread.join();
 
-    unsigned char buf[2];
-    buf[0] = 0x6b;    // select PWR_MGMT_1 configuration register
-    buf[1] = 1 << 6;  // enable sleep
-    CHECK_ERR(write(i2c_fd, buf, 2));
-
-    close(i2c_fd);
+    if (is_using_fifo) {
+        i2c_device->WriteRegister(user_control_register, 0);  // disable FIFO
+    }
+    i2c_device->WriteRegister(power_management_register, 1 << 6);  // enable sleep
 }
 
 whisker::proto::ImuSensorProperties Mpu6050::GetSensorProperties() const {
     return sensor_properties;
 }
 
-whisker::proto::ObservationMessage Mpu6050::GetLatestObservation() {
+whisker::proto::ObservationMessage Mpu6050::GetObservationBatch() {
+    thread_local std::vector<Sample> samples;
+    sample_ring.DrainAll(samples);
+
+    const auto to_microseconds = [](const auto& time_point) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(time_point.time_since_epoch()).count();
+    };
+
     whisker::proto::ObservationMessage observation_message;
+    observation_message.set_timestamp(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                              samples.back().timestamp.time_since_epoch())
+                                              .count());
+
+    const auto imu_batch = observation_message.mutable_imu_batch_observation();
+    const auto start_timestamp = to_microseconds(samples.front().timestamp);
+    imu_batch->set_start_timestamp(start_timestamp);
+
+    const auto num_samples = static_cast<int>(samples.size());
+    imu_batch->mutable_time_offsets()->Reserve(num_samples);
+    imu_batch->mutable_linear_acceleration_x()->Reserve(num_samples);
+    imu_batch->mutable_linear_acceleration_y()->Reserve(num_samples);
+    imu_batch->mutable_linear_acceleration_z()->Reserve(num_samples);
+    imu_batch->mutable_angular_velocity_x()->Reserve(num_samples);
+    imu_batch->mutable_angular_velocity_y()->Reserve(num_samples);
+    imu_batch->mutable_angular_velocity_z()->Reserve(num_samples);
+
+    for (const auto& sample : samples) {
+        const auto get_value = [&sample](int index) -> short {
+            return (sample.readings[index] << 8) | sample.readings[index + 1];
+        };
+
+        imu_batch->add_time_offsets(to_microseconds(sample.timestamp) - start_timestamp);
+        imu_batch->add_linear_acceleration_x((get_value(0) * 9.81 / 16384) + offset_accel_x);
+        imu_batch->add_linear_acceleration_y((get_value(2) * 9.81 / 16384) + offset_accel_y);
+        imu_batch->add_linear_acceleration_z((get_value(4) * 9.81 / 16384) + offset_accel_z);
+        imu_batch->add_angular_velocity_x((get_value(8) * M_PI / 180 / 131) + offset_gyro_x);
+        imu_batch->add_angular_velocity_y((get_value(10) * M_PI / 180 / 131) + offset_gyro_y);
+        imu_batch->add_angular_velocity_z((get_value(12) * M_PI / 180 / 131) + offset_gyro_z);
+    }
 
-    observation_buffer.Read([this, &observation_message](const auto buffered_observation) {
-        observation_message.set_timestamp(std::chrono::duration_cast<std::chrono::milliseconds>(
-                                                  buffered_observation->timestamp.time_since_epoch())
-                                                  .count());
+    return observation_message;
+}
 
-        const auto imu_observation = observation_message.mutable_imu_observation();
-        short value;
+void Mpu6050::PopulateSensorProperties(const Json::Value& config) {
+    sensor_properties.set_roll(config["position"]["roll"].asDouble() * M_PI / 180);
+    sensor_properties.set_pitch(config["position"]["pitch"].asDouble() * M_PI / 180);
+    sensor_properties.set_yaw(config["position"]["yaw"].asDouble() * M_PI / 180);
+}
 
-        value = (buffered_observation->readings[0] << 8) | buffered_observation->readings[1];
-        imu_observation->set_linear_acceleration_x((value * 9.81 / 16384) + offset_accel_x);
+void Mpu6050::ConfigureFifo(const Json::Value& fifo_config) {
+    const auto dlpf_mode = fifo_config["dlpf_mode"].asInt();
+    CHECK(dlpf_mode >= 0 && dlpf_mode <= 6) << "DLPF mode must be between 0 and 6";
 
-        value = (buffered_observation->readings[2] << 8) | buffered_observation->readings[3];
-        imu_observation->set_linear_acceleration_y((value * 9.81 / 16384) + offset_accel_y);
+    // the gyroscope output rate, from which the sample rate is divided, is 8 kHz only when the DLPF is disabled
+    const auto gyro_output_rate = (dlpf_mode == 0) ? 8000 : 1000;
+    const auto sample_rate = fifo_config["sample_rate"].asInt();
+    CHECK(sample_rate > 0 && sample_rate <= gyro_output_rate)
+            << "Sample rate must be between 1 and " << gyro_output_rate << " Hz with DLPF mode " << dlpf_mode;
+    const auto sample_rate_divider = std::clamp(gyro_output_rate / sample_rate - 1, 0, 255);
 
-        value = (buffered_observation->readings[4] << 8) | buffered_observation->readings[5];
-        imu_observation->set_linear_acceleration_z((value * 9.81 / 16384) + offset_accel_z);
+    fifo_sample_period = std::chrono::microseconds{1000000 * (sample_rate_divider + 1) / gyro_output_rate};
+    fifo_read_interval = std::chrono::milliseconds{fifo_config["read_interval"].asInt()};
+    CHECK(fifo_read_interval.count() > 0) << "FIFO read interval must be positive";
 
-        value = (buffered_observation->readings[8] << 8) | buffered_observation->readings[9];
-        imu_observation->set_angular_velocity_x((value * M_PI / 180 / 131) + offset_gyro_x);
+    // make sure the FIFO is drained well before it can fill up
+    const auto fifo_fill_time = fifo_sample_period * (fifo_capacity / sizeof(Sample::readings));
+    LOG_IF(WARNING, fifo_read_interval > (fifo_fill_time / 2))
+            << "FIFO read interval is too long for the sample rate, the FIFO may overflow between reads";
 
-        value = (buffered_observation->readings[10] << 8) | buffered_observation->readings[11];
-        imu_observation->set_angular_velocity_y((value * M_PI / 180 / 131) + offset_gyro_y);
+    LOG(INFO) << "Using FIFO with sample period " << fifo_sample_period.count() << " us, DLPF mode " << dlpf_mode
+              << ", read interval " << fifo_read_interval.count() << " ms";
 
-        value = (buffered_observation->readings[12] << 8) | buffered_observation->readings[13];
-        imu_observation->set_angular_velocity_z((value * M_PI / 180 / 131) + offset_gyro_z);
-    });
+    i2c_device->WriteRegister(config_register, dlpf_mode);
+    i2c_device->WriteRegister(sample_rate_divider_register, sample_rate_divider);
 
-    return observation_message;
+    // queue accelerometer, temperature, and gyroscope readings so that each FIFO frame has the same layout as the
+    // readings registers
+    i2c_device->WriteRegister(fifo_enable_register, 0xf8);
 }
 
-void Mpu6050::PopulateSensorProperties(const Json::Value& config) {
-    sensor_properties.set_roll(config["position"]["roll"].asDouble() * M_PI / 180);
-    sensor_properties.set_pitch(config["position"]["pitch"].asDouble() * M_PI / 180);
-    sensor_properties.set_yaw(config["position"]["yaw"].asDouble() * M_PI / 180);
+void Mpu6050::ProcessFifoData() {
+    constexpr auto frame_size = sizeof(Sample::readings);
+
+    std::vector<unsigned char> fifo_data(fifo_capacity);
+    std::vector<Sample> samples;
+    samples.reserve(fifo_capacity / frame_size);
+
+    // a read whose host time was late can put its newest samples after the oldest ones of the next read, so
+    // timestamps are kept increasing across reads (and FIFO resets)
+    std::chrono::system_clock::time_point last_sample_time;
+
+    while (run_sensor_thread) {
+        i2c_device->WriteRegister(user_control_register, 1 << 2);  // reset FIFO
+        i2c_device->WriteRegister(user_control_register, 1 << 6);  // enable FIFO
+
+        // the sensor's clock is the count of samples it has queued since the FIFO was reset, which is anchored to the
+        // host's clock by taking each FIFO read as an upper bound for the acquisition time of the newest sample
+        whisker::SensorTimeSync<std::chrono::microseconds> sensor_time_sync;
+        std::uint64_t num_fifo_samples = 0;
+
+        auto next_read_time = std::chrono::steady_clock::now() + fifo_read_interval;
+
+        while (run_sensor_thread) {
+            std::this_thread::sleep_until(next_read_time);
+            next_read_time += fifo_read_interval;
+
+            unsigned char interrupt_status;
+            i2c_device->ReadRegisters(interrupt_status_register, &interrupt_status, 1);
+            unsigned char fifo_count_bytes[2];
+            i2c_device->ReadRegisters(fifo_count_register_base, fifo_count_bytes, 2);
+            const auto fifo_count = (fifo_count_bytes[0] << 8) | fifo_count_bytes[1];
+            const auto host_time = std::chrono::system_clock::now();
+
+            if ((interrupt_status & (1 << 4)) || (fifo_count >= fifo_capacity)) {
+                // frames were lost and the FIFO may no longer be aligned to a frame boundary
+                LOG(WARNING) << "FIFO overflowed, resetting";
+                break;
+            }
+
+            const auto num_frames = fifo_count / frame_size;
+            if (num_frames == 0) {
+                continue;
+            }
+
+            i2c_device->ReadRegisters(fifo_data_register, fifo_data.data(), num_frames * frame_size);
+            num_fifo_samples += num_frames;
+
+            const auto newest_sample_time = sensor_time_sync.GetAdjustedTime(
+                    (num_fifo_samples * fifo_sample_period).count(), host_time);
+
+            samples.resize(num_frames);
+            for (std::size_t i = 0; i < num_frames; ++i) {
+                std::copy_n(&fifo_data[i * frame_size], frame_size, samples[i].readings);
+                samples[i].timestamp = std::max(
+                        std::chrono::system_clock::time_point{std::chrono::microseconds{newest_sample_time} -
+                                                              (num_frames - 1 - i) * fifo_sample_period},
+                        last_sample_time + std::chrono::microseconds{1});
+                last_sample_time = samples[i].timestamp;
+            }
+
+            if (sample_ring.Push(samples.begin(), samples.end()) > 0) {
+                LOG_EVERY_N(WARNING, 100) << "Sample buffer full, " << sample_ring.GetNumOverwritten()
+                                          << " samples overwritten so far";
+            }
+        }
+    }
 }
 
 void Mpu6050::ProcessSensorData() {
+    Sample sample;
+
     while (run_sensor_thread) {
-        observation_buffer.Write([this](const auto observation) {
-            CHECK_ERR(write(i2c_fd, &readings_register_base, 1));
-            CHECK_ERR(read(i2c_fd, observation->readings, sizeof(observation->readings)));
-            observation->timestamp = std::chrono::system_clock::now();
-        });
+        i2c_device->ReadRegisters(readings_register_base, sample.readings, sizeof(sample.readings));
+        sample.timestamp = std::chrono::system_clock::now();
+
+        if (sample_ring.Push(sample) > 0) {
+            LOG_EVERY_N(WARNING, 1000) << "Sample buffer full, " << sample_ring.GetNumOverwritten()
+                                       << " samples overwritten so far";
+        }
     }
 }
@@ -3,40 +3,51 @@
 
 #include <atomic>
 #include <chrono>
+#include <memory>
 #include <thread>
 #include <json/json.h>
-#include <whisker/overwriting_buffer.h>
+#include <whisker/sample_ring.h>
 #include <client.pb.h>
+#include "i2c_device.h"
 
 class Mpu6050 final {
   public:
-    Mpu6050(const Json::Value& config);
+    // opens the I2C device given by the config
+    explicit Mpu6050(const Json::Value& config);
+    Mpu6050(const Json::Value& config, std::unique_ptr<I2cDevice> i2c_device);
     ~Mpu6050();
 
     Mpu6050(const Mpu6050&) = delete;
     Mpu6050& operator=(const Mpu6050&) = delete;
 
     whisker::proto::ImuSensorProperties GetSensorProperties() const;
-    whisker::proto::ObservationMessage GetLatestObservation();
+
+    // blocks until a sample is available, then returns all of the samples acquired since the previous call
+    whisker::proto::ObservationMessage GetObservationBatch();
 
   private:
-    struct Observation {
+    struct Sample {
         std::chrono::system_clock::time_point timestamp;
         unsigned char readings[14];
     };
 
     void PopulateSensorProperties(const Json::Value& config);
-    void ProcessSensorData();
+    void ConfigureFifo(const Json::Value& fifo_config);
+    void ProcessFifoData();    // drains the sensor's FIFO at 'fifo_read_interval'
+    void ProcessSensorData();  // continuously polls the readings registers
 
     whisker::proto::ImuSensorProperties sensor_properties;
-    whisker::OverwritingBuffer<Observation> observation_buffer;
-    int i2c_fd;
+    whisker::SampleRing<Sample> sample_ring{2048};  // the oldest samples are overwritten when full
+    const std::unique_ptr<I2cDevice> i2c_device;
+    bool is_using_fifo = false;
     double offset_accel_x;
     double offset_accel_y;
     double offset_accel_z;
     double offset_gyro_x;
     double offset_gyro_y;
     double offset_gyro_z;
+    std::chrono::microseconds fifo_sample_period;
+    std::chrono::milliseconds fifo_read_interval;
     std::thread sensor_thread;
     std::atomic_bool run_sensor_thread = true;
 };
@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <chrono>
+#include <cstddef>
 #include <memory>
 #include <mutex>
 #include <optional>
@@ -10,6 +11,7 @@
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <json/json.h>
+#include <whisker/credit_stream.h>
 #include <whisker/init.h>
 #include <whisker/server_connection.h>
 #include <whisker/zmq_connection.h>
@@ -21,24 +23,50 @@ DEFINE_string(logs, "input.obslog", "Comma-separated list of observation log fil
 DEFINE_uint64(startoffset, 0, "Number of milliseconds from log start at which to start playback");
 DEFINE_uint64(stopoffset, 0, "Number of milliseconds from log start at which to stop playback (0 = no limit)");
 DEFINE_bool(realtime, true, "Whether to play back observations at the rate at which they were recorded");
+DEFINE_double(rate, 1, "Speed of realtime playback relative to the rate at which observations were recorded");
+DEFINE_bool(ordered, true, "Whether to keep observations from all logs in timestamp order when not playing back in "
+                           "realtime");
 
 class Client final : public whisker::Init::Context {
   public:
     using whisker::Init::Context::Context;
 
+    ~Client() override {
+        // the message handlers and observation streams may be waiting on the logs for their sensors' turns, and the
+        // message handlers reference the observation streams, so stop both before destruction
+        for (const auto& sensor : sensors) {
+            sensor->log->Stop();
+        }
+        for (const auto& sensor : sensors) {
+            sensor->server_connection->StopMessageHandling();
+        }
+    }
+
   private:
+    struct Sensor {
+        std::shared_ptr<ObservationLog> log;
+        std::size_t log_sensor_index;  // a log can hold the observations of several sensors
+        std::shared_ptr<whisker::ServerConnection> server_connection;
+        std::unique_ptr<whisker::CreditStream> observation_stream;  // declared last to be destroyed first
+    };
+
     struct TimeOffsetData {
         std::mutex mutex;
-        std::optional<std::chrono::system_clock::duration> offset;
+        std::optional<PlaybackClock> clock;
         std::chrono::system_clock::time_point earliest_log_start = std::chrono::system_clock::time_point::max();
     };
 
     void InitContext(Json::Value&& config) override {
-        LOG_IF(INFO, FLAGS_realtime) << "'realtime' option enabled, observations may be dropped";
+        CHECK_GT(FLAGS_rate, 0) << "Playback rate must be positive";
+        LOG_IF(INFO, FLAGS_realtime) << "'realtime' option enabled at " << FLAGS_rate
+                                     << "x speed, observations may be dropped";
+        LOG_IF(INFO, !FLAGS_realtime && FLAGS_ordered) << "'ordered' option enabled, observations from all logs will "
+                                                          "be played back in timestamp order";
 
         const auto& vehicle_config = config["vehicle"];
 
         const auto offset_data = std::make_shared<TimeOffsetData>();
+        const auto playback_order = FLAGS_ordered ? std::make_shared<PlaybackOrder>() : nullptr;
 
         std::vector<std::pair<std::shared_ptr<whisker::ServerConnection>, whisker::proto::SensorClientInitMessage>>
                 init_messages;
@@ -46,42 +74,73 @@ class Client final : public whisker::Init::Context {
         std::istringstream log_file_names{FLAGS_logs};
         std::string log_file_name;
 
-        // each log file is a separate sensor client, so they each have an ObservationLog + ServerConnection
-        // with which to independently play back observations
+        // each sensor in each log file is a separate sensor client, so they each have a ServerConnection with which to
+        // independently play back observations from their log
         for (auto i = 0; std::getline(log_file_names, log_file_name, ','); ++i) {
-            const auto sensor_name = "sensor" + std::to_string(i);
-            LOG(INFO) << sensor_name << ": " << log_file_name;
+            const auto log_name = "log" + std::to_string(i);
+            LOG(INFO) << log_name << ": " << log_file_name;
 
             std::shared_ptr<ObservationLog> log;
             if (FLAGS_realtime) {
                 log = std::make_shared<ObservationLog>(
-                        log_file_name, sensor_name, FLAGS_startoffset, FLAGS_stopoffset, [offset_data] {
+                        log_file_name, log_name, FLAGS_startoffset, FLAGS_stopoffset, [offset_data] {
                             std::scoped_lock lock(offset_data->mutex);
-                            if (!offset_data->offset) {
-                                offset_data->offset = std::chrono::system_clock::now() -
-                                                      offset_data->earliest_log_start + std::chrono::seconds{1};
+                            if (!offset_data->clock) {
+                                offset_data->clock = PlaybackClock{offset_data->earliest_log_start,
+                                                                   std::chrono::system_clock::now() +
+                                                                           std::chrono::seconds{1},
+                                                                   FLAGS_rate};
                             }
-                            return *(offset_data->offset);
+                            return *(offset_data->clock);
                         });
             } else {
-                log = std::make_shared<ObservationLog>(log_file_name, sensor_name, FLAGS_startoffset, FLAGS_stopoffset);
+                log = std::make_shared<ObservationLog>(log_file_name, log_name, FLAGS_startoffset, FLAGS_stopoffset,
+                                                       ObservationLog::GetPlaybackClockCallback{}, playback_order);
             }
 
-            whisker::ServerEventHandlers event_handlers;
-            event_handlers.SetMessageHandler<whisker::proto::RequestObservationMessage>(
-                    [log](auto&& message, auto& connection) {
-                        log->GetNextObservationMessage(
-                                [&connection](const auto& observation) { connection.SendMessage(observation); });
-                    });
+            for (std::size_t log_sensor_index = 0; log_sensor_index < log->GetNumSensors(); ++log_sensor_index) {
+                const auto sensor_name = "sensor" + std::to_string(sensors.size());
+                LOG(INFO) << sensor_name << ": " << log->GetSensorId(log_sensor_index) << " in " << log_name;
+
+                const auto sensor = sensors.emplace_back(std::make_unique<Sensor>()).get();
+                sensor->log = log;
+                sensor->log_sensor_index = log_sensor_index;
+
+                // push observations while the server has granted credits for them, until the end of the log
+                sensor->observation_stream = std::make_unique<whisker::CreditStream>([sensor] {
+                    return sensor->log->GetNextObservationMessage(
+                            sensor->log_sensor_index,
+                            [sensor](const auto& observation) { sensor->server_connection->SendMessage(observation); });
+                });
+
+                auto init_msg = log->GetSensorClientInitMessage(log_sensor_index);
+                init_msg.set_vehicle_id(vehicle_config["id"].asString());  // override with the vehicle_id in our config
+                init_msg.set_use_streaming(true);
+
+                whisker::ServerEventHandlers event_handlers;
+                event_handlers.disconnect_handler = [sensor, init_msg](auto& connection) {
+                    sensor->observation_stream->ResetCredits();
+                    // enqueue init msg to send when reconnected
+                    connection.SendMessage(init_msg);
+                };
+                // servers without observation streaming request each observation instead
+                event_handlers.SetMessageHandler<whisker::proto::RequestObservationMessage>(
+                        [sensor](auto&& message, auto& connection) {
+                            sensor->log->GetNextObservationMessage(
+                                    sensor->log_sensor_index,
+                                    [&connection](const auto& observation) { connection.SendMessage(observation); });
+                        });
+                event_handlers.SetMessageHandler<whisker::proto::GrantObservationCreditsMessage>(
+                        [sensor](auto&& message, auto& connection) {
+                            sensor->observation_stream->AddCredits(message.num_credits());
+                        });
 
-            const auto server_connection = whisker::ZmqConnection::CreateServerConnection(
-                    vehicle_config["server_address"].asString(),
-                    vehicle_config["id"].asString() + FLAGS_id + sensor_name, std::move(event_handlers));
-            server_connections.emplace_back(server_connection);
+                sensor->server_connection = whisker::ZmqConnection::CreateServerConnection(
+                        vehicle_config["server_address"].asString(),
+                        vehicle_config["id"].asString() + FLAGS_id + sensor_name, std::move(event_handlers));
 
-            auto init_msg = log->GetSensorClientInitMessage();
-            init_msg.set_vehicle_id(vehicle_config["id"].asString());  // override with the vehicle_id in our config
-            init_messages.emplace_back(server_connection, std::move(init_msg));
+                init_messages.emplace_back(sensor->server_connection, std::move(init_msg));
+            }
 
             offset_data->earliest_log_start = std::min(offset_data->earliest_log_start, log->GetPlaybackStartTime());
         }
@@ -91,7 +150,7 @@ class Client final : public whisker::Init::Context {
         }
     }
 
-    std::vector<std::shared_ptr<whisker::ServerConnection>> server_connections;
+    std::vector<std::unique_ptr<Sensor>> sensors;
 };
 
 int main(int argc, char* argv[]) {
@@ -1,139 +1,317 @@
 #ifndef WHISKER_OBSERVATION_LOG_H
 #define WHISKER_OBSERVATION_LOG_H
 
+#include <algorithm>
 #include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <cstddef>
 #include <cstdint>
 #include <functional>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <string>
-#include <thread>
+#include <vector>
 #include <glog/logging.h>
 #include <whisker/message_log.h>
 #include <client.pb.h>
 
+// Maps log timestamps to the system time at which they're played back, so that multiple logs can be played back in
+// sync with each other.
+struct PlaybackClock {
+    std::chrono::system_clock::time_point log_start;     // log time that is played back at 'playback_start'
+    std::chrono::system_clock::time_point playback_start;
+    double rate = 1;  // log time that elapses per unit of system time
+
+    std::chrono::system_clock::time_point GetPlaybackTime(std::uint64_t timestamp) const {
+        const auto log_time = std::chrono::system_clock::time_point{std::chrono::milliseconds{timestamp}};
+        return playback_start + std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                                        std::chrono::duration<double>(log_time - log_start) / rate);
+    }
+};
+
+// Keeps the observations of several logs in timestamp order relative to each other, when they aren't already kept
+// in order by being played back in sync with a PlaybackClock.  Each log waits to play back its next observation until
+// no other log has an earlier one.
+class PlaybackOrder final {
+  public:
+    // returns the ID with which the log reports the timestamp of its next observation
+    std::size_t AddLog(std::uint64_t next_timestamp) {
+        std::scoped_lock lock(order_mutex);
+        next_timestamps.push_back(next_timestamp);
+        return next_timestamps.size() - 1;
+    }
+
+    // logs that have finished should set this to 'finished_timestamp' so that they don't hold up the others
+    void SetNextTimestamp(std::size_t log_id, std::uint64_t next_timestamp) {
+        {
+            std::scoped_lock lock(order_mutex);
+            next_timestamps[log_id] = next_timestamp;
+        }
+        order_cv.notify_all();
+    }
+
+    // returns false if stopped while waiting
+    bool WaitForTurn(std::size_t log_id) {
+        std::unique_lock lock(order_mutex);
+        order_cv.wait(lock, [this, log_id] {
+            return is_stopped ||
+                   (next_timestamps[log_id] <= *std::min_element(next_timestamps.begin(), next_timestamps.end()));
+        });
+        return !is_stopped;
+    }
+
+    void Stop() {
+        {
+            std::scoped_lock lock(order_mutex);
+            is_stopped = true;
+        }
+        order_cv.notify_all();
+    }
+
+    static constexpr std::uint64_t finished_timestamp = std::numeric_limits<std::uint64_t>::max();
+
+  private:
+    std::vector<std::uint64_t> next_timestamps;  // indexed by log ID
+    bool is_stopped = false;
+    std::mutex order_mutex;
+    std::condition_variable order_cv;
+};
+
+// Plays back an observation log written for a single sensor, or one that multiplexes all of a vehicle's sensors
+// (see VehicleObservationLogHeader).
+//
+// Either way, the log is read as one sequential stream.  Each sensor's observations are taken by calling
+// GetNextObservationMessage() with its index, which waits until that sensor's next observation is at the head of the
+// stream, so the sensors' observations are played back in the order that they were logged.
+
 class ObservationLog final {
   public:
-    using GetOffsetCallback = std::function<std::chrono::system_clock::duration()>;
+    using GetPlaybackClockCallback = std::function<PlaybackClock()>;
 
+    // observations are played back in real time (scaled by the clock's rate) if 'get_playback_clock_callback' is
+    // given, or otherwise as fast as they're taken, in order with other logs that share 'playback_order' if given
     ObservationLog(const std::string& log_file_path,
-                   const std::string& sensor_name,
+                   const std::string& log_name,
                    std::uint64_t start_offset,
                    std::uint64_t stop_offset,
-                   const GetOffsetCallback& get_offset_callback = {})
-            : sensor_name(sensor_name),
+                   const GetPlaybackClockCallback& get_playback_clock_callback = {},
+                   std::shared_ptr<PlaybackOrder> playback_order = {})
+            : log_name(log_name),
               stop_offset(stop_offset),
-              is_realtime(get_offset_callback),
-              get_offset_callback(get_offset_callback) {
-        log_reader = whisker::MessageLogReader::CreateInstance(log_file_path);
+              is_realtime(get_playback_clock_callback),
+              get_playback_clock_callback(get_playback_clock_callback),
+              playback_order(std::move(playback_order)) {
+        is_vehicle_log =
+                whisker::MessageLogReader::ReadMagicHeader(log_file_path) == whisker::vehicle_observation_log_header;
 
-        CHECK(log_reader->Read(init_msg)) << "Error reading SensorClientInitMessage from observation log";
+        if (is_vehicle_log) {
+            log_reader = whisker::MessageLogReader::CreateInstance(log_file_path,
+                                                                   whisker::vehicle_observation_log_header);
+            CHECK(log_reader->Read(log_header)) << "Error reading VehicleObservationLogHeader from observation log";
+            CHECK_GT(log_header.sensors_size(), 0) << "No sensors in observation log";
+            LOG(INFO) << log_name << ": observations from vehicle '" << log_header.vehicle_id() << "'";
+        } else {
+            // a single sensor log starts with just the sensor's SensorClientInitMessage
+            log_reader = whisker::MessageLogReader::CreateInstance(log_file_path);
+            const auto log_sensor = log_header.add_sensors();
+            log_sensor->set_sensor_id(log_name);
+            CHECK(log_reader->Read(*log_sensor->mutable_init_message()))
+                    << "Error reading SensorClientInitMessage from observation log";
+        }
 
-        if (init_msg.sensor_type_case() == whisker::proto::SensorClientInitMessage::kLidarProperties) {
-            LOG(INFO) << sensor_name << ": rate " << init_msg.lidar_properties().rotations_per_second()
-                      << " Hz, angular resolution " << init_msg.lidar_properties().angular_resolution() * 180 / M_PI
-                      << " degrees";
+        for (const auto& log_sensor : log_header.sensors()) {
+            const auto& init_msg = log_sensor.init_message();
+            if (init_msg.sensor_type_case() == whisker::proto::SensorClientInitMessage::kLidarProperties) {
+                LOG(INFO) << log_name << ": " << log_sensor.sensor_id() << " rate "
+                          << init_msg.lidar_properties().rotations_per_second() << " Hz, angular resolution "
+                          << init_msg.lidar_properties().angular_resolution() * 180 / M_PI << " degrees";
+            }
         }
 
         ReadNextObservation();
-        CHECK(cached_observation_valid) << "No observation messages in log";
+        CHECK(cached_entry_valid) << "No observation messages in log";
 
-        log_start_timestamp = cached_observation.timestamp();
+        log_start_timestamp = cached_entry.observation().timestamp();
 
         if (start_offset > 0) {
             AdvanceToOffset(start_offset);
         }
 
-        playback_start_timestamp = cached_observation.timestamp();
+        playback_start_timestamp = cached_entry.observation().timestamp();
+
+        if (this->playback_order) {
+            playback_order_id = this->playback_order->AddLog(GetNextTimestamp());
+        }
     }
 
     ObservationLog(const ObservationLog&) = delete;
     ObservationLog& operator=(const ObservationLog&) = delete;
 
-    whisker::proto::SensorClientInitMessage GetSensorClientInitMessage() const { return init_msg; }
+    std::size_t GetNumSensors() const { return log_header.sensors_size(); }
+
+    // the sensor's ID as logged by the server, or the log name for single sensor logs
+    const std::string& GetSensorId(std::size_t sensor_index) const {
+        return log_header.sensors(sensor_index).sensor_id();
+    }
+
+    whisker::proto::SensorClientInitMessage GetSensorClientInitMessage(std::size_t sensor_index) const {
+        return log_header.sensors(sensor_index).init_message();
+    }
 
     std::chrono::system_clock::time_point GetPlaybackStartTime() const {
         return std::chrono::system_clock::time_point{std::chrono::milliseconds{playback_start_timestamp}};
     }
 
+    // returns false if the end of the log (or the stop offset) has been reached, or playback has been stopped
     template <typename ObservationMessageCallback>
-    void GetNextObservationMessage(const ObservationMessageCallback& callback) {
-        bool retry_required;
+    bool GetNextObservationMessage(std::size_t sensor_index, const ObservationMessageCallback& callback) {
+        std::unique_lock lock(log_mutex);
 
-        do {
-            retry_required = false;
+        while (true) {
+            log_cv.wait(lock, [this, sensor_index] {
+                return is_stopped || !HasObservationToPlay() || (cached_entry.sensor_index() == sensor_index);
+            });
 
-            if (cached_observation_valid &&
-                ((stop_offset == 0) || (stop_offset > (cached_observation.timestamp() - log_start_timestamp)))) {
-                ++num_read;
+            if (is_stopped || !HasObservationToPlay()) {
+                if (!is_finished) {
+                    is_finished = true;
+                    LOG(INFO) << log_name << ": finished, played back " << num_read << " observations, dropped "
+                              << num_dropped << " (" << 100.0 * num_dropped / num_read << "%)";
+                }
+                return false;
+            }
 
-                if (is_realtime) {
-                    if (num_read == 1) {
-                        // get the shared time offset that is synchronized with other playback clients
-                        time_offset = get_offset_callback();
-                    }
+            if (playback_order && !playback_order->WaitForTurn(playback_order_id)) {
+                is_stopped = true;
+                continue;
+            }
 
-                    const auto respond_time = std::chrono::system_clock::time_point{std::chrono::milliseconds{
-                                                      cached_observation.timestamp()}} +
-                                              time_offset;
+            ++num_read;
+            auto is_dropped = false;
 
-                    if (respond_time >= std::chrono::system_clock::now()) {
-                        std::this_thread::sleep_until(respond_time);
-                    } else {
-                        // couldn't keep up with message rate in observation log, so drop this message
-                        retry_required = true;
-                        ++num_dropped;
-                    }
+            if (is_realtime) {
+                if (num_read == 1) {
+                    // get the shared clock that is synchronized with other playback clients
+                    playback_clock = get_playback_clock_callback();
                 }
 
-                if (!retry_required) {
-                    callback(cached_observation);
+                const auto respond_time = playback_clock.GetPlaybackTime(cached_entry.observation().timestamp());
+
+                if (respond_time >= std::chrono::system_clock::now()) {
+                    if (log_cv.wait_until(lock, respond_time, [this] { return is_stopped; })) {
+                        continue;
+                    }
+                } else {
+                    // couldn't keep up with message rate in observation log, so drop this message
+                    is_dropped = true;
+                    ++num_dropped;
                 }
+            }
 
-                LOG_EVERY_T(INFO, 5) << sensor_name << ": " << log_reader->GetReadPercent() * 100 << "% of log, "
-                                     << cached_observation.timestamp() - log_start_timestamp << " ms from start";
+            if (!is_dropped) {
+                callback(cached_entry.observation());
+            }
+
+            LOG_EVERY_T(INFO, 5) << log_name << ": " << log_reader->GetReadPercent() * 100 << "% of log, "
+                                 << cached_entry.observation().timestamp() - log_start_timestamp << " ms from start";
 
-                ReadNextObservation();
-            } else {
-                LOG(INFO) << sensor_name << ": finished, played back " << num_read << " observations, dropped "
-                          << num_dropped << " (" << 100.0 * num_dropped / num_read << "%)";
+            ReadNextObservation();
+            if (playback_order) {
+                playback_order->SetNextTimestamp(playback_order_id, GetNextTimestamp());
             }
-        } while (retry_required);
+            // the next observation may belong to a different sensor
+            log_cv.notify_all();
+
+            if (!is_dropped) {
+                return true;
+            }
+        }
+    }
+
+    // makes GetNextObservationMessage() return false, including in any threads that are waiting in it (this also
+    // stops the other logs sharing this log's PlaybackOrder)
+    void Stop() {
+        if (playback_order) {
+            playback_order->Stop();
+        }
+        {
+            std::scoped_lock lock(log_mutex);
+            is_stopped = true;
+        }
+        log_cv.notify_all();
     }
 
   private:
-    void ReadNextObservation() { cached_observation_valid = log_reader->Read(cached_observation); }
+    bool HasObservationToPlay() const {
+        return cached_entry_valid &&
+               ((stop_offset == 0) || (stop_offset > (cached_entry.observation().timestamp() - log_start_timestamp)));
+    }
+
+    std::uint64_t GetNextTimestamp() const {
+        return HasObservationToPlay() ? cached_entry.observation().timestamp() : PlaybackOrder::finished_timestamp;
+    }
+
+    void ReadNextObservation() {
+        if (is_vehicle_log) {
+            cached_entry_valid = log_reader->Read(cached_entry);
+            if (cached_entry_valid) {
+                CHECK_LT(cached_entry.sensor_index(), GetNumSensors())
+                        << "Observation from unknown sensor in observation log";
+            }
+        } else {
+            cached_entry_valid = log_reader->Read(*cached_entry.mutable_observation());
+        }
+    }
 
     void AdvanceToOffset(std::uint64_t offset) {
-        LOG(INFO) << sensor_name << ": advancing to " << offset << " ms from start";
+        LOG(INFO) << log_name << ": advancing to " << offset << " ms from start";
+
+        // use the log's index if it has one
+        if (log_reader->SeekToTimestamp(log_start_timestamp + offset)) {
+            ReadNextObservation();
+            CHECK(cached_entry_valid) << "Error reading observation after seeking in log file";
+            LOG(INFO) << log_name << ": seeked to " << cached_entry.observation().timestamp() - log_start_timestamp
+                      << " ms from start";
+            return;
+        }
+
         auto num_skipped = 0;
-        auto timestamp = cached_observation.timestamp();
+        auto timestamp = cached_entry.observation().timestamp();
         while (timestamp < (log_start_timestamp + offset)) {
             ReadNextObservation();
-            CHECK(cached_observation_valid) << "Advanced past the end of log file";
+            CHECK(cached_entry_valid) << "Advanced past the end of log file";
             ++num_skipped;
-            timestamp = cached_observation.timestamp();
+            timestamp = cached_entry.observation().timestamp();
         }
-        LOG(INFO) << sensor_name << ": advanced past " << num_skipped << " messages";
+        LOG(INFO) << log_name << ": advanced past " << num_skipped << " messages";
     }
 
-    const std::string sensor_name;
+    const std::string log_name;
     const std::uint64_t stop_offset;
     const bool is_realtime;
-    const GetOffsetCallback get_offset_callback;
+    const GetPlaybackClockCallback get_playback_clock_callback;
+    const std::shared_ptr<PlaybackOrder> playback_order;
+    std::size_t playback_order_id = 0;
 
     std::shared_ptr<whisker::MessageLogReader> log_reader;
-    whisker::proto::SensorClientInitMessage init_msg;
+    bool is_vehicle_log;
+    whisker::proto::VehicleObservationLogHeader log_header;  // holds a single sensor for single sensor logs
     std::uint64_t log_start_timestamp;       // timestamp of first message in log file
     std::uint64_t playback_start_timestamp;  // timestamp of first message to play back having applied start offset
-    std::chrono::system_clock::duration time_offset;  // difference between system time and log message time
+    PlaybackClock playback_clock;
 
     unsigned int num_read = 0;
     unsigned int num_dropped = 0;
+    bool is_finished = false;
+    bool is_stopped = false;
+    std::mutex log_mutex;
+    std::condition_variable log_cv;
 
-    // prefetch the next ObservationMessage in the log to reduce latency
-    whisker::proto::ObservationMessage cached_observation;
-    bool cached_observation_valid;
+    // prefetch the next observation in the log to reduce latency (its sensor index is always 0 in single sensor logs)
+    whisker::proto::VehicleObservationLogEntry cached_entry;
+    bool cached_entry_valid;
 };
 
 #endif  // WHISKER_OBSERVATION_LOG_H
@@ -4,10 +4,6 @@ import {MapControls} from 'three/examples/jsm/controls/MapControls';
 import {CSS2DObject, CSS2DRenderer} from 'three/examples/jsm/renderers/CSS2DRenderer';
 import SubmapTextureData from './SubmapTextureData';
 
-// milliseconds to wait after receiving data before sending another request
-const mapDataRequestPeriod = 200;
-const vehiclePosesRequestPeriod = 60;
-
 // arbitrary 'height' values for layering
 const cameraHeight = 6;
 const indicatorHeight = 4;
@@ -49,12 +45,6 @@ class MapControl extends React.Component {
             new THREE.BufferGeometry().setAttribute('position', new THREE.Float32BufferAttribute(indicatorPoints, 3)),
             new THREE.LineBasicMaterial({color: indicatorLineColor}));
 
-        this.mapDataRequestMessage = this.props.connection.newMessage('RequestMapDataMessage',
-            {mapId: props.mapId, haveVersion: 0});
-
-        this.vehiclePosesRequestMessage = this.props.connection.newMessage('RequestVehiclePosesMessage',
-            {mapId: props.mapId});
-
         this.mountRef = React.createRef();
         this.mountResizeObserver = new ResizeObserver(() => {
             const {clientWidth, clientHeight} = this.mountRef.current;
@@ -93,14 +83,13 @@ class MapControl extends React.Component {
 
         this.mountResizeObserver.observe(this.mountRef.current);
 
-        this.resetMapDataRequestTimeout();
-        this.resetVehiclePosesRequestTimeout();
+        // the server pushes map data and vehicle pose updates until unsubscribed
+        this.props.connection.sendNewMessage('RequestSubscribeMapMessage', {mapId: this.props.mapId});
     }
 
     componentWillUnmount() {
         this.isShuttingDown = true;
-        clearTimeout(this.vehiclePosesRequestTimeout);
-        clearTimeout(this.mapDataRequestTimeout);
+        this.props.connection.sendNewMessage('RequestUnsubscribeMapMessage', {mapId: this.props.mapId});
         this.mountResizeObserver.disconnect();
         this.controls.dispose();
         this.cssRenderer.domElement.remove();
@@ -119,20 +108,6 @@ class MapControl extends React.Component {
         }
     }
 
-    resetMapDataRequestTimeout() {
-        clearTimeout(this.mapDataRequestTimeout);
-        this.mapDataRequestTimeout = setTimeout(() => {
-            this.props.connection.sendMessage(this.mapDataRequestMessage);
-        }, mapDataRequestPeriod);
-    }
-
-    resetVehiclePosesRequestTimeout() {
-        clearTimeout(this.vehiclePosesRequestTimeout);
-        this.vehiclePosesRequestTimeout = setTimeout(() => {
-            this.props.connection.sendMessage(this.vehiclePosesRequestMessage);
-        }, vehiclePosesRequestPeriod);
-    }
-
     getSubmapKeyFromProto(protoMsg) {
         return protoMsg.trajectoryId + ':' + protoMsg.index;
     }
@@ -193,10 +168,7 @@ class MapControl extends React.Component {
             });
         }
 
-        this.resetMapDataRequestTimeout();
-
         if (mapData.isNewMapVersion) {
-            this.mapDataRequestMessage.haveVersion = mapData.mapVersion;
             this.clearSubmaps(obsoleteSubmapKeys);
             this.requestRender();
         }
@@ -224,8 +196,6 @@ class MapControl extends React.Component {
                 this.requestRender();
             }
         });
-
-        this.resetMapDataRequestTimeout();
     }
 
     processVehiclePoses(vehiclePoses) {
@@ -278,8 +248,6 @@ class MapControl extends React.Component {
             this.indicators.delete(key);
             this.requestRender();
         }
-
-        this.resetVehiclePosesRequestTimeout();
     }
 
     render() {
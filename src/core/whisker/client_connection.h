@@ -20,6 +20,10 @@ class ClientConnection {
 
     virtual void SendMessage(const google::protobuf::MessageLite& message, const std::string& recipient_id) = 0;
 
+    // serializes the message once for all recipients
+    virtual void MulticastMessage(const google::protobuf::MessageLite& message,
+                                  const std::unordered_set<std::string>& recipient_ids) = 0;
+
     virtual void BroadcastMessage(const google::protobuf::MessageLite& message) = 0;
 
     virtual void StopMessageHandling() = 0;
@@ -0,0 +1,80 @@
+#ifndef WHISKER_CREDIT_STREAM_H
+#define WHISKER_CREDIT_STREAM_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace whisker {
+
+// Flow control for a client that pushes a stream of messages to the server instead of waiting for each one to be
+// requested.
+//
+// The server grants credits, each of which allows one more message to be sent.  While credits are available, a thread
+// repeatedly calls 'send_func', which is expected to block until the next message is available and then send it.
+// 'send_func' returns false to end the stream (e.g. at the end of a log file).
+
+class CreditStream final {
+  public:
+    explicit CreditStream(std::function<bool()> send_func)
+            : send_func(std::move(send_func)), stream_thread(&CreditStream::SendMessages, this) {}
+
+    ~CreditStream() {
+        {
+            std::scoped_lock lock(credits_mutex);
+            run_stream_thread = false;
+        }
+        credits_cv.notify_one();
+        stream_thread.join();
+    }
+
+    CreditStream(const CreditStream&) = delete;
+    CreditStream& operator=(const CreditStream&) = delete;
+
+    void AddCredits(unsigned int num_credits_to_add) {
+        {
+            std::scoped_lock lock(credits_mutex);
+            num_credits += num_credits_to_add;
+        }
+        credits_cv.notify_one();
+    }
+
+    // the server issues a new set of credits when a client reconnects, so unused ones should be discarded on disconnect
+    void ResetCredits() {
+        std::scoped_lock lock(credits_mutex);
+        num_credits = 0;
+    }
+
+  private:
+    void SendMessages() {
+        std::unique_lock lock(credits_mutex);
+        while (true) {
+            credits_cv.wait(lock, [this] { return !run_stream_thread || (num_credits > 0); });
+            if (!run_stream_thread) {
+                return;
+            }
+            --num_credits;
+
+            lock.unlock();
+            const auto is_stream_continuing = send_func();
+            lock.lock();
+
+            if (!is_stream_continuing) {
+                return;
+            }
+        }
+    }
+
+    const std::function<bool()> send_func;
+    unsigned int num_credits = 0;
+    bool run_stream_thread = true;
+    std::mutex credits_mutex;
+    std::condition_variable credits_cv;
+    std::thread stream_thread;  // declared last so that it starts after everything it accesses is initialized
+};
+
+}  // namespace whisker
+
+#endif  // WHISKER_CREDIT_STREAM_H
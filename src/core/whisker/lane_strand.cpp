@@ -0,0 +1,124 @@
+#include "lane_strand.h"
+
+namespace whisker {
+
+namespace {
+
+// number of tasks a lane runs before yielding the pool thread to other work
+constexpr unsigned int max_tasks_per_turn = 64;
+
+}  // namespace
+
+LaneStrand::LaneStrand(std::shared_ptr<ThreadPool> thread_pool) : thread_pool(std::move(thread_pool)) {}
+
+LaneStrand::~LaneStrand() {
+    FinishQueueSync();
+}
+
+std::size_t LaneStrand::GetNumTasks() {
+    std::scoped_lock lock(strand_mutex);
+    return num_tasks;
+}
+
+void LaneStrand::FinishQueueSync() {
+    std::unique_lock lock(strand_mutex);
+    idle_cv.wait(lock, [this] { return num_tasks == 0; });
+}
+
+void LaneStrand::AddTask(const std::string* lane_id, Task&& task) {
+    std::scoped_lock lock(strand_mutex);
+    ++num_tasks;
+
+    if (!lane_id) {
+        blocked_tasks.push_back({std::nullopt, std::move(task)});
+        if ((blocked_tasks.size() == 1) && !is_exclusive_task_running && (num_running_lanes == 0)) {
+            thread_pool->Schedule([this] { ProcessExclusiveTasks(); });
+        }
+        return;
+    }
+
+    if (is_exclusive_task_running || !blocked_tasks.empty()) {
+        // has to wait for an earlier exclusive task
+        blocked_tasks.push_back({*lane_id, std::move(task)});
+    } else {
+        auto& lane = lanes[*lane_id];
+        lane.tasks.emplace_back(std::move(task));
+        StartLane(lane);
+    }
+}
+
+void LaneStrand::StartLane(Lane& lane) {
+    if (!lane.is_running) {
+        lane.is_running = true;
+        ++num_running_lanes;
+        thread_pool->Schedule([this, &lane] { ProcessLane(lane); });
+    }
+}
+
+void LaneStrand::ProcessLane(Lane& lane) {
+    std::unique_lock lock(strand_mutex);
+
+    for (auto num_run = 0u; !lane.tasks.empty(); ++num_run) {
+        if (num_run == max_tasks_per_turn) {
+            thread_pool->Schedule([this, &lane] { ProcessLane(lane); });
+            return;
+        }
+
+        auto task = std::move(lane.tasks.front());
+        lane.tasks.pop_front();
+
+        lock.unlock();
+        task();
+        task = {};
+        lock.lock();
+
+        --num_tasks;
+    }
+
+    lane.is_running = false;
+    --num_running_lanes;
+
+    if ((num_running_lanes == 0) && !blocked_tasks.empty()) {
+        // the last lane to go idle lets the oldest blocked exclusive task run
+        thread_pool->Schedule([this] { ProcessExclusiveTasks(); });
+    } else if (num_tasks == 0) {
+        // after this the LaneStrand may be destroyed, so no members can be touched once the lock is released
+        idle_cv.notify_all();
+    }
+}
+
+void LaneStrand::ProcessExclusiveTasks() {
+    std::unique_lock lock(strand_mutex);
+
+    // invariant: no lanes are running and the first blocked task is exclusive
+    while (!blocked_tasks.empty() && (num_running_lanes == 0)) {
+        auto task = std::move(blocked_tasks.front().task);
+        blocked_tasks.pop_front();
+        is_exclusive_task_running = true;
+
+        // every lane is idle and empty, so drop them rather than keep one around for every ID ever seen
+        lanes.clear();
+
+        lock.unlock();
+        task();
+        task = {};
+        lock.lock();
+
+        is_exclusive_task_running = false;
+        --num_tasks;
+
+        // release the lane tasks that were waiting on this one, up to the next exclusive task
+        while (!blocked_tasks.empty() && blocked_tasks.front().lane_id) {
+            auto& lane = lanes[*blocked_tasks.front().lane_id];
+            lane.tasks.emplace_back(std::move(blocked_tasks.front().task));
+            blocked_tasks.pop_front();
+            StartLane(lane);
+        }
+    }
+
+    if (num_tasks == 0) {
+        idle_cv.notify_all();
+    }
+}
+
+}  // namespace whisker
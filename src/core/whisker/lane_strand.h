@@ -0,0 +1,78 @@
+#ifndef WHISKER_LANE_STRAND_H
+#define WHISKER_LANE_STRAND_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <whisker/task.h>
+#include <whisker/thread_pool.h>
+
+namespace whisker {
+
+// Strand whose tasks may be split into independent lanes, run on a shared ThreadPool.
+//
+// Tasks added with AddLaneTask() run serially with respect to other tasks in the same lane, but concurrently with
+// tasks in other lanes.  Tasks added with AddTask() are exclusive: they run after every previously added task (in any
+// lane) has finished and before any subsequently added task starts.  This allows independent streams of work to
+// proceed in parallel while operations that touch shared state still observe a single, well-defined order.
+//
+// Waiting for lanes to drain never blocks a pool thread, so any number of LaneStrands can share a pool of any size.
+
+class LaneStrand final {
+  public:
+    explicit LaneStrand(std::shared_ptr<ThreadPool> thread_pool);
+    ~LaneStrand();
+
+    LaneStrand(const LaneStrand&) = delete;
+    LaneStrand& operator=(const LaneStrand&) = delete;
+
+    template <typename T>
+    void AddTask(T&& task) {
+        AddTask(nullptr, Task{std::forward<T>(task)});
+    }
+
+    template <typename T>
+    void AddLaneTask(const std::string& lane_id, T&& task) {
+        AddTask(&lane_id, Task{std::forward<T>(task)});
+    }
+
+    // includes tasks that are currently running
+    std::size_t GetNumTasks();
+
+    // blocks until all previously added tasks have run (must not be called from within a task on this LaneStrand)
+    void FinishQueueSync();
+
+  private:
+    struct Lane {
+        std::deque<Task> tasks;
+        bool is_running = false;
+    };
+
+    struct BlockedTask {
+        std::optional<std::string> lane_id;  // empty if this is an exclusive task
+        Task task;
+    };
+
+    void AddTask(const std::string* lane_id, Task&& task);
+    void StartLane(Lane& lane);
+    void ProcessLane(Lane& lane);
+    void ProcessExclusiveTasks();
+
+    const std::shared_ptr<ThreadPool> thread_pool;
+    std::unordered_map<std::string, Lane> lanes;  // only erased from while no lanes are running
+    std::deque<BlockedTask> blocked_tasks;        // exclusive tasks and everything added after them, in order
+    unsigned int num_running_lanes = 0;
+    bool is_exclusive_task_running = false;
+    std::size_t num_tasks = 0;
+    std::mutex strand_mutex;
+    std::condition_variable idle_cv;
+};
+
+}  // namespace whisker
+
+#endif  // WHISKER_LANE_STRAND_H
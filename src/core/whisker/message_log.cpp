@@ -1,20 +1,109 @@
 #include "message_log.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
 #include <filesystem>
 #include <mutex>
+#include <string_view>
+#include <thread>
 #include <utility>
+#include <vector>
+#ifdef _WIN32
+#define NOGDI     // wingdi.h defines ERROR, which conflicts with glog
+#define NOMINMAX  // so that std::min() and std::max() aren't replaced by macros
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #include <glog/logging.h>
 #include <google/protobuf/message_lite.h>
 #include <zlib.h>
 #include <whisker/task_queue.h>
+#include <whisker/thread_pool.h>
+
+// There are two message log formats:
+//
+// v1 is a gzip stream containing the 64-bit magic header followed by each message as a 32-bit size and the serialized
+// message.  It can only be read sequentially.
+//
+// v2 (the format written now) is an uncompressed header, followed by independently compressed blocks of messages, an
+// index of the blocks, and a trailer locating the index:
+//
+//   header:  format signature (64) | magic header (64) | MessageLogCompression of the blocks (32)
+//   block:   compressed size (32) | uncompressed size (32) | number of messages (32) | first timestamp (64) |
+//            last timestamp (64) | compressed records
+//   record:  message size (32) | timestamp (64) | serialized message
+//   index:   for each block, its file offset (64) followed by a copy of its header
+//   trailer: index offset (64) | number of blocks (64) | index signature (64)
+//
+// All values are little-endian.  Since each block can be decompressed on its own, readers can seek to a message by its
+// ordinal or timestamp by binary searching the index, and the writer can compress blocks in parallel.  A log that
+// wasn't closed cleanly has no index, in which case it's rebuilt by walking the block headers.
 
 namespace whisker {
 
-class MessageLogReaderImpl final : public MessageLogReader {
-  public:
-    MessageLogReaderImpl(const std::string& log_file_path, std::uint64_t magic_header) : log_file_path(log_file_path) {
-        LOG(INFO) << "Opening message log file " << std::filesystem::absolute(log_file_path).lexically_normal()
-                  << " for reading";
+namespace {
+
+constexpr std::uint64_t indexed_log_signature = 0x3276676F6C6B7377;  // little-endian 'wsklogv2'
+constexpr std::uint64_t index_signature = 0x7865646E696B7377;        // little-endian 'wskindex'
+constexpr std::size_t file_header_size = 20;
+constexpr std::size_t block_header_size = 28;
+constexpr std::size_t record_header_size = 12;
+constexpr std::size_t index_entry_size = 8 + block_header_size;
+constexpr std::size_t trailer_size = 24;
+constexpr std::size_t target_block_size = 256 * 1024;  // uncompressed bytes of records per block
+
+struct BlockHeader {
+    std::uint32_t compressed_size = 0;
+    std::uint32_t uncompressed_size = 0;
+    std::uint32_t num_messages = 0;
+    std::uint64_t first_timestamp = 0;
+    std::uint64_t last_timestamp = 0;  // largest timestamp in the block
+};
+
+template <typename T>
+void AppendValue(std::string& buffer, T value) {
+    for (unsigned int i = 0; i < sizeof(T); ++i) {
+        buffer.push_back(static_cast<char>((value >> (i * 8)) & 0xff));
+    }
+}
+
+template <typename T>
+T DecodeValue(const char* data) {
+    T value = 0;
+    for (unsigned int i = 0; i < sizeof(T); ++i) {
+        value |= static_cast<T>(static_cast<unsigned char>(data[i])) << (i * 8);
+    }
+    return value;
+}
+
+void AppendBlockHeader(std::string& buffer, const BlockHeader& header) {
+    AppendValue(buffer, header.compressed_size);
+    AppendValue(buffer, header.uncompressed_size);
+    AppendValue(buffer, header.num_messages);
+    AppendValue(buffer, header.first_timestamp);
+    AppendValue(buffer, header.last_timestamp);
+}
+
+BlockHeader DecodeBlockHeader(const char* data) {
+    BlockHeader header;
+    header.compressed_size = DecodeValue<std::uint32_t>(data);
+    header.uncompressed_size = DecodeValue<std::uint32_t>(data + 4);
+    header.num_messages = DecodeValue<std::uint32_t>(data + 8);
+    header.first_timestamp = DecodeValue<std::uint64_t>(data + 12);
+    header.last_timestamp = DecodeValue<std::uint64_t>(data + 20);
+    return header;
+}
+
+}  // namespace
 
+class GzipMessageLogReader final : public MessageLogReader {
+  public:
+    GzipMessageLogReader(const std::string& log_file_path, std::uint64_t magic_header) : log_file_path(log_file_path) {
         log_file = gzopen(log_file_path.c_str(), "rb");
         PCHECK(log_file) << "Error opening message log file";
 
@@ -25,7 +114,7 @@ class MessageLogReaderImpl final : public MessageLogReader {
         CHECK_EQ(log_file_header, magic_header) << "Unexpected header value in message log file";
     }
 
-    ~MessageLogReaderImpl() override {
+    ~GzipMessageLogReader() override {
         CHECK_EQ(gzclose_r(log_file), Z_OK) << "Error closing message log file";
         LOG(INFO) << "Closed message log file " << std::filesystem::absolute(log_file_path).lexically_normal();
     }
@@ -44,6 +133,10 @@ class MessageLogReaderImpl final : public MessageLogReader {
         return message.ParseFromString(buffer);
     }
 
+    // v1 logs have no index
+    bool SeekToIndex(std::uint64_t index) override { return false; }
+    bool SeekToTimestamp(std::uint64_t timestamp) override { return false; }
+
     float GetReadPercent() override {
         std::scoped_lock lock(log_file_mutex);
         return static_cast<float>(gzoffset(log_file)) / file_size;
@@ -51,15 +144,9 @@ class MessageLogReaderImpl final : public MessageLogReader {
 
     template <typename T>
     bool ReadValue(T& value) {
-        constexpr auto width = sizeof(T);
-        unsigned char buf[width];
-        if (gzfread(buf, width, 1, log_file) == 1) {
-            value = 0;
-            for (auto i = (width - 1); i > 0; --i) {
-                value |= buf[i];
-                value <<= 8;
-            }
-            value |= buf[0];
+        char buf[sizeof(T)];
+        if (gzfread(buf, sizeof(T), 1, log_file) == 1) {
+            value = DecodeValue<T>(buf);
             return true;
         } else {
             return false;
@@ -73,64 +160,696 @@ class MessageLogReaderImpl final : public MessageLogReader {
     std::string buffer;
 };
 
+// read-only memory mapping of a whole file
+class MappedFile final {
+  public:
+    explicit MappedFile(const std::string& file_path) {
+#ifdef _WIN32
+        file = CreateFileA(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        CHECK_NE(file, INVALID_HANDLE_VALUE) << "(Windows error " << GetLastError() << ") Error opening file";
+        LARGE_INTEGER file_size;
+        CHECK(GetFileSizeEx(file, &file_size)) << "(Windows error " << GetLastError() << ") Error getting file size";
+        size = static_cast<std::size_t>(file_size.QuadPart);
+        if (size > 0) {
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            CHECK(mapping) << "(Windows error " << GetLastError() << ") Error mapping file";
+            data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            CHECK(data) << "(Windows error " << GetLastError() << ") Error mapping file";
+        }
+#else
+        const auto fd = open(file_path.c_str(), O_RDONLY);
+        PCHECK(fd >= 0) << "Error opening file";
+        struct stat file_stat;
+        PCHECK(fstat(fd, &file_stat) == 0) << "Error getting file size";
+        size = static_cast<std::size_t>(file_stat.st_size);
+        if (size > 0) {
+            const auto address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            PCHECK(address != MAP_FAILED) << "Error mapping file";
+            data = static_cast<const char*>(address);
+            madvise(address, size, MADV_SEQUENTIAL);
+        }
+        close(fd);  // the mapping stays valid
+#endif
+    }
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data) {
+            UnmapViewOfFile(data);
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+#else
+        if (data) {
+            munmap(const_cast<char*>(data), size);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* GetData() const { return data; }
+    std::size_t GetSize() const { return size; }
+
+  private:
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping = nullptr;
+#endif
+    const char* data = nullptr;
+    std::size_t size = 0;
+};
+
+// Reads v2 logs through a memory mapping.  Messages are parsed straight out of the mapping when blocks are
+// uncompressed, or otherwise out of blocks that a background thread decompresses ahead of the reader.
+class IndexedMessageLogReader final : public MessageLogReader {
+  public:
+    IndexedMessageLogReader(const std::string& log_file_path, std::uint64_t magic_header)
+            : log_file_path(log_file_path), log_file(log_file_path) {
+        CHECK_GE(log_file.GetSize(), file_header_size) << "Error reading header value from message log file";
+        const auto file_header = log_file.GetData();
+        CHECK_EQ(DecodeValue<std::uint64_t>(file_header), indexed_log_signature) << "Not an indexed message log";
+        CHECK_EQ(DecodeValue<std::uint64_t>(file_header + 8), magic_header)
+                << "Unexpected header value in message log file";
+        compression = static_cast<MessageLogCompression>(DecodeValue<std::uint32_t>(file_header + 16));
+        CHECK(compression == MessageLogCompression::none || compression == MessageLogCompression::zlib)
+                << "Unsupported compression method in message log file";
+
+        if (!LoadIndex()) {
+            LOG(WARNING) << "Message log file has no index (it may not have been closed cleanly), scanning blocks";
+            ScanBlocks();
+        }
+
+        std::uint64_t num_messages = 0;
+        for (auto& block : blocks) {
+            block.first_message_index = num_messages;
+            num_messages += block.header.num_messages;
+        }
+        if (!blocks.empty()) {
+            blocks_end_offset = blocks.back().offset + block_header_size + blocks.back().header.compressed_size;
+        }
+
+        LOG(INFO) << "Message log file has " << num_messages << " messages in " << blocks.size() << " blocks";
+
+        if (compression != MessageLogCompression::none) {
+            prefetch_thread = std::thread{&IndexedMessageLogReader::PrefetchBlocks, this};
+        }
+    }
+
+    ~IndexedMessageLogReader() override {
+        if (prefetch_thread.joinable()) {
+            {
+                std::scoped_lock lock(prefetch_mutex);
+                stop_prefetching = true;
+            }
+            prefetch_cv.notify_all();
+            prefetch_thread.join();
+        }
+        LOG(INFO) << "Closed message log file " << std::filesystem::absolute(log_file_path).lexically_normal();
+    }
+
+  private:
+    struct Block {
+        std::uint64_t offset;  // of the block header in the file
+        BlockHeader header;
+        std::uint64_t first_message_index;
+    };
+
+    struct DecodedBlock {
+        std::size_t block_index = 0;
+        std::vector<char> decompressed_data;
+        std::string_view data;  // records, in either 'decompressed_data' or the mapped file
+    };
+
+    bool Read(google::protobuf::MessageLite& message) override {
+        std::scoped_lock lock(read_mutex);
+        std::string_view message_data;
+        if (!NextRecord(message_data)) {
+            return false;
+        }
+        return message.ParseFromArray(message_data.data(), static_cast<int>(message_data.size()));
+    }
+
+    bool SeekToIndex(std::uint64_t index) override {
+        std::scoped_lock lock(read_mutex);
+
+        // last block starting at or before 'index'
+        auto block = std::upper_bound(blocks.begin(), blocks.end(), index, [](auto index, const auto& block) {
+            return index < block.first_message_index;
+        });
+        if (block == blocks.begin()) {
+            return false;
+        }
+        --block;
+        if (index >= (block->first_message_index + block->header.num_messages) ||
+            !SeekToBlock(block - blocks.begin())) {
+            return false;
+        }
+
+        std::string_view message_data;
+        for (auto i = block->first_message_index; i < index; ++i) {
+            NextRecord(message_data);
+        }
+        return true;
+    }
+
+    bool SeekToTimestamp(std::uint64_t timestamp) override {
+        std::scoped_lock lock(read_mutex);
+
+        // first block that could contain a message at or after 'timestamp'
+        const auto block =
+                std::lower_bound(blocks.begin(), blocks.end(), timestamp, [](const auto& block, auto timestamp) {
+                    return block.header.last_timestamp < timestamp;
+                });
+        if (block == blocks.end() || !SeekToBlock(block - blocks.begin())) {
+            return false;
+        }
+
+        // skip to the first record that is at or after 'timestamp', without parsing any messages
+        const auto& data = current_block.data;
+        while ((data.size() - block_position) >= record_header_size) {
+            if (DecodeValue<std::uint64_t>(data.data() + block_position + 4) >= timestamp) {
+                return true;
+            }
+            std::string_view message_data;
+            NextRecord(message_data);
+        }
+        return false;
+    }
+
+    float GetReadPercent() override {
+        std::scoped_lock lock(read_mutex);
+        if (next_block == 0) {
+            return blocks.empty() ? 1 : 0;
+        }
+        const auto& block = blocks[current_block.block_index];
+        const auto block_fraction =
+                current_block.data.empty() ? 1.0 : static_cast<double>(block_position) / current_block.data.size();
+        const auto block_size = block_header_size + block.header.compressed_size;
+        return static_cast<float>((block.offset + block_fraction * block_size) / blocks_end_offset);
+    }
+
+    bool LoadIndex() {
+        const auto file_size = log_file.GetSize();
+        if (file_size < (file_header_size + trailer_size)) {
+            return false;
+        }
+
+        const auto trailer = log_file.GetData() + file_size - trailer_size;
+        if (DecodeValue<std::uint64_t>(trailer + 16) != index_signature) {
+            return false;
+        }
+
+        const auto index_offset = DecodeValue<std::uint64_t>(trailer);
+        const auto num_blocks = DecodeValue<std::uint64_t>(trailer + 8);
+        if ((index_offset + num_blocks * index_entry_size + trailer_size) != file_size) {
+            return false;
+        }
+
+        blocks.reserve(num_blocks);
+        for (std::uint64_t i = 0; i < num_blocks; ++i) {
+            const auto entry = log_file.GetData() + index_offset + (i * index_entry_size);
+            blocks.push_back({DecodeValue<std::uint64_t>(entry), DecodeBlockHeader(entry + 8), 0});
+        }
+        return true;
+    }
+
+    void ScanBlocks() {
+        const auto file_size = log_file.GetSize();
+        std::uint64_t offset = file_header_size;
+        while ((offset + block_header_size) <= file_size) {
+            const auto block_header = DecodeBlockHeader(log_file.GetData() + offset);
+            const auto next_offset = offset + block_header_size + block_header.compressed_size;
+            if (next_offset > file_size) {
+                LOG(WARNING) << "Ignoring truncated block at end of message log file";
+                break;
+            }
+            blocks.push_back({offset, block_header, 0});
+            offset = next_offset;
+        }
+    }
+
+    DecodedBlock DecodeBlock(std::size_t block_index) {
+        const auto& block = blocks[block_index];
+        const std::string_view block_data{log_file.GetData() + block.offset + block_header_size,
+                                          block.header.compressed_size};
+
+        DecodedBlock decoded_block;
+        decoded_block.block_index = block_index;
+
+        if (compression == MessageLogCompression::none) {
+            decoded_block.data = block_data;
+            return decoded_block;
+        }
+
+        decoded_block.decompressed_data.resize(block.header.uncompressed_size);
+        auto uncompressed_size = static_cast<uLongf>(decoded_block.decompressed_data.size());
+        if ((uncompress(reinterpret_cast<Bytef*>(decoded_block.decompressed_data.data()), &uncompressed_size,
+                        reinterpret_cast<const Bytef*>(block_data.data()), block_data.size()) != Z_OK) ||
+            (uncompressed_size != decoded_block.decompressed_data.size())) {
+            LOG(ERROR) << "Error decompressing block from message log file";
+            decoded_block.decompressed_data.clear();
+        }
+        decoded_block.data = {decoded_block.decompressed_data.data(), decoded_block.decompressed_data.size()};
+        return decoded_block;
+    }
+
+    // runs ahead of the reader, decompressing up to 'max_prefetched_blocks' blocks following 'prefetch_next_block'
+    void PrefetchBlocks() {
+        std::unique_lock lock(prefetch_mutex);
+        while (true) {
+            prefetch_cv.wait(lock, [this] {
+                return stop_prefetching ||
+                       ((prefetched_blocks.size() < max_prefetched_blocks) && (prefetch_next_block < blocks.size()));
+            });
+            if (stop_prefetching) {
+                return;
+            }
+
+            const auto block_index = prefetch_next_block++;
+            const auto generation = prefetch_generation;
+            lock.unlock();
+
+            auto decoded_block = DecodeBlock(block_index);
+
+            lock.lock();
+            // discard the block if the reader has seeked elsewhere in the meantime
+            if (generation == prefetch_generation) {
+                prefetched_blocks.push_back(std::move(decoded_block));
+                prefetch_cv.notify_all();
+            }
+        }
+    }
+
+    // makes 'next_block' the current block, taking it from the prefetch thread if there is one
+    void LoadNextBlock() {
+        if (!prefetch_thread.joinable()) {
+            current_block = DecodeBlock(next_block);
+        } else {
+            std::unique_lock lock(prefetch_mutex);
+            prefetch_cv.wait(lock, [this] { return !prefetched_blocks.empty(); });
+            current_block = std::move(prefetched_blocks.front());
+            prefetched_blocks.pop_front();
+            lock.unlock();
+            prefetch_cv.notify_all();
+        }
+        block_position = 0;
+        ++next_block;
+    }
+
+    bool SeekToBlock(std::size_t block_index) {
+        if (prefetch_thread.joinable()) {
+            {
+                std::scoped_lock lock(prefetch_mutex);
+                ++prefetch_generation;
+                prefetched_blocks.clear();
+                prefetch_next_block = block_index;
+            }
+            prefetch_cv.notify_all();
+        }
+
+        next_block = block_index;
+        LoadNextBlock();
+        return !current_block.data.empty();
+    }
+
+    // advances past the next record, moving on to the next block if necessary
+    bool NextRecord(std::string_view& message_data) {
+        while (block_position >= current_block.data.size()) {
+            if (next_block >= blocks.size()) {
+                return false;
+            }
+            LoadNextBlock();
+        }
+
+        const auto& data = current_block.data;
+        if ((data.size() - block_position) < record_header_size) {
+            LOG(ERROR) << "Corrupt record in message log file";
+            block_position = data.size();
+            return false;
+        }
+        const auto message_size = DecodeValue<std::uint32_t>(data.data() + block_position);
+        block_position += record_header_size;
+
+        if ((data.size() - block_position) < message_size) {
+            LOG(ERROR) << "Corrupt record in message log file";
+            block_position = data.size();
+            return false;
+        }
+        message_data = data.substr(block_position, message_size);
+        block_position += message_size;
+        return true;
+    }
+
+    static constexpr std::size_t max_prefetched_blocks = 4;
+
+    const std::string log_file_path;
+    const MappedFile log_file;
+    MessageLogCompression compression;
+    std::vector<Block> blocks;
+    std::uint64_t blocks_end_offset = 0;  // where the index starts, so that reading the last block is 100%
+
+    // reader state
+    std::mutex read_mutex;
+    DecodedBlock current_block;
+    std::size_t block_position = 0;  // offset of the next record in 'current_block'
+    std::size_t next_block = 0;
+
+    // prefetch state
+    std::deque<DecodedBlock> prefetched_blocks;  // consecutive blocks starting at 'next_block'
+    std::size_t prefetch_next_block = 0;
+    unsigned int prefetch_generation = 0;  // incremented on each seek
+    bool stop_prefetching = false;
+    std::mutex prefetch_mutex;
+    std::condition_variable prefetch_cv;
+    std::thread prefetch_thread;
+};
+
 std::shared_ptr<MessageLogReader> MessageLogReader::CreateInstance(const std::string& log_file_path,
                                                                    std::uint64_t magic_header) {
-    return std::make_shared<MessageLogReaderImpl>(log_file_path, magic_header);
+    LOG(INFO) << "Opening message log file " << std::filesystem::absolute(log_file_path).lexically_normal()
+              << " for reading";
+
+    const auto log_file = std::fopen(log_file_path.c_str(), "rb");
+    PCHECK(log_file) << "Error opening message log file";
+    unsigned char signature[2] = {};
+    std::fread(signature, 1, sizeof(signature), log_file);
+    std::fclose(log_file);
+
+    // v1 logs are gzip streams
+    if (signature[0] == 0x1f && signature[1] == 0x8b) {
+        return std::make_shared<GzipMessageLogReader>(log_file_path, magic_header);
+    } else {
+        return std::make_shared<IndexedMessageLogReader>(log_file_path, magic_header);
+    }
+}
+
+std::uint64_t MessageLogReader::ReadMagicHeader(const std::string& log_file_path) {
+    // v1 logs are gzip streams that start with the magic header, while v2 logs have it after the format signature
+    const auto log_file = gzopen(log_file_path.c_str(), "rb");
+    PCHECK(log_file) << "Error opening message log file";
+    char file_header[16] = {};
+    const auto num_read = gzread(log_file, file_header, sizeof(file_header));
+    const auto is_gzip = !gzdirect(log_file);
+    gzclose_r(log_file);
+
+    if (is_gzip) {
+        CHECK_GE(num_read, 8) << "Error reading header value from message log file";
+        return DecodeValue<std::uint64_t>(file_header);
+    }
+    CHECK_EQ(num_read, static_cast<int>(sizeof(file_header))) << "Error reading header value from message log file";
+    CHECK_EQ(DecodeValue<std::uint64_t>(file_header), indexed_log_signature) << "Not an indexed message log";
+    return DecodeValue<std::uint64_t>(file_header + 8);
 }
 
 class MessageLogWriterImpl final : public MessageLogWriter {
   public:
-    MessageLogWriterImpl(const std::string& log_file_path, std::uint64_t magic_header) : log_file_path(log_file_path) {
+    MessageLogWriterImpl(const std::string& log_file_path, std::uint64_t magic_header, MessageLogWriterOptions options)
+            : log_file_path(log_file_path),
+              compression(options.compression),
+              max_buffered_bytes(options.max_buffered_bytes),
+              drop_when_full(options.drop_when_full),
+              block_size(std::min(target_block_size, options.max_buffered_bytes / 4)),
+              thread_pool(options.compression_thread_pool ? std::move(options.compression_thread_pool)
+                                                          : std::make_shared<ThreadPool>()) {
         LOG(INFO) << "Opening message log file " << std::filesystem::absolute(log_file_path).lexically_normal()
                   << " for writing";
 
-        log_file = gzopen(log_file_path.c_str(), "wb");
+        log_file = std::fopen(log_file_path.c_str(), "wb");
         PCHECK(log_file) << "Error opening message log file";
 
-        WriteValue(magic_header);
+        std::string file_header;
+        AppendValue(file_header, indexed_log_signature);
+        AppendValue(file_header, magic_header);
+        AppendValue(file_header, static_cast<std::uint32_t>(compression));
+        WriteBuffer(file_header);
+
+        block = std::make_shared<PendingBlock>();
     }
 
     ~MessageLogWriterImpl() override {
         task_queue.FinishQueueSync();  // do this in destructor to ensure class members outlive queue
-        CHECK_EQ(gzclose_w(log_file), Z_OK) << "Error closing message log file";
-        LOG(INFO) << "Closed message log file " << std::filesystem::absolute(log_file_path).lexically_normal();
+        SubmitBlock();
+        {
+            // wait for the blocks being compressed, since their tasks refer to this writer
+            std::unique_lock lock(pending_blocks_mutex);
+            pending_blocks_cv.wait(lock, [this] { return pending_blocks.empty() && !is_writing_blocks; });
+        }
+        WriteIndex();
+        CHECK_EQ(std::fclose(log_file), 0) << "Error closing message log file";
+        LOG(INFO) << "Closed message log file " << std::filesystem::absolute(log_file_path).lexically_normal()
+                  << (num_dropped_writes ? ", dropped " + std::to_string(num_dropped_writes) + " messages" : "");
     }
 
   private:
-    void Write(std::shared_ptr<const google::protobuf::MessageLite> message) override {
-        task_queue.AddTask([this, message = std::move(message)] {
+    struct Block {
+        std::uint64_t offset;
+        BlockHeader header;
+    };
+
+    // block that has been filled with records and is waiting to be compressed and written
+    struct PendingBlock {
+        BlockHeader header;
+        std::string data;  // records, replaced by the compressed block once compressed
+        std::size_t num_buffered_bytes = 0;
+        std::vector<WrittenCallback> written_callbacks;
+        bool is_compressed = false;
+    };
+
+    void Write(std::shared_ptr<const google::protobuf::MessageLite> message,
+               std::uint64_t timestamp,
+               WrittenCallback written_callback) override {
+        if (!Enqueue(message, timestamp, written_callback, !drop_when_full)) {
+            std::uint64_t num_dropped;
+            {
+                std::scoped_lock lock(buffer_mutex);
+                num_dropped = ++num_dropped_writes;
+            }
+            LOG_EVERY_N(WARNING, 100) << "Message log buffer full, dropped " << num_dropped << " messages so far";
+            if (written_callback) {
+                written_callback(false);
+            }
+        }
+    }
+
+    bool TryWrite(std::shared_ptr<const google::protobuf::MessageLite> message,
+                  std::uint64_t timestamp,
+                  WrittenCallback written_callback) override {
+        return Enqueue(message, timestamp, written_callback, false);
+    }
+
+    std::size_t GetNumPendingWrites() override {
+        std::scoped_lock lock(buffer_mutex);
+        return num_pending_writes;
+    }
+
+    std::uint64_t GetNumDroppedWrites() override {
+        std::scoped_lock lock(buffer_mutex);
+        return num_dropped_writes;
+    }
+
+    // 'message' and 'written_callback' are moved from only if the message is accepted, which fails if the buffer limit
+    // has been reached and 'wait' is false
+    bool Enqueue(std::shared_ptr<const google::protobuf::MessageLite>& message,
+                 std::uint64_t timestamp,
+                 WrittenCallback& written_callback,
+                 bool wait) {
+        const auto record_size = record_header_size + message->ByteSizeLong();
+
+        {
+            std::unique_lock lock(buffer_mutex);
+            // a message larger than the limit is still accepted when nothing else is buffered
+            const auto has_space = [this, record_size] {
+                return (num_buffered_bytes + record_size <= max_buffered_bytes) || (num_buffered_bytes == 0);
+            };
+            if (!has_space()) {
+                // the block being filled counts towards the limit until it's written, so submit it now in case it
+                // would otherwise not fill up
+                if (!is_flush_requested) {
+                    is_flush_requested = true;
+                    task_queue.AddTask([this] {
+                        {
+                            std::scoped_lock lock(buffer_mutex);
+                            is_flush_requested = false;
+                        }
+                        SubmitBlock();
+                    });
+                }
+
+                if (!wait) {
+                    return false;
+                }
+                buffer_cv.wait(lock, has_space);
+            }
+            num_buffered_bytes += record_size;
+            ++num_pending_writes;
+        }
+
+        task_queue.AddTask([this, message = std::move(message), timestamp, record_size,
+                            written_callback = std::move(written_callback)]() mutable {
             message->SerializeToString(&serialization_buffer);
             CHECK_LE(serialization_buffer.size(), UINT32_MAX) << "Messages larger than UINT32_MAX are unsupported";
-            WriteValue(static_cast<std::uint32_t>(serialization_buffer.size()));
-            WriteBuffer(serialization_buffer.c_str(), serialization_buffer.size());
+
+            auto& header = block->header;
+            if (header.num_messages == 0) {
+                header.first_timestamp = timestamp;
+            }
+            header.last_timestamp = std::max(header.last_timestamp, timestamp);
+            ++header.num_messages;
+
+            AppendValue(block->data, static_cast<std::uint32_t>(serialization_buffer.size()));
+            AppendValue(block->data, timestamp);
+            block->data.append(serialization_buffer);
+            block->num_buffered_bytes += record_size;
+            if (written_callback) {
+                block->written_callbacks.push_back(std::move(written_callback));
+            }
+
+            if (block->data.size() >= block_size) {
+                SubmitBlock();
+            }
         });
+
+        return true;
     }
 
-    std::size_t GetNumPendingWrites() override { return task_queue.GetNumTasks(); }
+    // hands the block being filled off to be compressed on the thread pool
+    void SubmitBlock() {
+        if (block->header.num_messages == 0) {
+            return;
+        }
+
+        auto submitted_block = std::exchange(block, std::make_shared<PendingBlock>());
+        {
+            std::scoped_lock lock(pending_blocks_mutex);
+            pending_blocks.push_back(submitted_block);
+        }
 
-    template <typename T>
-    void WriteValue(T value) {
-        constexpr auto width = sizeof(T);
-        char buf[width];
-        for (unsigned int i = 0; i < width; ++i) {
-            buf[i] = ((value >> (i * 8)) & 0xff);
+        thread_pool->Schedule([this, submitted_block = std::move(submitted_block)] {
+            CompressBlock(*submitted_block);
+            // the block has to be marked and written in one critical section, since another thread that's writing
+            // could otherwise write it and let the destructor finish before this task is done with the writer
+            std::unique_lock lock(pending_blocks_mutex);
+            submitted_block->is_compressed = true;
+            WriteCompressedBlocks(lock);
+        });
+    }
+
+    void CompressBlock(PendingBlock& pending_block) {
+        CHECK_LE(pending_block.data.size(), UINT32_MAX) << "Blocks larger than UINT32_MAX are unsupported";
+        pending_block.header.uncompressed_size = static_cast<std::uint32_t>(pending_block.data.size());
+
+        if (compression == MessageLogCompression::zlib) {
+            std::string compressed_data(compressBound(pending_block.data.size()), '\0');
+            auto compressed_size = static_cast<uLongf>(compressed_data.size());
+            CHECK_EQ(compress2(reinterpret_cast<Bytef*>(compressed_data.data()), &compressed_size,
+                               reinterpret_cast<const Bytef*>(pending_block.data.data()), pending_block.data.size(),
+                               Z_DEFAULT_COMPRESSION),
+                     Z_OK)
+                    << "Error compressing message log block";
+            compressed_data.resize(compressed_size);
+            pending_block.data = std::move(compressed_data);
         }
-        WriteBuffer(buf, width);
+
+        pending_block.header.compressed_size = static_cast<std::uint32_t>(pending_block.data.size());
     }
 
-    void WriteBuffer(const char* buffer, std::size_t size) {
-        CHECK_EQ(gzfwrite(buffer, size, 1, log_file), 1) << "Error writing to message log file";
+    // writes out the compressed blocks at the front of 'pending_blocks' so that blocks reach the file in the order
+    // they were filled, regardless of the order in which they finish compressing ('lock' holds 'pending_blocks_mutex')
+    void WriteCompressedBlocks(std::unique_lock<std::mutex>& lock) {
+        if (is_writing_blocks) {
+            return;  // the thread that's writing will pick up any newly compressed blocks
+        }
+        is_writing_blocks = true;
+
+        while (!pending_blocks.empty() && pending_blocks.front()->is_compressed) {
+            const auto pending_block = std::move(pending_blocks.front());
+            pending_blocks.pop_front();
+            lock.unlock();
+
+            blocks.push_back({file_offset, pending_block->header});
+            std::string header;
+            AppendBlockHeader(header, pending_block->header);
+            WriteBuffer(header);
+            WriteBuffer(pending_block->data);
+
+            {
+                std::scoped_lock buffer_lock(buffer_mutex);
+                num_buffered_bytes -= pending_block->num_buffered_bytes;
+                num_pending_writes -= pending_block->header.num_messages;
+            }
+            buffer_cv.notify_all();
+
+            for (const auto& written_callback : pending_block->written_callbacks) {
+                written_callback(true);
+            }
+
+            lock.lock();
+        }
+
+        is_writing_blocks = false;
+        pending_blocks_cv.notify_all();
+    }
+
+    void WriteIndex() {
+        const auto index_offset = file_offset;
+
+        std::string index;
+        index.reserve(blocks.size() * index_entry_size + trailer_size);
+        for (const auto& block : blocks) {
+            AppendValue(index, block.offset);
+            AppendBlockHeader(index, block.header);
+        }
+        AppendValue(index, index_offset);
+        AppendValue(index, static_cast<std::uint64_t>(blocks.size()));
+        AppendValue(index, index_signature);
+        WriteBuffer(index);
+    }
+
+    void WriteBuffer(std::string_view buffer) {
+        CHECK_EQ(std::fwrite(buffer.data(), 1, buffer.size(), log_file), buffer.size())
+                << "Error writing to message log file";
+        file_offset += buffer.size();
     }
 
     const std::string log_file_path;
-    gzFile log_file;
-    TaskQueue task_queue;
+    const MessageLogCompression compression;
+    const std::size_t max_buffered_bytes;
+    const bool drop_when_full;
+    const std::size_t block_size;  // small enough that several blocks fit within 'max_buffered_bytes'
+    const std::shared_ptr<ThreadPool> thread_pool;
+    std::FILE* log_file;
+
+    // accounting for backpressure, covering messages from Write() until their block is written to disk
+    std::size_t num_buffered_bytes = 0;
+    std::size_t num_pending_writes = 0;
+    std::uint64_t num_dropped_writes = 0;
+    bool is_flush_requested = false;
+    std::mutex buffer_mutex;
+    std::condition_variable buffer_cv;
+
+    // only used on the task queue
     std::string serialization_buffer;
+    std::shared_ptr<PendingBlock> block;  // being filled with records
+
+    std::deque<std::shared_ptr<PendingBlock>> pending_blocks;  // in the order they were filled
+    bool is_writing_blocks = false;
+    std::mutex pending_blocks_mutex;
+    std::condition_variable pending_blocks_cv;
+
+    // only used by whichever thread is writing blocks
+    std::uint64_t file_offset = 0;
+    std::vector<Block> blocks;
+
+    TaskQueue task_queue;  // declared last so that its thread starts after the other members are initialized
 };
 
 std::shared_ptr<MessageLogWriter> MessageLogWriter::CreateInstance(const std::string& log_file_path,
-                                                                   std::uint64_t magic_header) {
-    return std::make_shared<MessageLogWriterImpl>(log_file_path, magic_header);
+                                                                   std::uint64_t magic_header,
+                                                                   MessageLogWriterOptions options) {
+    return std::make_shared<MessageLogWriterImpl>(log_file_path, magic_header, std::move(options));
 }
 
 }  // namespace whisker
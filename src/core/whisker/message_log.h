@@ -1,7 +1,9 @@
 #ifndef WHISKER_MESSAGE_LOG_H
 #define WHISKER_MESSAGE_LOG_H
 
+#include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
 
@@ -11,7 +13,27 @@ class MessageLite;
 
 namespace whisker {
 
+class ThreadPool;
+
 constexpr std::uint64_t message_log_default_header = 0x3130676F6C6B7377;  // little-endian 'wsklog01'
+constexpr std::uint64_t vehicle_observation_log_header = 0x3130676C68657677;  // little-endian 'wvehlg01'
+
+enum class MessageLogCompression : std::uint32_t {
+    none = 0,
+    zlib = 1,
+};
+
+struct MessageLogWriterOptions {
+    MessageLogCompression compression = MessageLogCompression::zlib;
+
+    // limit on the size of messages that have been accepted but not yet written to disk, beyond which Write() either
+    // blocks until enough of them have been written or drops the message, and TryWrite() fails
+    std::size_t max_buffered_bytes = 64 * 1024 * 1024;
+    bool drop_when_full = false;
+
+    // pool on which blocks are compressed, which may be shared by multiple writers (one is created if not provided)
+    std::shared_ptr<ThreadPool> compression_thread_pool;
+};
 
 class MessageLogReader {
   public:
@@ -19,22 +41,51 @@ class MessageLogReader {
 
     virtual bool Read(google::protobuf::MessageLite& message) = 0;
 
+    // position the log so that the next Read() returns the message with the given ordinal (starting from 0) or the
+    // first message with a timestamp at or after the given one; these return false if the target is past the end of
+    // the log or the log has no index (i.e. it was written in the v1 format), and the read position is then undefined
+    virtual bool SeekToIndex(std::uint64_t index) = 0;
+    virtual bool SeekToTimestamp(std::uint64_t timestamp) = 0;
+
     virtual float GetReadPercent() = 0;
 
     static std::shared_ptr<MessageLogReader> CreateInstance(const std::string& log_file_path,
                                                             std::uint64_t magic_header = message_log_default_header);
+
+    // returns the magic header that the log was written with, so that different kinds of logs can be told apart
+    // before opening them
+    static std::uint64_t ReadMagicHeader(const std::string& log_file_path);
 };
 
 class MessageLogWriter {
   public:
+    using WrittenCallback = std::function<void(bool is_written)>;
+
     virtual ~MessageLogWriter() = default;
 
-    virtual void Write(std::shared_ptr<const google::protobuf::MessageLite> message) = 0;
+    // 'timestamp' is recorded in the log's index for MessageLogReader::SeekToTimestamp(), and should not decrease
+    // from one message to the next
+    //
+    // When the buffer limit in MessageLogWriterOptions has been reached, this blocks until there is room for the
+    // message, or drops it if the writer was created with 'drop_when_full'.  'written_callback' is called from one of
+    // the writer's threads once the message has been written to disk, or with false if the message was dropped.  The
+    // callback must not wait on this writer.
+    virtual void Write(std::shared_ptr<const google::protobuf::MessageLite> message,
+                       std::uint64_t timestamp = 0,
+                       WrittenCallback written_callback = {}) = 0;
+
+    // like Write(), except that this returns false immediately, without calling 'written_callback', if the buffer
+    // limit has been reached
+    virtual bool TryWrite(std::shared_ptr<const google::protobuf::MessageLite> message,
+                          std::uint64_t timestamp = 0,
+                          WrittenCallback written_callback = {}) = 0;
 
     virtual std::size_t GetNumPendingWrites() = 0;
+    virtual std::uint64_t GetNumDroppedWrites() = 0;
 
     static std::shared_ptr<MessageLogWriter> CreateInstance(const std::string& log_file_path,
-                                                            std::uint64_t magic_header = message_log_default_header);
+                                                            std::uint64_t magic_header = message_log_default_header,
+                                                            MessageLogWriterOptions options = {});
 };
 
 }  // namespace whisker
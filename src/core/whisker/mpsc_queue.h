@@ -0,0 +1,61 @@
+#ifndef WHISKER_MPSC_QUEUE_H
+#define WHISKER_MPSC_QUEUE_H
+
+#include <atomic>
+#include <utility>
+
+namespace whisker {
+
+// Unbounded lock-free multi-producer/single-consumer FIFO queue.
+//
+// Based on Dmitry Vyukov's non-intrusive MPSC node-based queue:
+// https://www.1024cores.net/home/lock-free-algorithms/queues/non-intrusive-mpsc-node-based-queue
+//
+// Push() is wait-free and may be called from any thread.  TryPop() must only be called from one consumer thread at a
+// time.  A push that is still in progress may be briefly invisible to TryPop(), so callers that need an exact "empty"
+// answer should track the number of items separately.
+
+template <typename T>
+class MpscQueue final {
+  public:
+    MpscQueue() : head(new Node), tail(head.load(std::memory_order_relaxed)) {}
+
+    ~MpscQueue() {
+        while (tail) {
+            delete std::exchange(tail, tail->next.load(std::memory_order_relaxed));
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void Push(T&& value) {
+        const auto node = new Node{std::move(value)};
+        const auto prev = head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    bool TryPop(T& value) {
+        const auto next = tail->next.load(std::memory_order_acquire);
+        if (!next) {
+            return false;
+        }
+        // 'next' becomes the new stub node, so its value is moved out and the old stub is freed
+        value = std::move(next->value);
+        delete std::exchange(tail, next);
+        return true;
+    }
+
+  private:
+    struct Node {
+        T value;
+        std::atomic<Node*> next = nullptr;
+    };
+
+    std::atomic<Node*> head;  // most recently pushed node, shared by producers
+    Node* tail;               // stub node preceding the oldest unconsumed node, owned by the consumer
+};
+
+}  // namespace whisker
+
+#endif  // WHISKER_MPSC_QUEUE_H
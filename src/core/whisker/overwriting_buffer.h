@@ -1,7 +1,9 @@
 #ifndef WHISKER_OVERWRITING_BUFFER_H
 #define WHISKER_OVERWRITING_BUFFER_H
 
+#include <atomic>
 #include <condition_variable>
+#include <cstdint>
 #include <memory>
 #include <mutex>
 
@@ -11,7 +13,11 @@ namespace whisker {
 //
 // The expected use case is for a writer to repeatedly write to the buffer from one thread, with the
 // reader accessing the latest unread piece of data from another thread.  If no unread data is available,
-// the read call will block until a new write has completed.
+// Read() will block until a new write has completed, while TryRead() returns immediately.
+//
+// This is a triple buffer: the writer and the reader each own one slot, and the third slot holds the latest
+// completed write.  Ownership is passed by atomically swapping slot indices, so writes never wait for the reader.
+// The only synchronization the writer does beyond that is to wake a reader that is blocked in Read().
 //
 // There should only be one reader and one writer per OverwritingBuffer.
 
@@ -26,46 +32,70 @@ class OverwritingBuffer final {
     // this will block until there is data available to be read
     template <typename Reader>
     void Read(const Reader& reader) {
-        std::unique_lock lock(index_mutex);
-        wait_cv.wait(lock, [this] { return index_newest != -1 && index_reading == -1; });
-
-        index_reading = index_newest;
-        index_newest = -1;
-        lock.unlock();
+        if (!HasUnreadData()) {
+            std::unique_lock lock(wait_mutex);
+            reader_waiting = true;
+            wait_cv.wait(lock, [this] { return HasUnreadData(); });
+            reader_waiting = false;
+        }
 
+        AcquireLatest();
         reader(&buffer[index_reading]);
+    }
 
-        lock.lock();
-        index_reading = -1;
+    // returns false without calling 'reader' if there is no unread data
+    template <typename Reader>
+    bool TryRead(const Reader& reader) {
+        if (!HasUnreadData()) {
+            return false;
+        }
+
+        AcquireLatest();
+        reader(&buffer[index_reading]);
+        return true;
     }
 
     template <typename Writer>
     void Write(const Writer& writer) {
-        std::unique_lock lock(index_mutex);
-        for (auto i = 0; i < num_slots; ++i) {
-            if (i != index_newest && i != index_reading && index_writing == -1) {
-                index_writing = i;
-                lock.unlock();
-
-                writer(&buffer[i]);
+        writer(&buffer[index_writing]);
 
-                lock.lock();
-                index_newest = i;
-                index_writing = -1;
-                wait_cv.notify_one();
+        const auto previous = index_latest.exchange(index_writing | unread_flag);
+        index_writing = previous & ~unread_flag;
+        if (previous & unread_flag) {
+            num_overwritten.fetch_add(1, std::memory_order_relaxed);
+        }
 
-                return;
-            }
+        if (reader_waiting) {
+            // synchronize with the reader's predicate check so that the notification can't be missed
+            std::scoped_lock lock(wait_mutex);
         }
+        wait_cv.notify_one();
+    }
+
+    // number of writes that were replaced by a newer write before being read
+    std::uint64_t GetNumOverwritten() const {
+        return num_overwritten.load(std::memory_order_relaxed);
     }
 
   private:
-    static constexpr unsigned short num_slots = 3;
+    static constexpr unsigned int num_slots = 3;
+    static constexpr unsigned int unread_flag = 1 << 2;  // set in 'index_latest' when its slot hasn't been read yet
+
+    bool HasUnreadData() const {
+        return index_latest.load() & unread_flag;
+    }
+
+    void AcquireLatest() {
+        index_reading = index_latest.exchange(index_reading) & ~unread_flag;
+    }
+
     const std::unique_ptr<T[]> buffer = std::make_unique<T[]>(num_slots);
-    short index_newest = -1;
-    short index_reading = -1;
-    short index_writing = -1;
-    std::mutex index_mutex;
+    unsigned int index_writing = 0;     // owned by the writer
+    std::atomic_uint index_latest = 1;  // most recently written slot, swapped between the writer and reader
+    unsigned int index_reading = 2;     // owned by the reader
+    std::atomic_uint64_t num_overwritten = 0;
+    std::atomic_bool reader_waiting = false;
+    std::mutex wait_mutex;
     std::condition_variable wait_cv;
 };
 
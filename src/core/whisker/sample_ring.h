@@ -0,0 +1,121 @@
+#ifndef WHISKER_SAMPLE_RING_H
+#define WHISKER_SAMPLE_RING_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace whisker {
+
+// Fixed-capacity history of samples, for readers that want every sample written since their previous read rather
+// than only the latest one (see OverwritingBuffer).
+//
+// All slots are allocated up front.  When the ring is full, each new sample overwrites the oldest unread one, and
+// the number of samples lost this way is counted.  The reader can either drain all of the unread samples or take
+// only the newest one, skipping the rest.  Samples are copied in and out of the ring under a short lock, so 'T'
+// should be cheap to copy.
+//
+// There should only be one reader and one writer per SampleRing.
+
+template <typename T>
+class SampleRing final {
+  public:
+    explicit SampleRing(std::size_t capacity) : capacity(capacity), slots(std::make_unique<T[]>(capacity)) {}
+
+    SampleRing(const SampleRing&) = delete;
+    SampleRing& operator=(const SampleRing&) = delete;
+
+    // returns the number of unread samples that were overwritten to make room
+    std::size_t Push(const T& sample) {
+        return Push(&sample, &sample + 1);
+    }
+
+    template <typename Iterator>
+    std::size_t Push(Iterator first, Iterator last) {
+        std::size_t num_overwritten_by_push = 0;
+        {
+            std::scoped_lock lock(ring_mutex);
+            for (; first != last; ++first) {
+                slots[num_written % capacity] = *first;
+                ++num_written;
+            }
+            if ((num_written - num_read) > capacity) {
+                num_overwritten_by_push = num_written - num_read - capacity;
+                num_read = num_written - capacity;
+                num_overwritten += num_overwritten_by_push;
+            }
+        }
+        wait_cv.notify_one();
+        return num_overwritten_by_push;
+    }
+
+    // replaces the contents of 'samples' with all of the unread samples, oldest first, blocking until there is at
+    // least one; 'samples' is reserved to the ring's capacity so that reusing it avoids further allocations
+    void DrainAll(std::vector<T>& samples) {
+        samples.clear();
+        samples.reserve(capacity);
+
+        std::unique_lock lock(ring_mutex);
+        wait_cv.wait(lock, [this] { return num_written > num_read; });
+        CopyUnread(std::back_inserter(samples));
+    }
+
+    // returns false, leaving 'samples' empty, if there are no unread samples
+    bool TryDrainAll(std::vector<T>& samples) {
+        samples.clear();
+        samples.reserve(capacity);
+
+        std::scoped_lock lock(ring_mutex);
+        CopyUnread(std::back_inserter(samples));
+        return !samples.empty();
+    }
+
+    // copies the newest sample to 'sample' and marks all samples as read, blocking until there is an unread sample
+    void ReadLatest(T& sample) {
+        std::unique_lock lock(ring_mutex);
+        wait_cv.wait(lock, [this] { return num_written > num_read; });
+        sample = slots[(num_written - 1) % capacity];
+        num_read = num_written;
+    }
+
+    // returns false, leaving 'sample' unchanged, if there are no unread samples
+    bool TryReadLatest(T& sample) {
+        std::scoped_lock lock(ring_mutex);
+        if (num_written == num_read) {
+            return false;
+        }
+        sample = slots[(num_written - 1) % capacity];
+        num_read = num_written;
+        return true;
+    }
+
+    // total number of samples that were overwritten before being read
+    std::uint64_t GetNumOverwritten() {
+        std::scoped_lock lock(ring_mutex);
+        return num_overwritten;
+    }
+
+  private:
+    template <typename OutputIterator>
+    void CopyUnread(OutputIterator output) {
+        for (; num_read < num_written; ++num_read) {
+            *output++ = slots[num_read % capacity];
+        }
+    }
+
+    const std::size_t capacity;
+    const std::unique_ptr<T[]> slots;
+    std::uint64_t num_written = 0;  // slot index = count % capacity
+    std::uint64_t num_read = 0;
+    std::uint64_t num_overwritten = 0;
+    std::mutex ring_mutex;
+    std::condition_variable wait_cv;
+};
+
+}  // namespace whisker
+
+#endif  // WHISKER_SAMPLE_RING_H
@@ -0,0 +1,59 @@
+#include "strand.h"
+#include <thread>
+
+namespace whisker {
+
+namespace {
+
+// number of tasks to run before yielding the pool thread to other work
+constexpr unsigned int max_tasks_per_turn = 64;
+
+}  // namespace
+
+Strand::Strand(std::shared_ptr<ThreadPool> thread_pool) : thread_pool(std::move(thread_pool)) {}
+
+Strand::~Strand() {
+    FinishQueueSync();
+}
+
+std::size_t Strand::GetNumTasks() {
+    return num_tasks.load(std::memory_order_relaxed);
+}
+
+void Strand::FinishQueueSync() {
+    std::unique_lock lock(idle_mutex);
+    idle_cv.wait(lock, [this] { return num_tasks.load(std::memory_order_acquire) == 0; });
+}
+
+void Strand::ProcessTasks() {
+    Task task;
+
+    for (auto num_run = 1u;; ++num_run) {
+        while (!task_queue.TryPop(task)) {
+            // the task was counted but its producer hasn't finished linking it into the queue yet
+            std::this_thread::yield();
+        }
+        task();
+        task = {};
+
+        // only this function decrements 'num_tasks', so a count above one means we still own the strand
+        if (num_tasks.load(std::memory_order_acquire) > 1) {
+            num_tasks.fetch_sub(1, std::memory_order_acq_rel);
+            if (num_run >= max_tasks_per_turn) {
+                thread_pool->Schedule([this] { ProcessTasks(); });
+                return;
+            }
+            continue;
+        }
+
+        // possibly the last task, so decrement under the lock that FinishQueueSync() waits with; after this the
+        // Strand may be destroyed, so no members can be touched once the lock is released
+        std::scoped_lock lock(idle_mutex);
+        if (num_tasks.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            idle_cv.notify_all();
+            return;
+        }
+    }
+}
+
+}  // namespace whisker
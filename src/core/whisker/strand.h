@@ -0,0 +1,56 @@
+#ifndef WHISKER_STRAND_H
+#define WHISKER_STRAND_H
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <whisker/mpsc_queue.h>
+#include <whisker/task.h>
+#include <whisker/thread_pool.h>
+
+namespace whisker {
+
+// Runs tasks serially, in the order they were added, on a shared ThreadPool.
+//
+// This has the same interface and ordering guarantees as TaskQueue, but instead of owning a thread, a Strand with
+// pending tasks occupies at most one of the pool's threads at a time.  Many Strands can then share a pool sized to the
+// machine instead of each of them having a mostly idle thread.
+
+class Strand final {
+  public:
+    explicit Strand(std::shared_ptr<ThreadPool> thread_pool);
+    ~Strand();
+
+    Strand(const Strand&) = delete;
+    Strand& operator=(const Strand&) = delete;
+
+    template <typename T>
+    void AddTask(T&& task) {
+        task_queue.Push(Task{std::forward<T>(task)});
+        // whoever takes the strand from idle to busy is responsible for getting it onto the pool
+        if (num_tasks.fetch_add(1, std::memory_order_acq_rel) == 0) {
+            thread_pool->Schedule([this] { ProcessTasks(); });
+        }
+    }
+
+    // includes the task that is currently running, if any
+    std::size_t GetNumTasks();
+
+    // blocks until all previously added tasks have run (must not be called from within a task on this Strand)
+    void FinishQueueSync();
+
+  private:
+    void ProcessTasks();
+
+    const std::shared_ptr<ThreadPool> thread_pool;
+    MpscQueue<Task> task_queue;
+    std::atomic_size_t num_tasks = 0;
+    std::mutex idle_mutex;
+    std::condition_variable idle_cv;
+};
+
+}  // namespace whisker
+
+#endif  // WHISKER_STRAND_H
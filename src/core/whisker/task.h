@@ -0,0 +1,107 @@
+#ifndef WHISKER_TASK_H
+#define WHISKER_TASK_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace whisker {
+
+// Move-only, type-erased void() callable used by the task queues and executors.
+//
+// Unlike std::function, it accepts move-only callables and stores callables of up to 'inline_capacity' bytes
+// (e.g. a lambda capturing a pointer, a string, and a couple of shared_ptrs) without a heap allocation.
+
+class Task final {
+  public:
+    static constexpr std::size_t inline_capacity = 96;
+
+    Task() = default;
+
+    template <typename Callable, typename = std::enable_if_t<!std::is_same_v<std::decay_t<Callable>, Task>>>
+    Task(Callable&& callable) {
+        using StoredType = std::decay_t<Callable>;
+        static_assert(std::is_invocable_r_v<void, StoredType&>, "Callable must be compatible with void()");
+
+        if constexpr (IsStoredInline<StoredType>()) {
+            new (&storage) StoredType(std::forward<Callable>(callable));
+            ops = &inline_ops<StoredType>;
+        } else {
+            *reinterpret_cast<StoredType**>(&storage) = new StoredType(std::forward<Callable>(callable));
+            ops = &heap_ops<StoredType>;
+        }
+    }
+
+    Task(Task&& other) noexcept { MoveFrom(other); }
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            Reset();
+            MoveFrom(other);
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() { Reset(); }
+
+    explicit operator bool() const { return ops != nullptr; }
+
+    void operator()() { ops->invoke(&storage); }
+
+  private:
+    struct Ops {
+        void (*invoke)(void* storage);
+        void (*move)(void* dst_storage, void* src_storage);  // move-constructs dst and destroys src
+        void (*destroy)(void* storage);
+    };
+
+    template <typename T>
+    static constexpr bool IsStoredInline() {
+        return (sizeof(T) <= inline_capacity) && (alignof(T) <= alignof(std::max_align_t)) &&
+               std::is_nothrow_move_constructible_v<T>;
+    }
+
+    template <typename T>
+    static constexpr Ops inline_ops = {
+            [](void* storage) { (*std::launder(static_cast<T*>(storage)))(); },
+            [](void* dst_storage, void* src_storage) {
+                const auto src = std::launder(static_cast<T*>(src_storage));
+                new (dst_storage) T(std::move(*src));
+                src->~T();
+            },
+            [](void* storage) { std::launder(static_cast<T*>(storage))->~T(); },
+    };
+
+    template <typename T>
+    static constexpr Ops heap_ops = {
+            [](void* storage) { (**static_cast<T**>(storage))(); },
+            [](void* dst_storage, void* src_storage) {
+                *static_cast<T**>(dst_storage) = *static_cast<T**>(src_storage);
+            },
+            [](void* storage) { delete *static_cast<T**>(storage); },
+    };
+
+    void MoveFrom(Task& other) noexcept {
+        if (other.ops) {
+            other.ops->move(&storage, &other.storage);
+            ops = std::exchange(other.ops, nullptr);
+        }
+    }
+
+    void Reset() {
+        if (ops) {
+            std::exchange(ops, nullptr)->destroy(&storage);
+        }
+    }
+
+    std::aligned_storage_t<inline_capacity, alignof(std::max_align_t)> storage;
+    const Ops* ops = nullptr;
+};
+
+}  // namespace whisker
+
+#endif  // WHISKER_TASK_H
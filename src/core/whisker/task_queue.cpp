@@ -1,8 +1,17 @@
 #include "task_queue.h"
+#include <algorithm>
 #include <glog/logging.h>
 
 namespace whisker {
 
+namespace {
+
+// bounds on the number of times the work thread polls an empty queue before parking
+constexpr unsigned int min_idle_spins = 16;
+constexpr unsigned int max_idle_spins = 4096;
+
+}  // namespace
+
 TaskQueue::TaskQueue() {
     work_thread = std::thread{&TaskQueue::ProcessTasks, this};
 }
@@ -14,8 +23,7 @@ TaskQueue::~TaskQueue() {
 }
 
 std::size_t TaskQueue::GetNumTasks() {
-    std::scoped_lock lock(task_queue_mutex);
-    return task_queue.size();
+    return num_tasks.load(std::memory_order_relaxed);
 }
 
 void TaskQueue::FinishQueueSync() {
@@ -23,22 +31,55 @@ void TaskQueue::FinishQueueSync() {
         LOG(INFO) << "Draining task queue, " << num_tasks << " tasks remaining";
     }
     run_work_thread = false;
-    task_queue_cv.notify_one();
+    {
+        std::scoped_lock lock(park_mutex);
+        park_cv.notify_one();
+    }
     work_thread.join();
 }
 
 void TaskQueue::ProcessTasks() {
-    const auto should_proceed = [this] { return !task_queue.empty() || !run_work_thread; };
+    Task task;
+    auto spin_limit = min_idle_spins;
+    auto num_spins = 0u;
+
     while (true) {
-        std::unique_lock lock(task_queue_mutex);
-        task_queue_cv.wait(lock, should_proceed);
-        if (task_queue.empty() && !run_work_thread) {
+        if (task_queue.TryPop(task)) {
+            num_tasks.fetch_sub(1, std::memory_order_relaxed);
+            task();
+            task = {};
+
+            // a task arriving while we were spinning means spinning paid off, so be willing to spin longer next time
+            if (num_spins > 0) {
+                spin_limit = std::min(spin_limit * 2, max_idle_spins);
+                num_spins = 0;
+            }
+            continue;
+        }
+
+        if (num_tasks.load(std::memory_order_acquire) > 0) {
+            // a producer has counted its task but hasn't finished linking it into the queue yet
+            std::this_thread::yield();
+            continue;
+        }
+
+        if (!run_work_thread) {
             return;
         }
-        const auto task_ptr = std::move(task_queue.front());
-        task_queue.pop();
-        lock.unlock();
-        (*task_ptr)();
+
+        if (++num_spins < spin_limit) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // nothing showed up while spinning, so park until a producer wakes us and spin less next time
+        spin_limit = std::max(spin_limit / 2, min_idle_spins);
+        num_spins = 0;
+
+        std::unique_lock lock(park_mutex);
+        work_thread_parked.store(true, std::memory_order_seq_cst);
+        park_cv.wait(lock, [this] { return (num_tasks.load(std::memory_order_seq_cst) > 0) || !run_work_thread; });
+        work_thread_parked.store(false, std::memory_order_relaxed);
     }
 }
 
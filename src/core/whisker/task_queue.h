@@ -3,18 +3,23 @@
 
 #include <atomic>
 #include <condition_variable>
-#include <functional>
-#include <memory>
 #include <mutex>
-#include <queue>
 #include <thread>
 #include <utility>
+#include <whisker/mpsc_queue.h>
+#include <whisker/task.h>
 
 namespace whisker {
 
+// Runs tasks serially, in the order they were added, on a dedicated thread.
+//
+// AddTask() is lock-free so that producers (e.g. connection message handlers) never contend with each other or the
+// work thread.  When the queue runs dry, the work thread spins briefly before parking, adapting the length of the
+// spin to how often new tasks show up while it is spinning.
+
 class TaskQueue final {
   public:
-    using Task = std::function<void()>;
+    using Task = whisker::Task;
 
     TaskQueue();
     ~TaskQueue();
@@ -24,9 +29,13 @@ class TaskQueue final {
 
     template <typename T>
     void AddTask(T&& task) {
-        std::scoped_lock lock(task_queue_mutex);
-        task_queue.emplace(std::make_unique<Task>(std::forward<T>(task)));
-        task_queue_cv.notify_one();
+        // count first so that the work thread never sees a queued task it hasn't accounted for
+        num_tasks.fetch_add(1, std::memory_order_seq_cst);
+        task_queue.Push(Task{std::forward<T>(task)});
+        if (work_thread_parked.load(std::memory_order_seq_cst)) {
+            std::scoped_lock lock(park_mutex);
+            park_cv.notify_one();
+        }
     }
 
     std::size_t GetNumTasks();
@@ -35,9 +44,11 @@ class TaskQueue final {
   private:
     void ProcessTasks();
 
-    std::queue<std::unique_ptr<Task>> task_queue;
-    std::mutex task_queue_mutex;
-    std::condition_variable task_queue_cv;
+    MpscQueue<Task> task_queue;
+    std::atomic_size_t num_tasks = 0;
+    std::atomic_bool work_thread_parked = false;
+    std::mutex park_mutex;
+    std::condition_variable park_cv;
     std::thread work_thread;
     std::atomic_bool run_work_thread = true;
 };
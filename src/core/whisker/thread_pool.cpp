@@ -0,0 +1,126 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <glog/logging.h>
+
+namespace whisker {
+
+namespace {
+
+// number of times an idle worker looks for tasks to steal before parking
+constexpr unsigned int num_idle_spins = 64;
+
+// identifies the pool and worker that the current thread belongs to (if any)
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local std::size_t current_worker_index;
+
+}  // namespace
+
+ThreadPool::ThreadPool(unsigned int num_threads) {
+    if (num_threads == 0) {
+        num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    LOG(INFO) << "Starting thread pool with " << num_threads << " threads";
+
+    for (auto i = 0u; i < num_threads; ++i) {
+        workers.emplace_back(std::make_unique<Worker>());
+    }
+    for (auto i = 0u; i < num_threads; ++i) {
+        workers[i]->thread = std::thread{&ThreadPool::ProcessTasks, this, i};
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    run_workers = false;
+    {
+        std::scoped_lock lock(park_mutex);
+        park_cv.notify_all();
+    }
+    for (const auto& worker : workers) {
+        worker->thread.join();
+    }
+}
+
+void ThreadPool::ScheduleTask(Task&& task) {
+    const auto worker_index = (current_pool == this)
+                                      ? current_worker_index
+                                      : (next_worker_index.fetch_add(1, std::memory_order_relaxed) % workers.size());
+    auto& worker = *workers[worker_index];
+
+    // count first so that a worker never takes a task it hasn't accounted for
+    num_tasks.fetch_add(1, std::memory_order_seq_cst);
+    {
+        std::scoped_lock lock(worker.tasks_mutex);
+        worker.tasks.emplace_back(std::move(task));
+    }
+
+    if (num_parked_workers.load(std::memory_order_seq_cst) > 0) {
+        std::scoped_lock lock(park_mutex);
+        park_cv.notify_one();
+    }
+}
+
+bool ThreadPool::TryGetTask(std::size_t worker_index, Task& task) {
+    // take the oldest task from our own deque
+    {
+        auto& worker = *workers[worker_index];
+        std::scoped_lock lock(worker.tasks_mutex);
+        if (!worker.tasks.empty()) {
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+            return true;
+        }
+    }
+
+    // otherwise steal the newest task from a peer, starting with our neighbour
+    for (auto i = 1u; i < workers.size(); ++i) {
+        auto& victim = *workers[(worker_index + i) % workers.size()];
+        std::unique_lock lock(victim.tasks_mutex, std::try_to_lock);
+        if (lock && !victim.tasks.empty()) {
+            task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::ProcessTasks(std::size_t worker_index) {
+    current_pool = this;
+    current_worker_index = worker_index;
+
+    Task task;
+    auto num_spins = 0u;
+
+    while (true) {
+        if (TryGetTask(worker_index, task)) {
+            num_tasks.fetch_sub(1, std::memory_order_relaxed);
+            task();
+            task = {};
+            num_spins = 0;
+            continue;
+        }
+
+        const auto tasks_pending = (num_tasks.load(std::memory_order_acquire) > 0);
+
+        if (!tasks_pending && !run_workers) {
+            return;
+        }
+
+        if (tasks_pending || (++num_spins < num_idle_spins)) {
+            // either a peer's deque was busy or a task is still being scheduled, so look again shortly
+            std::this_thread::yield();
+            continue;
+        }
+
+        num_spins = 0;
+
+        std::unique_lock lock(park_mutex);
+        num_parked_workers.fetch_add(1, std::memory_order_seq_cst);
+        park_cv.wait(lock, [this] { return (num_tasks.load(std::memory_order_seq_cst) > 0) || !run_workers; });
+        num_parked_workers.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+}  // namespace whisker
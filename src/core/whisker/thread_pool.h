@@ -0,0 +1,63 @@
+#ifndef WHISKER_THREAD_POOL_H
+#define WHISKER_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <whisker/task.h>
+
+namespace whisker {
+
+// Work-stealing pool of threads that runs tasks in no particular order.
+//
+// Each worker has its own task deque.  Tasks scheduled from a worker thread go to that worker's deque, while tasks
+// scheduled from elsewhere are spread across workers round-robin.  A worker that runs out of tasks steals from the
+// other end of its peers' deques before parking, which keeps all threads busy as long as there is work anywhere.
+//
+// Use a Strand on top of a ThreadPool for tasks that need to run serially.
+
+class ThreadPool final {
+  public:
+    // num_threads = 0 means to use the system's processor count
+    explicit ThreadPool(unsigned int num_threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template <typename T>
+    void Schedule(T&& task) {
+        ScheduleTask(Task{std::forward<T>(task)});
+    }
+
+    std::size_t GetNumThreads() const { return workers.size(); }
+    std::size_t GetNumTasks() { return num_tasks.load(std::memory_order_relaxed); }
+
+  private:
+    struct Worker {
+        std::deque<Task> tasks;
+        std::mutex tasks_mutex;
+        std::thread thread;
+    };
+
+    void ScheduleTask(Task&& task);
+    bool TryGetTask(std::size_t worker_index, Task& task);
+    void ProcessTasks(std::size_t worker_index);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic_size_t num_tasks = 0;
+    std::atomic_size_t next_worker_index = 0;
+    std::atomic_uint num_parked_workers = 0;
+    std::mutex park_mutex;
+    std::condition_variable park_cv;
+    std::atomic_bool run_workers = true;
+};
+
+}  // namespace whisker
+
+#endif  // WHISKER_THREAD_POOL_H
@@ -1,10 +1,12 @@
 #include "websocket_connection.h"
 #include <algorithm>
 #include <atomic>
+#include <cstdint>
 #include <cstring>
+#include <deque>
 #include <filesystem>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <shared_mutex>
 #include <thread>
 #include <unordered_map>
@@ -24,8 +26,11 @@ constexpr unsigned int client_id_buf_size = 256;
 
 class WebsocketClientConnection final : public ClientConnection {
   public:
-    WebsocketClientConnection(unsigned short bind_port, std::string&& root_path, ClientEventHandlers&& event_handlers)
-            : mount_root(std::move(root_path)) {
+    WebsocketClientConnection(unsigned short bind_port,
+                              std::string&& root_path,
+                              ClientEventHandlers&& event_handlers,
+                              WebsocketOutgoingQueueOptions&& outgoing_queue_options)
+            : mount_root(std::move(root_path)), queue_options(std::move(outgoing_queue_options)) {
         LOG(INFO) << "WebsocketClientConnection: listening on port " << bind_port;
 
         lws_set_log_level(0, nullptr);  // disable libwebsockets logging
@@ -74,39 +79,130 @@ class WebsocketClientConnection final : public ClientConnection {
     }
 
   private:
+    // serialized message preceded by LWS_PRE bytes of headroom for lws_write(), shared by all of its recipients
+    using SerializedMessage = std::shared_ptr<const std::string>;
+
+    struct OutgoingMessage {
+        std::string coalescing_key;  // empty if the message is never superseded
+        std::int64_t coalescing_version;
+        SerializedMessage message;  // null if the message was superseded by one queued behind it
+    };
+
     struct ClientData {
         lws* websocket_instance;
-        std::queue<std::string> outgoing_messages;
+        std::deque<OutgoingMessage> outgoing_messages;
+        std::unordered_map<std::string, OutgoingMessage*> coalescable_messages;  // queued messages by coalescing key
+        std::size_t queued_bytes = 0;
+        std::uint64_t sent_bytes = 0;
+        std::uint64_t num_coalesced_messages = 0;
+        bool is_over_queue_limit = false;
     };
 
-    static std::string& SerializeMessage(const google::protobuf::MessageLite& message) {
-        thread_local std::string serialized_message;
-        serialized_message.resize(LWS_PRE);
-        serialized_message.append(message.GetTypeName());
-        serialized_message.push_back('\0');
-        message.AppendToString(&serialized_message);
+    static SerializedMessage SerializeMessage(const google::protobuf::MessageLite& message) {
+        const auto type_name = message.GetTypeName();
+        auto serialized_message = std::make_shared<std::string>();
+        serialized_message->reserve(LWS_PRE + type_name.size() + 1 + message.ByteSizeLong());
+        serialized_message->resize(LWS_PRE);
+        serialized_message->append(type_name);
+        serialized_message->push_back('\0');
+        message.AppendToString(serialized_message.get());
         return serialized_message;
     }
 
+    WebsocketOutgoingQueueOptions::CoalescingKey GetCoalescingKey(const google::protobuf::MessageLite& message) const {
+        return queue_options.coalescing_key_func ? queue_options.coalescing_key_func(message)
+                                                 : WebsocketOutgoingQueueOptions::CoalescingKey{};
+    }
+
+    // must be called with client_data_mutex held
+    void QueueMessage(const std::string& client_id,
+                      ClientData& client,
+                      const WebsocketOutgoingQueueOptions::CoalescingKey& coalescing_key,
+                      const SerializedMessage& message) {
+        if (client.is_over_queue_limit) {
+            return;
+        }
+
+        const auto message_size = message->size() - LWS_PRE;
+        const auto [it, emplaced] = coalescing_key.key.empty()
+                                            ? std::pair{client.coalescable_messages.end(), true}
+                                            : client.coalescable_messages.try_emplace(coalescing_key.key);
+        bool is_replaced_in_place = false;
+        if (!emplaced) {
+            auto& queued_message = *it->second;
+            ++client.num_coalesced_messages;
+            if (coalescing_key.version < queued_message.coalescing_version) {
+                return;  // the queued message supersedes this one
+            }
+
+            client.queued_bytes -= queued_message.message->size() - LWS_PRE;
+            if (coalescing_key.replace_in_place) {
+                // the newer message doesn't have to wait behind later messages
+                queued_message.coalescing_version = coalescing_key.version;
+                queued_message.message = message;
+                is_replaced_in_place = true;
+            } else {
+                // leave a placeholder that is skipped when sending, as erasing it would invalidate the other pointers
+                // into 'outgoing_messages'
+                queued_message.coalescing_key.clear();
+                queued_message.message = nullptr;
+            }
+        }
+        if (!is_replaced_in_place) {
+            client.outgoing_messages.push_back({coalescing_key.key, coalescing_key.version, message});
+            if (it != client.coalescable_messages.end()) {
+                it->second = &client.outgoing_messages.back();
+            }
+        }
+        client.queued_bytes += message_size;
+
+        if ((queue_options.max_queued_bytes > 0) && (client.queued_bytes > queue_options.max_queued_bytes)) {
+            // the connection is closed from its next writable callback
+            LOG(WARNING) << "WebsocketClientConnection: '" << client_id << "' has " << client.queued_bytes
+                         << " bytes of messages queued, disconnecting";
+            client.is_over_queue_limit = true;
+            client.outgoing_messages.clear();
+            client.coalescable_messages.clear();
+            client.queued_bytes = 0;
+        }
+
+        lws_callback_on_writable(client.websocket_instance);
+    }
+
     void SendMessage(const google::protobuf::MessageLite& message, const std::string& recipient_id) override {
-        const auto& serialized_message = SerializeMessage(message);
+        const auto serialized_message = SerializeMessage(message);
+        const auto coalescing_key = GetCoalescingKey(message);
 
         std::unique_lock lock(client_data_mutex);
         const auto recipient = client_data.find(recipient_id);
         if (recipient != client_data.end()) {
-            recipient->second.outgoing_messages.emplace(serialized_message);
-            lws_callback_on_writable(recipient->second.websocket_instance);
+            QueueMessage(recipient->first, recipient->second, coalescing_key, serialized_message);
             lws_cancel_service(websocket_context);
         }
     }
 
+    void MulticastMessage(const google::protobuf::MessageLite& message,
+                          const std::unordered_set<std::string>& recipient_ids) override {
+        const auto serialized_message = SerializeMessage(message);
+        const auto coalescing_key = GetCoalescingKey(message);
+
+        std::unique_lock lock(client_data_mutex);
+        for (const auto& recipient_id : recipient_ids) {
+            const auto recipient = client_data.find(recipient_id);
+            if (recipient != client_data.end()) {
+                QueueMessage(recipient->first, recipient->second, coalescing_key, serialized_message);
+            }
+        }
+        lws_cancel_service(websocket_context);
+    }
+
     void BroadcastMessage(const google::protobuf::MessageLite& message) override {
-        const auto& serialized_message = SerializeMessage(message);
+        const auto serialized_message = SerializeMessage(message);
+        const auto coalescing_key = GetCoalescingKey(message);
 
         std::unique_lock lock(client_data_mutex);
         for (auto& [client_id, data] : client_data) {
-            data.outgoing_messages.emplace(serialized_message);
-            lws_callback_on_writable(data.websocket_instance);
+            QueueMessage(client_id, data, coalescing_key, serialized_message);
         }
         lws_cancel_service(websocket_context);
     }
@@ -165,7 +261,9 @@ class WebsocketClientConnection final : public ClientConnection {
                         // new connection for existing client id -- close old connection, new one takes over
                         lws_set_timeout(it->second.websocket_instance, PENDING_TIMEOUT_CLOSE_SEND, LWS_TO_KILL_ASYNC);
                     }
-                    this_obj->client_data[client_id].websocket_instance = wsi;
+                    auto& data = this_obj->client_data[client_id];
+                    data = {};
+                    data.websocket_instance = wsi;
                 }
                 LOG(INFO) << "WebsocketClientConnection: '" << client_id << "' connected";
                 if (this_obj->connection_state_handler) {
@@ -179,9 +277,12 @@ class WebsocketClientConnection final : public ClientConnection {
                 std::unique_lock lock(this_obj->client_data_mutex);
                 const auto it = this_obj->client_data.find(client_id);
                 if ((it != this_obj->client_data.end()) && (it->second.websocket_instance == wsi)) {
+                    const auto sent_bytes = it->second.sent_bytes;
+                    const auto num_coalesced_messages = it->second.num_coalesced_messages;
                     this_obj->client_data.erase(it);
                     lock.unlock();
-                    LOG(INFO) << "WebsocketClientConnection: '" << client_id << "' disconnected";
+                    LOG(INFO) << "WebsocketClientConnection: '" << client_id << "' disconnected (sent " << sent_bytes
+                              << " bytes, coalesced " << num_coalesced_messages << " messages)";
                     if (this_obj->connection_state_handler) {
                         this_obj->connection_state_handler(*this_obj, std::move(client_id), false);
                     }
@@ -193,18 +294,34 @@ class WebsocketClientConnection final : public ClientConnection {
 
                 std::unique_lock lock(this_obj->client_data_mutex);
                 auto& recipient = this_obj->client_data.at(client_id);
+                if (recipient.is_over_queue_limit) {
+                    return -1;  // close the connection
+                }
+                while (!recipient.outgoing_messages.empty() && !recipient.outgoing_messages.front().message) {
+                    recipient.outgoing_messages.pop_front();
+                }
                 if (!recipient.outgoing_messages.empty()) {
-                    auto message = std::move(recipient.outgoing_messages.front());
+                    auto& front = recipient.outgoing_messages.front();
+                    if (!front.coalescing_key.empty()) {
+                        recipient.coalescable_messages.erase(front.coalescing_key);
+                    }
+                    const auto message = std::move(front.message);
+                    recipient.outgoing_messages.pop_front();
+
+                    const auto message_size = message->size() - LWS_PRE;
+                    recipient.queued_bytes -= message_size;
+                    recipient.sent_bytes += message_size;
 
-                    recipient.outgoing_messages.pop();
                     if (!recipient.outgoing_messages.empty()) {
                         lws_callback_on_writable(wsi);
                     }
 
                     lock.unlock();
 
-                    lws_write(wsi, reinterpret_cast<unsigned char*>(message.data() + LWS_PRE), message.size() - LWS_PRE,
-                              LWS_WRITE_BINARY);
+                    // lws_write() only modifies the headroom (to prepend the frame header) and is only called from
+                    // this thread, so a buffer can be shared by all of its recipients
+                    lws_write(wsi, reinterpret_cast<unsigned char*>(const_cast<char*>(message->data()) + LWS_PRE),
+                              message->size() - LWS_PRE, LWS_WRITE_BINARY);
                 }
             } break;
 
@@ -247,6 +364,7 @@ class WebsocketClientConnection final : public ClientConnection {
     std::atomic_bool run_message_loop = true;
 
     const std::string mount_root;
+    const WebsocketOutgoingQueueOptions queue_options;
     lws_context_creation_info context_info = {};
     lws_protocol_vhost_options mime_types[2];
     lws_http_mount mount = {};
@@ -261,10 +379,13 @@ class WebsocketClientConnection final : public ClientConnection {
     std::shared_mutex client_data_mutex;
 };
 
-std::shared_ptr<ClientConnection> WebsocketConnection::CreateClientConnection(unsigned short bind_port,
-                                                                              std::string root_path,
-                                                                              ClientEventHandlers event_handlers) {
-    return std::make_shared<WebsocketClientConnection>(bind_port, std::move(root_path), std::move(event_handlers));
+std::shared_ptr<ClientConnection> WebsocketConnection::CreateClientConnection(
+        unsigned short bind_port,
+        std::string root_path,
+        ClientEventHandlers event_handlers,
+        WebsocketOutgoingQueueOptions outgoing_queue_options) {
+    return std::make_shared<WebsocketClientConnection>(bind_port, std::move(root_path), std::move(event_handlers),
+                                                       std::move(outgoing_queue_options));
 }
 
 }  // namespace whisker
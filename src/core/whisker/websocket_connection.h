@@ -1,18 +1,42 @@
 #ifndef WHISKER_WEBSOCKET_CONNECTION_H
 #define WHISKER_WEBSOCKET_CONNECTION_H
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
 #include <whisker/client_connection.h>
 
 namespace whisker {
 
+// limits on the messages waiting to be sent to each client, so that a client on a slow link can't make memory use grow
+// without bound or fall further and further behind
+struct WebsocketOutgoingQueueOptions {
+    struct CoalescingKey {
+        std::string key;  // shared by messages that supersede one another, or empty if the message must always be sent
+        std::int64_t version = 0;  // a queued message is only replaced by one with the same or a newer version
+        // whether the replacement takes the queued message's place, or goes to the back of the queue so it isn't sent
+        // ahead of messages that were queued after the one it replaces
+        bool replace_in_place = true;
+    };
+
+    // a queued message is replaced by a newer one with the same key, and a message that is older than the one queued
+    // with its key is dropped
+    std::function<CoalescingKey(const google::protobuf::MessageLite&)> coalescing_key_func;
+
+    // a client is disconnected if the messages queued for it exceed this many bytes (0 = unlimited)
+    std::size_t max_queued_bytes = 0;
+};
+
 class WebsocketConnection final {
   public:
     // serve files out of root_path, or pass an empty string to disable file serving
-    static std::shared_ptr<ClientConnection> CreateClientConnection(unsigned short bind_port,
-                                                                    std::string root_path,
-                                                                    ClientEventHandlers event_handlers = {});
+    static std::shared_ptr<ClientConnection> CreateClientConnection(
+            unsigned short bind_port,
+            std::string root_path,
+            ClientEventHandlers event_handlers = {},
+            WebsocketOutgoingQueueOptions outgoing_queue_options = {});
 };
 
 }  // namespace whisker
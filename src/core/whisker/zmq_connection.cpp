@@ -1,7 +1,10 @@
 #include "zmq_connection.h"
 #include <algorithm>
+#include <cstddef>
+#include <memory>
 #include <mutex>
 #include <shared_mutex>
+#include <string>
 #include <thread>
 #include <unordered_map>
 #include <unordered_set>
@@ -129,6 +132,20 @@ class ZmqOps final {
         return serialized_message;
     }
 
+    static void ConnectServerSocket(void* socket, const std::string& server_address, const std::string& client_id) {
+        // discard pending messages when closing socket
+        const int opt_linger = 0;
+        CHECK_ERR(zmq_setsockopt(socket, ZMQ_LINGER, &opt_linger, sizeof(opt_linger)));
+
+        // get notified with a special message when server disconnects
+        CHECK_ERR(zmq_setsockopt(socket, ZMQ_HICCUP_MSG, "D", 1));
+
+        // use our client id as the socket routing id
+        CHECK_ERR(zmq_setsockopt(socket, ZMQ_ROUTING_ID, client_id.c_str(), client_id.size()));
+
+        CHECK_ERR(zmq_connect(socket, server_address.c_str()));
+    }
+
   private:
     void* zeromq_context;
     void* zeromq_socket;
@@ -231,6 +248,18 @@ class ZmqClientConnection final : public ClientConnection {
         }
     }
 
+    void MulticastMessage(const google::protobuf::MessageLite& message,
+                          const std::unordered_set<std::string>& recipient_ids) override {
+        zmq_ops.UseSocket([&recipient_ids, &msg = ZmqOps::SerializeMessage(message)](const auto socket) {
+            for (const auto& recipient_id : recipient_ids) {
+                if (!recipient_id.empty()) {
+                    zmq_send(socket, recipient_id.c_str(), recipient_id.size(), ZMQ_SNDMORE);
+                    zmq_send(socket, msg.c_str(), msg.size(), 0);
+                }
+            }
+        });
+    }
+
     void BroadcastMessage(const google::protobuf::MessageLite& message) override {
         std::shared_lock lock_clients(connected_clients_mutex);
         zmq_ops.UseSocket([this, &msg = ZmqOps::SerializeMessage(message)](const auto socket) {
@@ -253,6 +282,55 @@ class ZmqClientConnection final : public ClientConnection {
     std::shared_mutex connected_clients_mutex;
 };
 
+// Dispatches messages received by a server connection to its event handlers
+class ZmqServerMessageDispatcher final {
+  public:
+    ZmqServerMessageDispatcher(ServerConnection& connection, ServerEventHandlers&& event_handlers)
+            : connection(connection),
+              message_handlers(ZmqOps::BuildMessageHandlerMap(std::move(event_handlers.message_handlers))),
+              disconnect_handler(std::move(event_handlers.disconnect_handler)) {}
+
+    void operator()(const char* msg, std::size_t msg_size) {
+        // handle special connection state change message:
+        // single 'D' character = server disconnected
+        if ((msg_size == 1) && (*msg == 'D')) {
+            LOG(INFO) << "ZmqServerConnection: disconnected from server, will try to reconnect";
+            if (disconnect_handler) {
+                disconnect_handler(connection);
+            }
+            return;
+        }
+
+        const auto begin = msg;
+        const auto end = begin + msg_size;
+        const auto delimiter = std::find(begin, end, '\0');
+
+        if (delimiter != end) {
+            message_type.assign(begin, delimiter - begin);
+
+            const auto it = message_handlers.find(message_type);
+            if (it != message_handlers.end()) {
+                const auto& [cached_message, handler] = it->second;
+                const auto message_size = (((delimiter + 1) == end) ? 0 : (end - delimiter - 1));
+
+                if (cached_message->ParseFromArray(delimiter + 1, message_size)) {
+                    handler(std::move(*cached_message), connection);
+                } else {
+                    LOG(WARNING) << "ZmqServerConnection: malformed " << message_type << " from server";
+                }
+            }
+        }
+    }
+
+  private:
+    ServerConnection& connection;
+    std::string message_type;
+    std::unordered_map<std::string,
+                       std::pair<std::unique_ptr<google::protobuf::MessageLite>, ServerEventHandlers::MessageHandler>>
+            message_handlers;
+    ServerEventHandlers::DisconnectHandler disconnect_handler;
+};
+
 class ZmqServerConnection final : public ServerConnection {
   public:
     ZmqServerConnection(const std::string& server_address,
@@ -262,71 +340,185 @@ class ZmqServerConnection final : public ServerConnection {
         LOG(INFO) << "ZmqServerConnection: connecting to " << server_address << " with ID '" << client_id << "'";
 
         zmq_ops.UseSocket([&client_id, &server_address](const auto socket) {
-            // discard pending messages when closing socket
-            const int opt_linger = 0;
-            CHECK_ERR(zmq_setsockopt(socket, ZMQ_LINGER, &opt_linger, sizeof(opt_linger)));
+            ZmqOps::ConnectServerSocket(socket, server_address, client_id);
+        });
 
-            // get notified with a special message when server disconnects
-            CHECK_ERR(zmq_setsockopt(socket, ZMQ_HICCUP_MSG, "D", 1));
+        zmq_ops.StartMessageLoop<false>(server_address, ZmqServerMessageDispatcher{*this, std::move(event_handlers)});
+    }
 
-            // use our client id as the socket routing id
-            CHECK_ERR(zmq_setsockopt(socket, ZMQ_ROUTING_ID, client_id.c_str(), client_id.size()));
+    ~ZmqServerConnection() override {
+        StopMessageHandling();
+        LOG(INFO) << "ZmqServerConnection: closed";
+    }
 
-            CHECK_ERR(zmq_connect(socket, server_address.c_str()));
+  private:
+    void SendMessage(const google::protobuf::MessageLite& message) override {
+        zmq_ops.UseSocket([&msg = ZmqOps::SerializeMessage(message)](const auto socket) {
+            zmq_send(socket, msg.c_str(), msg.size(), 0);
         });
+    }
 
-        zmq_ops.StartMessageLoop<false>(
-                server_address,
-                [this, message_type = std::string{},
-                 message_handlers = ZmqOps::BuildMessageHandlerMap(std::move(event_handlers.message_handlers)),
-                 disconnect_handler = std::move(event_handlers.disconnect_handler)](auto msg, auto msg_size) mutable {
-                    // handle special connection state change message:
-                    // single 'D' character = server disconnected
-                    if ((msg_size == 1) && (*msg == 'D')) {
-                        LOG(INFO) << "ZmqServerConnection: disconnected from server, will try to reconnect";
-                        if (disconnect_handler) {
-                            disconnect_handler(*this);
-                        }
-                        return;
-                    }
+    void StopMessageHandling() override { zmq_ops.StopMessageLoop(); }
 
-                    const auto begin = msg;
-                    const auto end = begin + msg_size;
-                    const auto delimiter = std::find(begin, end, '\0');
+    ZmqOps zmq_ops;
+};
 
-                    if (delimiter != end) {
-                        message_type.assign(begin, delimiter - begin);
+// Sockets of server connections that share a context and a message loop thread, which are created together and live
+// until the last of their connections is destroyed
+class ZmqServerConnectionGroup final {
+  public:
+    explicit ZmqServerConnectionGroup(std::size_t num_connections) {
+        zeromq_context = zmq_ctx_new();
+        PCHECK(zeromq_context != nullptr);
 
-                        const auto it = message_handlers.find(message_type);
-                        if (it != message_handlers.end()) {
-                            const auto& [cached_message, handler] = it->second;
-                            const auto message_size = (((delimiter + 1) == end) ? 0 : (end - delimiter - 1));
+        // each connection has a socket, along with the pair used to signal the message loop
+        const auto max_sockets = static_cast<int>(num_connections + 2);
+        if (max_sockets > zmq_ctx_get(zeromq_context, ZMQ_MAX_SOCKETS)) {
+            CHECK_ERR(zmq_ctx_set(zeromq_context, ZMQ_MAX_SOCKETS, max_sockets));
+        }
 
-                            if (cached_message->ParseFromArray(delimiter + 1, message_size)) {
-                                handler(std::move(*cached_message), *this);
-                            } else {
-                                LOG(WARNING) << "ZmqServerConnection: malformed " << message_type << " from server";
-                            }
+        signal_socket_r = zmq_socket(zeromq_context, ZMQ_PAIR);
+        PCHECK(signal_socket_r != nullptr);
+        signal_socket_w = zmq_socket(zeromq_context, ZMQ_PAIR);
+        PCHECK(signal_socket_w != nullptr);
+        CHECK_ERR(zmq_bind(signal_socket_r, "inproc://signal"));
+        CHECK_ERR(zmq_connect(signal_socket_w, "inproc://signal"));
+    }
+
+    ~ZmqServerConnectionGroup() {
+        if (message_loop_thread.joinable()) {
+            zmq_send(signal_socket_w, "#", 1, 0);
+            message_loop_thread.join();
+        }
+        for (const auto& member : members) {
+            zmq_close(member->socket);
+        }
+        zmq_close(signal_socket_w);
+        zmq_close(signal_socket_r);
+        zmq_ctx_term(zeromq_context);
+    }
+
+    ZmqServerConnectionGroup(const ZmqServerConnectionGroup&) = delete;
+    ZmqServerConnectionGroup& operator=(const ZmqServerConnectionGroup&) = delete;
+
+    // must be called before StartMessageLoop(), and returns the index that the connection is referred to by
+    std::size_t AddConnection(ServerConnection& connection,
+                              const std::string& server_address,
+                              const std::string& client_id,
+                              ServerEventHandlers&& event_handlers) {
+        const auto socket = zmq_socket(zeromq_context, ZMQ_DEALER);
+        PCHECK(socket != nullptr);
+        ZmqOps::ConnectServerSocket(socket, server_address, client_id);
+        members.push_back(
+                std::make_unique<Member>(socket, ZmqServerMessageDispatcher{connection, std::move(event_handlers)}));
+        return members.size() - 1;
+    }
+
+    void StartMessageLoop() {
+        message_loop_thread = std::thread{[this] {
+            std::vector<zmq_pollitem_t> poll_items(members.size() + 1);
+            poll_items[0].socket = signal_socket_r;
+            poll_items[0].events = ZMQ_POLLIN;
+            for (std::size_t i = 0; i < members.size(); ++i) {
+                poll_items[i + 1].socket = members[i]->socket;
+                poll_items[i + 1].events = ZMQ_POLLIN;
+            }
+
+            zmq_msg_t zeromq_message;
+            zmq_msg_init(&zeromq_message);
+
+            while (true) {
+                zmq_poll(poll_items.data(), static_cast<int>(poll_items.size()), -1);
+
+                if (poll_items[0].revents) {
+                    break;
+                }
+
+                // one message from each ready socket per poll, so that a busy connection doesn't hold up the others
+                for (std::size_t i = 0; i < members.size(); ++i) {
+                    if (!poll_items[i + 1].revents) {
+                        continue;
+                    }
+
+                    auto& member = *members[i];
+                    zmq_msg_close(&zeromq_message);
+                    zmq_msg_init(&zeromq_message);
+                    {
+                        std::scoped_lock lock(member.socket_mutex);
+                        if (zmq_msg_recv(&zeromq_message, member.socket, ZMQ_DONTWAIT) < 0) {
+                            continue;
                         }
                     }
-                });
+
+                    std::scoped_lock lock(member.handler_mutex);
+                    if (!member.is_stopped) {
+                        member.dispatcher(static_cast<const char*>(zmq_msg_data(&zeromq_message)),
+                                          zmq_msg_size(&zeromq_message));
+                    }
+                }
+            }
+
+            zmq_msg_close(&zeromq_message);
+        }};
     }
 
-    ~ZmqServerConnection() override {
+    void SendMessage(std::size_t index, const google::protobuf::MessageLite& message) {
+        auto& member = *members[index];
+        const auto& msg = ZmqOps::SerializeMessage(message);
+        std::scoped_lock lock(member.socket_mutex);
+        zmq_send(member.socket, msg.c_str(), msg.size(), 0);
+    }
+
+    // waits for a message being handled for the connection to finish, after which none are handled
+    void StopMessageHandling(std::size_t index) {
+        auto& member = *members[index];
+        std::scoped_lock lock(member.handler_mutex);
+        member.is_stopped = true;
+    }
+
+  private:
+    struct Member {
+        Member(void* socket, ZmqServerMessageDispatcher&& dispatcher)
+                : socket(socket), dispatcher(std::move(dispatcher)) {}
+
+        void* const socket;
+        std::mutex socket_mutex;
+        ZmqServerMessageDispatcher dispatcher;
+        std::mutex handler_mutex;  // held while a message is being dispatched
+        bool is_stopped = false;
+    };
+
+    void* zeromq_context;
+    std::vector<std::unique_ptr<Member>> members;
+
+    std::thread message_loop_thread;
+    void* signal_socket_r;
+    void* signal_socket_w;
+};
+
+class ZmqGroupedServerConnection final : public ServerConnection {
+  public:
+    ZmqGroupedServerConnection(std::shared_ptr<ZmqServerConnectionGroup> group,
+                               const std::string& server_address,
+                               const std::string& client_id,
+                               ServerEventHandlers&& event_handlers)
+            : group(std::move(group)) {
+        LOG(INFO) << "ZmqServerConnection: connecting to " << server_address << " with ID '" << client_id << "'";
+        index = this->group->AddConnection(*this, server_address, client_id, std::move(event_handlers));
+    }
+
+    ~ZmqGroupedServerConnection() override {
         StopMessageHandling();
         LOG(INFO) << "ZmqServerConnection: closed";
     }
 
   private:
-    void SendMessage(const google::protobuf::MessageLite& message) override {
-        zmq_ops.UseSocket([&msg = ZmqOps::SerializeMessage(message)](const auto socket) {
-            zmq_send(socket, msg.c_str(), msg.size(), 0);
-        });
-    }
+    void SendMessage(const google::protobuf::MessageLite& message) override { group->SendMessage(index, message); }
 
-    void StopMessageHandling() override { zmq_ops.StopMessageLoop(); }
+    void StopMessageHandling() override { group->StopMessageHandling(index); }
 
-    ZmqOps zmq_ops;
+    const std::shared_ptr<ZmqServerConnectionGroup> group;
+    std::size_t index;
 };
 
 std::shared_ptr<ClientConnection> ZmqConnection::CreateClientConnection(const std::string& bind_address,
@@ -340,4 +532,17 @@ std::shared_ptr<ServerConnection> ZmqConnection::CreateServerConnection(const st
     return std::make_shared<ZmqServerConnection>(server_address, client_id, std::move(event_handlers));
 }
 
+std::vector<std::shared_ptr<ServerConnection>> ZmqConnection::CreateServerConnections(
+        const std::string& server_address,
+        std::vector<std::pair<std::string, ServerEventHandlers>> clients) {
+    const auto group = std::make_shared<ZmqServerConnectionGroup>(clients.size());
+    std::vector<std::shared_ptr<ServerConnection>> connections;
+    for (auto& [client_id, event_handlers] : clients) {
+        connections.push_back(std::make_shared<ZmqGroupedServerConnection>(group, server_address, client_id,
+                                                                           std::move(event_handlers)));
+    }
+    group->StartMessageLoop();
+    return connections;
+}
+
 }  // namespace whisker
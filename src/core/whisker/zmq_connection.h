@@ -3,6 +3,8 @@
 
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 #include <whisker/client_connection.h>
 #include <whisker/server_connection.h>
 
@@ -16,6 +18,14 @@ class ZmqConnection final {
     static std::shared_ptr<ServerConnection> CreateServerConnection(const std::string& server_address,
                                                                     const std::string& client_id,
                                                                     ServerEventHandlers event_handlers = {});
+
+    // Connects to the server as a number of clients at once (e.g. simulated ones), given as pairs of client ID and
+    // event handlers, and returns their connections in the same order.  Since the server tells clients apart by their
+    // sockets, each client still has its own socket, but they share one ZeroMQ context and have their messages
+    // handled on one thread instead of each connection having its own.
+    static std::vector<std::shared_ptr<ServerConnection>> CreateServerConnections(
+            const std::string& server_address,
+            std::vector<std::pair<std::string, ServerEventHandlers>> clients);
 };
 
 }  // namespace whisker
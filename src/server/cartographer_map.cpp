@@ -1,4 +1,6 @@
 #include "cartographer_map.h"
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
 #include <filesystem>
@@ -12,7 +14,6 @@
 #include <cartographer/mapping/map_builder.h>
 #include <cartographer/mapping/trajectory_builder_interface.h>
 #include <cartographer/mapping/2d/submap_2d.h>
-#include <cartographer/mapping/2d/xy_index.h>
 #include <cartographer/sensor/imu_data.h>
 #include <cartographer/sensor/rangefinder_point.h>
 #include <cartographer/sensor/timed_point_cloud_data.h>
@@ -20,9 +21,25 @@
 #include <Eigen/Geometry>
 #include <glog/logging.h>
 #include <png.h>
-
-CartographerMap::CartographerMap(std::string id, Json::Value cfg, bool use_overlapping_trimmer)
-        : map_id(std::move(id)), config(std::move(cfg)) {
+#include "submap_texture.h"
+
+CartographerMap::CartographerMap(std::string id,
+                                 Json::Value cfg,
+                                 bool use_overlapping_trimmer,
+                                 std::shared_ptr<whisker::ThreadPool> thread_pool,
+                                 std::shared_ptr<whisker::ThreadPool> texture_thread_pool,
+                                 std::shared_ptr<SubmapTextureCache> texture_cache,
+                                 bool prerender_submap_textures,
+                                 ObservationConsumedCallback observation_consumed_callback)
+        : map_id(std::move(id)),
+          config(std::move(cfg)),
+          observation_consumed_callback(std::move(observation_consumed_callback)),
+          task_queue(thread_pool),
+          read_queue(thread_pool),
+          texture_thread_pool(std::move(texture_thread_pool)),
+          texture_cache(std::move(texture_cache)),
+          texture_cache_map(this->texture_cache->AddMap()),
+          is_prerender_enabled(prerender_submap_textures) {
     const auto config_file = config["config_file"].asString();
     const auto base_config_dir = config["base_config_dir"].asString();
 
@@ -52,16 +69,44 @@ CartographerMap::CartographerMap(std::string id, Json::Value cfg, bool use_overl
         trimmer_options->set_min_added_submaps_count(config["overlapping_trimmer_min_added_submaps_count"].asInt());
     }
 
+    // with per-trajectory collation, sensor data for different trajectories goes through independent queues and local
+    // SLAM instances, so each vehicle's observations can be ingested on its own lane of the task queue
+    use_trajectory_lanes = map_builder_options.collate_by_trajectory();
+    LOG_IF(INFO, !use_trajectory_lanes) << "Map '" << map_id
+                                        << "' processes all vehicles' observations serially because "
+                                           "'collate_by_trajectory' is disabled";
+
     map_builder = cartographer::mapping::CreateMapBuilder(map_builder_options);
     map_builder->pose_graph()->SetGlobalSlamOptimizationCallback(
-            [this](const auto& last_optimized_submaps, const auto& last_optimized_nodes) { ++map_data_version; });
+            [this](const auto& last_optimized_submaps, const auto& last_optimized_nodes) {
+                ++map_data_version;
+                UpdateLocalToGlobalTransforms();
+                QueueSubmapTexturePrerender();
+            });
 
     map_data_cache.set_map_id(map_id);
 }
 
 CartographerMap::~CartographerMap() {
+    // do this in destructor to ensure class members outlive queues (the read queue goes first since it adds to the
+    // task queue)
+    stop_prerendering = true;
+    read_queue.FinishQueueSync();
     task_queue.AddTask([this] { DoFinalOptimization(); });
-    task_queue.FinishQueueSync();  // do this in destructor to ensure class members outlive queue
+    task_queue.FinishQueueSync();
+
+    // textures still being encoded need the cache to put themselves in
+    {
+        std::unique_lock lock(submap_textures_mutex);
+        submap_textures_in_flight_cv.wait(lock, [this] {
+            return submap_textures_in_flight.empty() && (num_submap_textures_being_delivered == 0);
+        });
+    }
+
+    // finishing the last textures of a pre-render pass may have queued another (empty) pass
+    read_queue.FinishQueueSync();
+
+    texture_cache->RemoveMap(texture_cache_map);
 }
 
 void CartographerMap::AddVehicle(std::string vehicle_id,
@@ -69,10 +114,15 @@ void CartographerMap::AddVehicle(std::string vehicle_id,
                                  whisker::proto::Transform initial_pose,
                                  bool allow_global_localization,
                                  bool use_localization_trimmer) {
+    // a new trajectory means new collator state for each of its sensors (see SubmitObservation())
+    std::scoped_lock lock(vehicle_submitted_sensors_mutex);
+    vehicle_submitted_sensors.erase(vehicle_id);
+
     task_queue.AddTask([this, vehicle_id = std::move(vehicle_id), sensor_ids = std::move(sensor_ids),
                         initial_pose = std::move(initial_pose), allow_global_localization, use_localization_trimmer] {
         const auto [it, emplaced] = vehicles.try_emplace(vehicle_id);
         if (emplaced) {
+            is_finally_optimized = false;
             bool using_imu = false;
 
             std::set<cartographer::mapping::MapBuilderInterface::SensorId> sensors;
@@ -112,18 +162,29 @@ void CartographerMap::AddVehicle(std::string vehicle_id,
                     // callback that is invoked when TrajectoryBuilderInterface::AddSensorData() processes a scan
                     [this, vehicle_id](const auto& trajectory, const auto& time, const auto& local_pose,
                                        const auto& range_data, const auto& insertion_result) {
+                        {
+                            std::scoped_lock lock(vehicle_poses_mutex);
+                            vehicle_poses.at(vehicle_id).local_pose = local_pose;
+                        }
                         const auto vehicle = vehicles.find(vehicle_id);
-                        vehicle->second.local_pose = local_pose;
                         if (insertion_result) {
                             const auto latest_submap_ptr = insertion_result->insertion_submaps.back().get();
                             // follow Cartographer's logic of comparing submap pointer values to detect changes
                             if (vehicle->second.latest_submap_ptr != latest_submap_ptr) {
                                 vehicle->second.latest_submap_ptr = latest_submap_ptr;
                                 ++map_data_version;
+                                QueueSubmapTexturePrerender();
                             }
                         }
                     });
 
+            {
+                std::scoped_lock lock(vehicle_poses_mutex);
+                vehicle_poses[vehicle_id] = {
+                        it->second.trajectory_id, cartographer::transform::Rigid3d::Identity(),
+                        map_builder->pose_graph()->GetLocalToGlobalTransform(it->second.trajectory_id)};
+            }
+
             LOG(INFO) << "Added vehicle '" << vehicle_id << "' as trajectory " << it->second.trajectory_id << " "
                       << (using_imu ? "with" : "without") << " IMU"
                       << (use_localization_trimmer ? ", using localization trimmer" : "");
@@ -132,18 +193,25 @@ void CartographerMap::AddVehicle(std::string vehicle_id,
 }
 
 void CartographerMap::RemoveVehicle(std::string vehicle_id) {
+    std::scoped_lock lock(vehicle_submitted_sensors_mutex);
+    vehicle_submitted_sensors.erase(vehicle_id);
+
     task_queue.AddTask([this, vehicle_id = std::move(vehicle_id)] {
         const auto vehicle = vehicles.find(vehicle_id);
         if (vehicle != vehicles.end()) {
+            is_finally_optimized = false;
             map_builder->FinishTrajectory(vehicle->second.trajectory_id);
             vehicles.erase(vehicle);
+
+            std::scoped_lock lock(vehicle_poses_mutex);
+            vehicle_poses.erase(vehicle_id);
         }
     });
 }
 
 void CartographerMap::GetMapData(unsigned int have_version,
                                  std::function<void(const whisker::proto::MapDataMessage&)> callback) {
-    task_queue.AddTask([this, have_version, callback = std::move(callback)] {
+    read_queue.AddTask([this, have_version, callback = std::move(callback)] {
         const auto is_new_map = (have_version != map_data_version);
 
         map_data_cache.set_is_new_map_version(is_new_map);
@@ -169,19 +237,29 @@ void CartographerMap::GetMapData(unsigned int have_version,
             }
         }
 
+        map_data_cache.set_ingest_queue_depth(task_queue.GetNumTasks());
+        map_data_cache.set_read_queue_depth(read_queue.GetNumTasks() - 1);  // don't count this task
+        map_data_cache.set_submap_texture_cache_hits(submap_texture_cache_hits);
+        map_data_cache.set_submap_texture_cache_misses(submap_texture_cache_misses);
+        const auto texture_cache_stats = texture_cache->GetMapStats(texture_cache_map);
+        map_data_cache.set_submap_texture_cache_size(texture_cache_stats.num_textures);
+        map_data_cache.set_submap_texture_cache_bytes(texture_cache_stats.num_bytes);
+
         callback(map_data_cache);
 
-        // delete cached textures of submaps that no longer exist (submap_texture_cache.size() serves as a heuristic)
-        if (is_new_map && (submap_texture_cache.size() > submaps.size())) {
-            std::unordered_set<cartographer::mapping::SubmapId> cached_ids(submap_texture_cache.size());
-            for (const auto& [id, texture] : submap_texture_cache) {
-                cached_ids.emplace(id);
+        // forget textures of submaps that no longer exist (rendered_texture_versions.size() serves as a heuristic)
+        std::scoped_lock lock(submap_textures_mutex);
+        if (is_new_map && (rendered_texture_versions.size() > submaps.size())) {
+            std::unordered_set<cartographer::mapping::SubmapId> rendered_ids(rendered_texture_versions.size());
+            for (const auto& [id, version] : rendered_texture_versions) {
+                rendered_ids.emplace(id);
             }
             for (const auto& submap : submaps) {
-                cached_ids.erase(submap.id);
+                rendered_ids.erase(submap.id);
             }
-            for (const auto& obsolete_id : cached_ids) {
-                submap_texture_cache.erase(obsolete_id);
+            for (const auto& obsolete_id : rendered_ids) {
+                rendered_texture_versions.erase(obsolete_id);
+                texture_cache->Erase(texture_cache_map, obsolete_id);
             }
         }
     });
@@ -190,37 +268,41 @@ void CartographerMap::GetMapData(unsigned int have_version,
 void CartographerMap::GetSubmapTexture(int trajectory_id,
                                        int index,
                                        std::function<void(const whisker::proto::SubmapTextureMessage&)> callback) {
-    task_queue.AddTask([this, trajectory_id, index, callback = std::move(callback)] {
-        const cartographer::mapping::SubmapId submap_id(trajectory_id, index);
+    read_queue.AddTask([this, submap_id = cartographer::mapping::SubmapId{trajectory_id, index},
+                        callback = std::move(callback)]() mutable {
         const auto submap = map_builder->pose_graph()->GetSubmapData(submap_id).submap;
-        if (submap) {
-            const auto [it, emplaced] = submap_texture_cache.try_emplace(submap_id);
-            auto& texture_msg = it->second;
-            if (emplaced) {
-                texture_msg.set_map_id(map_id);
-                texture_msg.mutable_submap_id()->set_trajectory_id(trajectory_id);
-                texture_msg.mutable_submap_id()->set_index(index);
-                CreateSubmapTexture(submap, texture_msg);
-            } else if (texture_msg.version() != submap->num_range_data()) {
-                CreateSubmapTexture(submap, texture_msg);
-            }
-            callback(texture_msg);
+        if (!submap) {
+            return;
+        }
+
+        // textures are normally pre-rendered as submaps change, so this only has to wait for one if the request
+        // arrived between a change and the pre-render pass that picks it up
+        // (or if its texture was evicted from the cache since)
+        const auto texture_msg = texture_cache->Get(texture_cache_map, submap_id);
+        if (texture_msg && (texture_msg->version() == submap->num_range_data())) {
+            ++submap_texture_cache_hits;
+            callback(*texture_msg);
+        } else {
+            ++submap_texture_cache_misses;
+            RenderSubmapTexture(submap_id, std::move(callback));
         }
     });
 }
 
 void CartographerMap::GetVehiclePoses(std::function<void(const whisker::proto::VehiclePosesMessage&)> callback) {
-    task_queue.AddTask([this, callback = std::move(callback)] {
+    read_queue.AddTask([this, callback = std::move(callback)] {
         whisker::proto::VehiclePosesMessage msg;
         msg.set_map_id(map_id);
-        for (const auto& [vehicle_id, vehicle_data] : vehicles) {
-            const auto pose = map_builder->pose_graph()->GetLocalToGlobalTransform(vehicle_data.trajectory_id) *
-                              vehicle_data.local_pose;
-            const auto vehicle_pose = msg.add_vehicle_poses();
-            vehicle_pose->set_vehicle_id(vehicle_id);
-            vehicle_pose->mutable_pose()->set_x(pose.translation().x());
-            vehicle_pose->mutable_pose()->set_y(pose.translation().y());
-            vehicle_pose->mutable_pose()->set_r(cartographer::transform::GetYaw(pose));
+        {
+            std::scoped_lock lock(vehicle_poses_mutex);
+            for (const auto& [vehicle_id, vehicle_pose] : vehicle_poses) {
+                const auto pose = vehicle_pose.local_to_global * vehicle_pose.local_pose;
+                const auto vehicle_pose_msg = msg.add_vehicle_poses();
+                vehicle_pose_msg->set_vehicle_id(vehicle_id);
+                vehicle_pose_msg->mutable_pose()->set_x(pose.translation().x());
+                vehicle_pose_msg->mutable_pose()->set_y(pose.translation().y());
+                vehicle_pose_msg->mutable_pose()->set_r(cartographer::transform::GetYaw(pose));
+            }
         }
         callback(msg);
     });
@@ -229,10 +311,24 @@ void CartographerMap::GetVehiclePoses(std::function<void(const whisker::proto::V
 void CartographerMap::SubmitObservation(std::string sensor_id,
                                         std::shared_ptr<const whisker::proto::SensorClientInitMessage> sensor_data,
                                         std::shared_ptr<const whisker::proto::ObservationMessage> observation) {
-    task_queue.AddTask([this, sensor_id = std::move(sensor_id), sensor_data = std::move(sensor_data),
-                        observation = std::move(observation)] {
+    // refers into 'sensor_data', which is kept alive by the task
+    const auto& vehicle_id = sensor_data->vehicle_id();
+
+    // Cartographer's TrajectoryCollator is shared by all trajectories, and the first observation of each sensor on a
+    // trajectory inserts a metric into it, so that one has to be exclusive.  Later observations only touch the
+    // trajectory's own queue and builder, and the PoseGraph which does its own locking.
+    std::unique_lock lock(vehicle_submitted_sensors_mutex, std::defer_lock);
+    bool is_exclusive = true;
+    if (use_trajectory_lanes) {
+        lock.lock();
+        is_exclusive = vehicle_submitted_sensors[vehicle_id].insert(sensor_id).second;
+    }
+
+    auto task = [this, sensor_id = std::move(sensor_id), sensor_data = std::move(sensor_data),
+                 observation = std::move(observation)] {
         const auto vehicle = vehicles.find(sensor_data->vehicle_id());
         if (vehicle != vehicles.end()) {
+            is_finally_optimized.store(false, std::memory_order_relaxed);
             const cartographer::common::Time timestamp(
                     cartographer::common::FromMilliseconds(observation->timestamp()));
 
@@ -290,12 +386,58 @@ void CartographerMap::SubmitObservation(std::string sensor_id,
                             ->AddSensorData(sensor_id, point_data);
                 } break;
 
+                case whisker::proto::ObservationMessage::kImuBatchObservation: {
+                    const auto& imu_properties = sensor_data->imu_properties();
+                    const auto& imu_batch = observation->imu_batch_observation();
+
+                    const auto num_samples = imu_batch.time_offsets_size();
+                    if ((imu_batch.linear_acceleration_x_size() != num_samples) ||
+                        (imu_batch.linear_acceleration_y_size() != num_samples) ||
+                        (imu_batch.linear_acceleration_z_size() != num_samples) ||
+                        (imu_batch.angular_velocity_x_size() != num_samples) ||
+                        (imu_batch.angular_velocity_y_size() != num_samples) ||
+                        (imu_batch.angular_velocity_z_size() != num_samples)) {
+                        LOG(WARNING) << "Received an IMU batch with inconsistent sample counts from sensor '"
+                                     << sensor_id << "'";
+                        break;
+                    }
+
+                    const auto sensor_rotation = cartographer::transform::RollPitchYaw(
+                            imu_properties.roll(), imu_properties.pitch(), imu_properties.yaw());
+                    const cartographer::common::Time start_time(std::chrono::microseconds{imu_batch.start_timestamp()});
+                    const auto trajectory_builder = map_builder->GetTrajectoryBuilder(vehicle->second.trajectory_id);
+
+                    cartographer::sensor::ImuData imu_data;
+                    for (auto i = 0; i < num_samples; ++i) {
+                        imu_data.time = start_time + std::chrono::microseconds{imu_batch.time_offsets(i)};
+                        imu_data.linear_acceleration =
+                                sensor_rotation * Eigen::Vector3d{imu_batch.linear_acceleration_x(i),
+                                                                  imu_batch.linear_acceleration_y(i),
+                                                                  imu_batch.linear_acceleration_z(i)};
+                        imu_data.angular_velocity =
+                                sensor_rotation * Eigen::Vector3d{imu_batch.angular_velocity_x(i),
+                                                                  imu_batch.angular_velocity_y(i),
+                                                                  imu_batch.angular_velocity_z(i)};
+                        trajectory_builder->AddSensorData(sensor_id, imu_data);
+                    }
+                } break;
+
                 case whisker::proto::ObservationMessage::SENSOR_TYPE_NOT_SET: {
                     LOG(WARNING) << "Received an empty observation from sensor '" << sensor_id << "'";
                 } break;
             }
         }
-    });
+
+        if (observation_consumed_callback) {
+            observation_consumed_callback(sensor_id);
+        }
+    };
+
+    if (is_exclusive) {
+        task_queue.AddTask(std::move(task));
+    } else {
+        task_queue.AddLaneTask(vehicle_id, std::move(task));
+    }
 }
 
 void CartographerMap::SaveState(std::string state_file_path) {
@@ -314,21 +456,200 @@ void CartographerMap::LoadState(std::string state_file_path, bool is_frozen) {
     task_queue.AddTask([this, state_file_path = std::move(state_file_path), is_frozen] {
         map_builder->LoadStateFromFile(state_file_path, is_frozen);
         map_builder->pose_graph()->RunFinalOptimization();
+        QueueSubmapTexturePrerender();
         LOG(INFO) << "Loaded map state from " << std::filesystem::absolute(state_file_path).lexically_normal()
                   << " into map '" << map_id << "'";
     });
 }
 
 void CartographerMap::DoFinalOptimization() {
+    // trajectories are always finished, so that none is left active in a saved map
+    const auto has_active_trajectories = !vehicles.empty();
     for (const auto& [vehicle_id, vehicle_data] : vehicles) {
         map_builder->FinishTrajectory(vehicle_data.trajectory_id);
     }
     vehicles.clear();
+    {
+        std::scoped_lock lock(vehicle_poses_mutex);
+        vehicle_poses.clear();
+    }
+
+    // but e.g. saving a map then deleting it would otherwise optimize the same data twice
+    if (is_finally_optimized && !has_active_trajectories) {
+        return;
+    }
+
+    const auto start_time = std::chrono::steady_clock::now();
     map_builder->pose_graph()->RunFinalOptimization();
+    is_finally_optimized = true;
+    LOG(INFO) << "Final optimization of map '" << map_id << "' took "
+              << std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count() << " s";
+}
+
+void CartographerMap::UpdateLocalToGlobalTransforms() {
+    std::scoped_lock lock(vehicle_poses_mutex);
+    for (auto& [vehicle_id, vehicle_pose] : vehicle_poses) {
+        vehicle_pose.local_to_global = map_builder->pose_graph()->GetLocalToGlobalTransform(vehicle_pose.trajectory_id);
+    }
+}
+
+std::string CartographerMap::GetVehicleIdForTrajectory(int trajectory_id) {
+    std::scoped_lock lock(vehicle_poses_mutex);
+    for (const auto& [vehicle_id, vehicle_pose] : vehicle_poses) {
+        if (vehicle_pose.trajectory_id == trajectory_id) {
+            return vehicle_id;
+        }
+    }
+    return {};
 }
 
-void CartographerMap::CreateSubmapTexture(const std::shared_ptr<const cartographer::mapping::Submap>& submap,
-                                          whisker::proto::SubmapTextureMessage& texture_msg) {
+void CartographerMap::SetSubmapTexturePrerendering(bool enabled) {
+    is_prerender_enabled = enabled;
+    if (enabled) {
+        QueueSubmapTexturePrerender();
+    }
+}
+
+void CartographerMap::QueueSubmapTexturePrerender() {
+    is_prerender_requested = true;
+    if (is_prerender_enabled && !stop_prerendering && !is_prerender_running.exchange(true)) {
+        read_queue.AddTask([this] { PrerenderSubmapTextures(); });
+    }
+}
+
+void CartographerMap::PrerenderSubmapTextures() {
+    is_prerender_requested = false;
+
+    // released once every texture of this pass has been rendered (or found to be unneeded), which lets the next pass
+    // start if there's more to do
+    const std::shared_ptr<void> pass_token(nullptr, [this](void*) {
+        is_prerender_running = false;
+        if (is_prerender_requested) {
+            QueueSubmapTexturePrerender();
+        }
+    });
+
+    if (!is_prerender_enabled || stop_prerendering) {
+        return;
+    }
+
+    unsigned int num_prerenders = 0;
+    for (const auto& submap : map_builder->pose_graph()->GetAllSubmapPoses()) {
+        // textures that were evicted from the cache are left to be rendered again when they're requested, since the
+        // cache would otherwise churn if it can't hold all of the map's textures
+        {
+            std::scoped_lock lock(submap_textures_mutex);
+            const auto rendered_version = rendered_texture_versions.find(submap.id);
+            if (((rendered_version != rendered_texture_versions.end()) &&
+                 (rendered_version->second >= submap.data.version)) ||
+                (submap_textures_in_flight.count({submap.id, submap.data.version}) > 0)) {
+                continue;
+            }
+        }
+
+        if (num_prerenders == max_prerenders_per_pass) {
+            is_prerender_requested = true;
+            break;
+        }
+        ++num_prerenders;
+        RenderSubmapTexture(submap.id, [pass_token](const auto& texture_msg) {});
+    }
+}
+
+void CartographerMap::RenderSubmapTexture(const cartographer::mapping::SubmapId& submap_id,
+                                          SubmapTextureCallback callback) {
+    // submaps of a vehicle's trajectory are written to as its observations are ingested, so they have to be read in
+    // between that vehicle's observations instead of from the read queue
+    const auto vehicle_id = GetVehicleIdForTrajectory(submap_id.trajectory_id);
+    if (vehicle_id.empty()) {
+        SendSubmapTexture(submap_id, std::move(callback));
+    } else if (use_trajectory_lanes) {
+        task_queue.AddLaneTask(vehicle_id, [this, submap_id, callback = std::move(callback)]() mutable {
+            SendSubmapTexture(submap_id, std::move(callback));
+        });
+    } else {
+        task_queue.AddTask([this, submap_id, callback = std::move(callback)]() mutable {
+            SendSubmapTexture(submap_id, std::move(callback));
+        });
+    }
+}
+
+void CartographerMap::SendSubmapTexture(const cartographer::mapping::SubmapId& submap_id,
+                                        SubmapTextureCallback callback) {
+    const auto submap = map_builder->pose_graph()->GetSubmapData(submap_id).submap;
+    if (!submap) {
+        return;
+    }
+
+    const auto version = submap->num_range_data();
+    if (const auto texture_msg = texture_cache->Get(texture_cache_map, submap_id);
+        texture_msg && (texture_msg->version() == version)) {
+        callback(*texture_msg);
+        return;
+    }
+
+    {
+        std::scoped_lock lock(submap_textures_mutex);
+
+        // if this version of the submap is already being encoded, its texture goes to this callback as well
+        const auto [in_flight, emplaced] =
+                submap_textures_in_flight.try_emplace({submap_id, version});
+        in_flight->second.emplace_back(std::move(callback));
+        if (!emplaced) {
+            return;
+        }
+    }
+
+    // only rasterizing the submap needs to happen here in between the map's other tasks, while the much slower PNG
+    // encoding can run in parallel with them
+    SubmapTextureSnapshot snapshot;
+    snapshot.version = version;
+    snapshot.texture_msg = std::make_shared<whisker::proto::SubmapTextureMessage>();
+    snapshot.texture_msg->set_map_id(map_id);
+    snapshot.texture_msg->mutable_submap_id()->set_trajectory_id(submap_id.trajectory_id);
+    snapshot.texture_msg->mutable_submap_id()->set_index(submap_id.submap_index);
+    CreateSubmapTextureSnapshot(submap, snapshot);
+
+    texture_thread_pool->Schedule([this, submap_id, snapshot = std::move(snapshot)]() mutable {
+        EncodeSubmapTexture(snapshot);
+        FinishSubmapTexture(submap_id, std::move(snapshot));
+    });
+}
+
+void CartographerMap::FinishSubmapTexture(const cartographer::mapping::SubmapId& submap_id,
+                                          SubmapTextureSnapshot snapshot) {
+    const std::shared_ptr<const whisker::proto::SubmapTextureMessage> texture_msg = std::move(snapshot.texture_msg);
+    texture_cache->Put(texture_cache_map, submap_id, texture_msg);
+
+    std::vector<SubmapTextureCallback> callbacks;
+    {
+        std::scoped_lock lock(submap_textures_mutex);
+
+        // another encoding of a newer version of the submap may have finished first
+        auto& rendered_version = rendered_texture_versions[submap_id];
+        rendered_version = std::max(rendered_version, snapshot.version);
+
+        const auto in_flight = submap_textures_in_flight.find({submap_id, snapshot.version});
+        CHECK(in_flight != submap_textures_in_flight.end())
+                << "Texture of submap " << submap_id << " version " << snapshot.version << " wasn't in flight";
+        callbacks = std::move(in_flight->second);
+        submap_textures_in_flight.erase(in_flight);
+        ++num_submap_textures_being_delivered;
+    }
+
+    for (const auto& callback : callbacks) {
+        callback(*texture_msg);
+    }
+    callbacks.clear();  // pre-render callbacks hold on to their pass until they're destroyed
+
+    // notify while holding the lock since the map may be destroyed as soon as it's released
+    std::scoped_lock lock(submap_textures_mutex);
+    --num_submap_textures_being_delivered;
+    submap_textures_in_flight_cv.notify_all();
+}
+
+void CartographerMap::CreateSubmapTextureSnapshot(const std::shared_ptr<const cartographer::mapping::Submap>& submap,
+                                                  SubmapTextureSnapshot& snapshot) {
     const auto grid = std::static_pointer_cast<const cartographer::mapping::Submap2D>(submap)->grid();
 
     // use a smaller cropped bounding box containing all known cells to produce the submap texture
@@ -340,41 +661,37 @@ void CartographerMap::CreateSubmapTexture(const std::shared_ptr<const cartograph
     const auto png_height = cropped_limits.num_y_cells;
     const auto resolution = grid->limits().resolution();
 
-    texture_msg.set_version(submap->num_range_data());
-    texture_msg.set_resolution(resolution);
+    const auto texture_msg = snapshot.texture_msg.get();
+    texture_msg->set_version(snapshot.version);
+    texture_msg->set_resolution(resolution);
 
     // this is the transform from the submap's local pose to the center of the generated PNG
     // (the -M_PI/2 rotation is to compensate for the grid's rotated layout)
-    texture_msg.mutable_submap_pose()->set_x(grid->limits().max().x() - submap->local_pose().translation().x() -
-                                             (resolution * (cropped_offset.y() + (png_height / 2.0))));
-    texture_msg.mutable_submap_pose()->set_y(grid->limits().max().y() - submap->local_pose().translation().y() -
-                                             (resolution * (cropped_offset.x() + (png_width / 2.0))));
-    texture_msg.mutable_submap_pose()->set_r(-M_PI / 2);
-
-    const auto png_out = texture_msg.mutable_texture();
-
-    thread_local std::vector<std::uint8_t> submap_texture_buffer;
-    submap_texture_buffer.resize(png_width * png_height);
-
-    auto cursor = submap_texture_buffer.data();
-    for (const auto& cropped_index : cartographer::mapping::XYIndexRangeIterator(cropped_limits)) {
-        const auto cell = cropped_offset + cropped_index;
-        if (grid->IsKnown(cell)) {
-            *(cursor++) = cartographer::mapping::ProbabilityToLogOddsInteger(1 - grid->GetCorrespondenceCost(cell));
-        } else {
-            *(cursor++) = 0;
-        }
-    }
+    texture_msg->mutable_submap_pose()->set_x(grid->limits().max().x() - submap->local_pose().translation().x() -
+                                              (resolution * (cropped_offset.y() + (png_height / 2.0))));
+    texture_msg->mutable_submap_pose()->set_y(grid->limits().max().y() - submap->local_pose().translation().y() -
+                                              (resolution * (cropped_offset.x() + (png_width / 2.0))));
+    texture_msg->mutable_submap_pose()->set_r(-M_PI / 2);
+
+    snapshot.width = png_width;
+    snapshot.height = png_height;
+    snapshot.pixels.resize(png_width * png_height);
+
+    RasterizeSubmapTexture(*grid, cropped_offset, cropped_limits, snapshot.pixels.data());
+}
 
+void CartographerMap::EncodeSubmapTexture(SubmapTextureSnapshot& snapshot) {
     png_image image{};
     image.version = PNG_IMAGE_VERSION;
-    image.width = png_width;
-    image.height = png_height;
+    image.width = snapshot.width;
+    image.height = snapshot.height;
     image.format = PNG_FORMAT_GRAY;
 
+    const auto png_out = snapshot.texture_msg->mutable_texture();
     auto output_size = PNG_IMAGE_PNG_SIZE_MAX(image);
     png_out->resize(output_size);
-    CHECK(png_image_write_to_memory(&image, png_out->data(), &output_size, 0, submap_texture_buffer.data(), png_width,
+    CHECK(png_image_write_to_memory(&image, png_out->data(), &output_size, 0, snapshot.pixels.data(), snapshot.width,
                                     nullptr));
     png_out->resize(output_size);
+    png_out->shrink_to_fit();  // the worst case size reserved above is much larger than what's cached
 }
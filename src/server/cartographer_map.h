@@ -2,8 +2,13 @@
 #define WHISKER_CARTOGRAPHER_MAP_H
 
 #include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -14,15 +19,35 @@
 #include <cartographer/mapping/proto/trajectory_builder_options.pb.h>
 #include <cartographer/transform/rigid_transform.h>
 #include <json/json.h>
-#include <whisker/task_queue.h>
+#include <whisker/lane_strand.h>
+#include <whisker/strand.h>
+#include <whisker/thread_pool.h>
 #include <client.pb.h>
 #include <console.pb.h>
+#include "submap_texture_cache.h"
 
 class CartographerMap final {
   public:
     using SensorIdAndType = std::pair<std::string, whisker::proto::SensorClientInitMessage::SensorTypeCase>;
+    using ObservationConsumedCallback = std::function<void(const std::string& sensor_id)>;
 
-    CartographerMap(std::string id, Json::Value cfg, bool use_overlapping_trimmer);
+    // 'observation_consumed_callback' is invoked (from one of the map's tasks) after each submitted observation has
+    // been processed
+    //
+    // submap textures are PNG-encoded on 'texture_thread_pool', which can be sized smaller than 'thread_pool' so that
+    // a burst of texture requests can't occupy all of the threads that ingest observations, and kept in
+    // 'texture_cache', which may be shared with other maps
+    //
+    // 'prerender_submap_textures' sets whether the textures of changed submaps are rendered before they're requested
+    // (see SetSubmapTexturePrerendering())
+    CartographerMap(std::string id,
+                    Json::Value cfg,
+                    bool use_overlapping_trimmer,
+                    std::shared_ptr<whisker::ThreadPool> thread_pool,
+                    std::shared_ptr<whisker::ThreadPool> texture_thread_pool,
+                    std::shared_ptr<SubmapTextureCache> texture_cache,
+                    bool prerender_submap_textures,
+                    ObservationConsumedCallback observation_consumed_callback = {});
     ~CartographerMap();
 
     CartographerMap(const CartographerMap&) = delete;
@@ -41,6 +66,10 @@ class CartographerMap final {
                           std::function<void(const whisker::proto::SubmapTextureMessage&)> callback);
     void GetVehiclePoses(std::function<void(const whisker::proto::VehiclePosesMessage&)> callback);
 
+    // pre-rendering only saves time for consoles viewing the map, and otherwise takes ingestion lane time and cache
+    // space for nothing -- enabling it catches up on the submaps that changed while it was disabled
+    void SetSubmapTexturePrerendering(bool enabled);
+
     void SubmitObservation(std::string sensor_id,
                            std::shared_ptr<const whisker::proto::SensorClientInitMessage> sensor_data,
                            std::shared_ptr<const whisker::proto::ObservationMessage> observation);
@@ -51,24 +80,78 @@ class CartographerMap final {
   private:
     struct VehicleData {
         int trajectory_id;
-        cartographer::transform::Rigid3d local_pose;
         const void* latest_submap_ptr = nullptr;
     };
 
+    // the parts of a vehicle's state needed to answer console queries, kept apart from VehicleData so that the read
+    // queue never has to wait for the ingestion queue
+    struct VehiclePose {
+        int trajectory_id;
+        cartographer::transform::Rigid3d local_pose;
+        cartographer::transform::Rigid3d local_to_global;
+    };
+
+    using SubmapTextureCallback = std::function<void(const whisker::proto::SubmapTextureMessage&)>;
+
+    // a submap's texture as rasterized from its grid, waiting to be PNG-encoded into 'texture_msg'
+    struct SubmapTextureSnapshot {
+        std::shared_ptr<whisker::proto::SubmapTextureMessage> texture_msg;
+        int version;  // the version it's in flight as, which the rasterized grid may have moved past
+        int width;
+        int height;
+        std::vector<std::uint8_t> pixels;
+    };
+
     void DoFinalOptimization();
+    void UpdateLocalToGlobalTransforms();
+    std::string GetVehicleIdForTrajectory(int trajectory_id);
+    void QueueSubmapTexturePrerender();
+    void PrerenderSubmapTextures();
+    void RenderSubmapTexture(const cartographer::mapping::SubmapId& submap_id, SubmapTextureCallback callback);
+    void SendSubmapTexture(const cartographer::mapping::SubmapId& submap_id, SubmapTextureCallback callback);
+    void FinishSubmapTexture(const cartographer::mapping::SubmapId& submap_id, SubmapTextureSnapshot snapshot);
+
+    static void CreateSubmapTextureSnapshot(const std::shared_ptr<const cartographer::mapping::Submap>& submap,
+                                            SubmapTextureSnapshot& snapshot);
+    static void EncodeSubmapTexture(SubmapTextureSnapshot& snapshot);
 
-    static void CreateSubmapTexture(const std::shared_ptr<const cartographer::mapping::Submap>& submap,
-                                    whisker::proto::SubmapTextureMessage& texture_msg);
+    // bounds the memory held by rasterized textures waiting to be encoded when a large map is pre-rendered
+    static constexpr unsigned int max_prerenders_per_pass = 8;
 
     const std::string map_id;
     const Json::Value config;
+    const ObservationConsumedCallback observation_consumed_callback;
     cartographer::mapping::proto::TrajectoryBuilderOptions trajectory_builder_options;
     std::unique_ptr<cartographer::mapping::MapBuilderInterface> map_builder;
     std::atomic_uint map_data_version = 1;
-    whisker::TaskQueue task_queue;
+    std::atomic_bool is_finally_optimized = false;  // whether nothing has been added since DoFinalOptimization()
+    bool use_trajectory_lanes = false;  // whether observations for different vehicles may be processed concurrently
+    whisker::LaneStrand task_queue;     // orders this map's work on the server-wide thread pool
+    whisker::Strand read_queue;         // console queries, which don't need to wait for 'task_queue'
     std::unordered_map<std::string, VehicleData> vehicles;
+    // sensors of each vehicle that have had an observation queued since the vehicle was added
+    std::unordered_map<std::string, std::set<std::string>> vehicle_submitted_sensors;
+    std::mutex vehicle_submitted_sensors_mutex;  // also held while queueing, so the queue order matches the sets
+    std::unordered_map<std::string, VehiclePose> vehicle_poses;
+    std::mutex vehicle_poses_mutex;
     whisker::proto::MapDataMessage map_data_cache;
-    std::unordered_map<cartographer::mapping::SubmapId, whisker::proto::SubmapTextureMessage> submap_texture_cache;
+    const std::shared_ptr<whisker::ThreadPool> texture_thread_pool;
+    const std::shared_ptr<SubmapTextureCache> texture_cache;
+    const SubmapTextureCache::MapHandle texture_cache_map;
+    // latest version of each submap whose texture has been rendered, whether or not it's still in 'texture_cache'
+    std::unordered_map<cartographer::mapping::SubmapId, int> rendered_texture_versions;
+    // callbacks waiting on textures that are being encoded, by submap ID and version
+    std::map<std::pair<cartographer::mapping::SubmapId, int>, std::vector<SubmapTextureCallback>>
+            submap_textures_in_flight;
+    unsigned int num_submap_textures_being_delivered = 0;  // callbacks running outside of the mutex
+    std::mutex submap_textures_mutex;
+    std::condition_variable submap_textures_in_flight_cv;
+    std::atomic_uint64_t submap_texture_cache_hits = 0;
+    std::atomic_uint64_t submap_texture_cache_misses = 0;
+    std::atomic_bool is_prerender_requested = false;  // whether submaps may have changed since the last pass started
+    std::atomic_bool is_prerender_running = false;    // whether a pass is queued or its textures are still rendering
+    std::atomic_bool is_prerender_enabled;
+    std::atomic_bool stop_prerendering = false;
 };
 
 #endif  // WHISKER_CARTOGRAPHER_MAP_H
@@ -1,5 +1,6 @@
 #include <future>
 #include <memory>
+#include <string>
 #include <utility>
 #include <vector>
 #include <glog/logging.h>
@@ -48,11 +49,16 @@ class Server final : public whisker::Init::Context {
                 [this, server_tasks](auto&& message, auto& connection, auto&& client_id) {
                     if (!message.vehicle_id().empty() && (message.keep_out_radius() > 0)) {
                         LOG(INFO) << "Init sensor client '" << client_id << "' on vehicle '" << message.vehicle_id()
-                                  << "'";
+                                  << "'" << (message.use_streaming() ? " with observation streaming" : "");
                         server_tasks->AddSensorClient(
                                 client_id, message,
                                 [&connection, client_id, msg = whisker::proto::RequestObservationMessage{}] {
                                     connection.SendMessage(msg, client_id);
+                                },
+                                [&connection, client_id](unsigned int num_credits) {
+                                    whisker::proto::GrantObservationCreditsMessage msg;
+                                    msg.set_num_credits(num_credits);
+                                    connection.SendMessage(msg, client_id);
                                 });
                         BroadcastConsoleMessage(server_tasks->GetServerState());
                     } else {
@@ -99,6 +105,8 @@ class Server final : public whisker::Init::Context {
             if (is_connected) {
                 // notify newly connected consoles of current server state
                 connection.SendMessage(server_tasks->GetServerState(), console_id);
+            } else {
+                server_tasks->UnsubscribeFromAllMaps(connection, console_id);
             }
         };
 
@@ -123,6 +131,16 @@ class Server final : public whisker::Init::Context {
                     server_tasks->GetVehiclePoses(message.map_id(), MakeResponder(connection, std::move(console_id)));
                 });
 
+        event_handlers.SetMessageHandler<whisker::proto::RequestSubscribeMapMessage>(
+                [server_tasks](auto&& message, auto& connection, auto&& console_id) {
+                    server_tasks->SubscribeToMap(message.map_id(), connection, console_id);
+                });
+
+        event_handlers.SetMessageHandler<whisker::proto::RequestUnsubscribeMapMessage>(
+                [server_tasks](auto&& message, auto& connection, auto&& console_id) {
+                    server_tasks->UnsubscribeFromMap(message.map_id(), connection, console_id);
+                });
+
         event_handlers.SetMessageHandler<whisker::proto::InvokeCapabilityMessage>(
                 [server_tasks](auto&& message, auto& connection, auto&& console_id) {
                     server_tasks->InvokeCapability(message);
@@ -188,8 +206,11 @@ class Server final : public whisker::Init::Context {
 
         const auto& ws_cfg = console_service_cfg["websocket"];
         if (ws_cfg["enabled"].asBool()) {
+            whisker::WebsocketOutgoingQueueOptions queue_options;
+            queue_options.coalescing_key_func = &GetConsoleMessageCoalescingKey;
+            queue_options.max_queued_bytes = ws_cfg["max_queued_bytes"].asUInt64();
             console_connections.emplace_back(whisker::WebsocketConnection::CreateClientConnection(
-                    ws_cfg["port"].asUInt(), ws_cfg["root"].asString(), event_handlers));
+                    ws_cfg["port"].asUInt(), ws_cfg["root"].asString(), event_handlers, std::move(queue_options)));
         }
 
         const auto& zmq_cfg = console_service_cfg["zeromq"];
@@ -207,6 +228,30 @@ class Server final : public whisker::Init::Context {
         }
     }
 
+    // a console only needs the latest vehicle poses and map data for each map, and the latest texture for each submap,
+    // so older ones still waiting to be sent over a slow link can be replaced
+    static whisker::WebsocketOutgoingQueueOptions::CoalescingKey GetConsoleMessageCoalescingKey(
+            const google::protobuf::MessageLite& message) {
+        if (const auto msg = dynamic_cast<const whisker::proto::VehiclePosesMessage*>(&message)) {
+            return {"poses/" + msg->map_id()};
+        }
+        if (const auto msg = dynamic_cast<const whisker::proto::MapDataMessage*>(&message)) {
+            // a new map version carries submap poses that later updates don't, so it's only superseded by another one,
+            // and neither kind may overtake the other
+            if (msg->is_new_map_version()) {
+                return {"map_version/" + msg->map_id(), msg->map_version(), false};
+            }
+            return {"map_data/" + msg->map_id(), 0, false};
+        }
+        if (const auto msg = dynamic_cast<const whisker::proto::SubmapTextureMessage*>(&message)) {
+            // textures can be rendered out of order, so an older one mustn't replace a newer one
+            return {"texture/" + std::to_string(msg->submap_id().trajectory_id()) + "/" +
+                            std::to_string(msg->submap_id().index()) + "/" + msg->map_id(),
+                    msg->version()};
+        }
+        return {};
+    }
+
     template <typename RecipientIdType>
     static auto MakeResponder(whisker::ClientConnection& connection, RecipientIdType&& recipient_id) {
         return [&connection, recipient_id = std::forward<RecipientIdType>(recipient_id)](const auto& message) {
@@ -4,34 +4,65 @@
 #include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <filesystem>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <shared_mutex>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 #include <glog/logging.h>
 #include <json/json.h>
+#include <whisker/client_connection.h>
 #include <whisker/message_log.h>
 #include <whisker/task_queue.h>
+#include <whisker/thread_pool.h>
 #include <client.pb.h>
 #include <console.pb.h>
 #include "cartographer_map.h"
+#include "vehicle_observation_log.h"
 
 class ServerTasks final {
   public:
-    ServerTasks(Json::Value config) : config(std::move(config)) {}
+    ServerTasks(Json::Value config) : config(std::move(config)), publish_thread([this] { PublishMapUpdates(); }) {}
 
-    template <typename RequestObservationFunc>
+    ~ServerTasks() {
+        {
+            std::lock_guard lock(publish_mutex);
+            stop_publishing = true;
+        }
+        publish_cv.notify_one();
+        publish_thread.join();
+
+        // destroy the maps while the rest of this object is intact, since their remaining tasks may call back into it
+        decltype(maps) maps_to_delete;
+        {
+            std::unique_lock lock(data_mutex);
+            for (const auto& [vehicle_id, vehicle] : vehicles) {
+                vehicle->map.reset();
+            }
+            maps_to_delete.swap(maps);
+        }
+    }
+
+    ServerTasks(const ServerTasks&) = delete;
+    ServerTasks& operator=(const ServerTasks&) = delete;
+
+    template <typename RequestObservationFunc, typename GrantObservationCreditsFunc>
     void AddSensorClient(const std::string& sensor_id,
                          const whisker::proto::SensorClientInitMessage& init_message,
-                         RequestObservationFunc&& request_observation_func) {
+                         RequestObservationFunc&& request_observation_func,
+                         GrantObservationCreditsFunc&& grant_observation_credits_func) {
         std::unique_lock lock(data_mutex);
-        const auto sensor =
-                AddSensor(sensor_id, init_message, std::forward<RequestObservationFunc>(request_observation_func));
+        const auto sensor = AddSensor(sensor_id, init_message,
+                                      std::forward<RequestObservationFunc>(request_observation_func),
+                                      std::forward<GrantObservationCreditsFunc>(grant_observation_credits_func));
         if (sensor->vehicle->map) {
             LOG(INFO) << "Resuming observations from sensor '" << sensor_id
                       << "' because its vehicle is assigned to map '" << sensor->vehicle->map->map_id << "'";
@@ -55,16 +86,29 @@ class ServerTasks final {
         const auto it = sensors.find(sensor_id);
         if (it != sensors.end()) {
             const auto& sensor = it->second;
-            sensor->pending_observation = false;
+            if (sensor->data->use_streaming()) {
+                // the sensor spent one of its credits, which is replaced once the map has consumed the observation
+                std::scoped_lock credits_lock(sensor->credits_mutex);
+                if (sensor->num_granted_credits > 0) {
+                    --sensor->num_granted_credits;
+                }
+                if (sensor->vehicle->map) {
+                    ++sensor->num_queued_observations;
+                }
+            } else {
+                sensor->pending_observation = false;
+            }
             if (sensor->vehicle->map) {
                 // generally better to copy the ObservationMessage than to move it from the message handler cache
-                auto observation_ptr = std::make_shared<const whisker::proto::ObservationMessage>(observation);
-                if (sensor->observation_log) {
-                    sensor->observation_log->Write(observation_ptr);
+                if (sensor->vehicle->observation_log) {
+                    sensor->vehicle->observation_log->Write(sensor_id, observation);
                 }
+                auto observation_ptr = std::make_shared<const whisker::proto::ObservationMessage>(observation);
                 sensor->vehicle->map->map_interface.SubmitObservation(std::move(sensor_id), sensor->data,
                                                                       std::move(observation_ptr));
-                RequestObservation(sensor, false);
+                if (!sensor->data->use_streaming()) {
+                    RequestObservation(sensor, false);
+                }
             }
         }
     }
@@ -130,6 +174,33 @@ class ServerTasks final {
         }
     }
 
+    void SubscribeToMap(const std::string& map_id,
+                        whisker::ClientConnection& connection,
+                        const std::string& console_id) {
+        std::shared_lock lock(data_mutex);
+        const auto map = maps.find(map_id);
+        if (map != maps.end()) {
+            map->second->Subscribe(connection, console_id);
+        }
+    }
+
+    void UnsubscribeFromMap(const std::string& map_id,
+                            whisker::ClientConnection& connection,
+                            const std::string& console_id) {
+        std::shared_lock lock(data_mutex);
+        const auto map = maps.find(map_id);
+        if (map != maps.end()) {
+            map->second->Unsubscribe(connection, console_id);
+        }
+    }
+
+    void UnsubscribeFromAllMaps(whisker::ClientConnection& connection, const std::string& console_id) {
+        std::shared_lock lock(data_mutex);
+        for (const auto& [map_id, map] : maps) {
+            map->Unsubscribe(connection, console_id);
+        }
+    }
+
     void InvokeCapability(const whisker::proto::InvokeCapabilityMessage& request) {
         std::shared_lock lock(data_mutex);
         const auto vehicle = vehicles.find(request.vehicle_id());
@@ -219,6 +290,7 @@ class ServerTasks final {
             if (vehicle->map) {
                 vehicle->map->map_interface.RemoveVehicle(vehicle_id);
             }
+            QueueForDeletion(std::move(vehicle->observation_log));
             vehicles.erase(it);
         }
     }
@@ -263,23 +335,35 @@ class ServerTasks final {
     }
 
     void StartObservationLog(const std::string& vehicle_id) {
-        std::string log_file_suffix = "-";
-        log_file_suffix.append(std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(
-                                                      std::chrono::system_clock::now().time_since_epoch())
-                                                      .count()));
-        log_file_suffix.append(observation_log_extension);
+        std::string log_file_name = vehicle_id;
+        log_file_name.append("-");
+        log_file_name.append(std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                                    std::chrono::system_clock::now().time_since_epoch())
+                                                    .count()));
+        log_file_name.append(observation_log_extension);
 
         std::unique_lock lock(data_mutex);
-        const auto vehicle = vehicles.find(vehicle_id);
-        if (vehicle != vehicles.end()) {
-            for (const auto& sensor_weak_ptr : vehicle->second->sensors) {
-                const auto sensor = sensor_weak_ptr.lock();
-                if (!sensor->observation_log) {
-                    const auto log_file_path = GetResourcePath(sensor->sensor_id + log_file_suffix);
-                    if (!log_file_path.empty()) {
-                        sensor->observation_log = whisker::MessageLogWriter::CreateInstance(log_file_path);
-                        sensor->observation_log->Write(sensor->data);
+        const auto it = vehicles.find(vehicle_id);
+        if (it != vehicles.end()) {
+            const auto& vehicle = it->second;
+            if (!vehicle->observation_log) {
+                const auto log_file_path = GetResourcePath(log_file_name);
+                if (!log_file_path.empty()) {
+                    // the log records the sensors that the vehicle has now, along with their properties
+                    whisker::proto::VehicleObservationLogHeader log_header;
+                    log_header.set_vehicle_id(vehicle_id);
+                    for (const auto& sensor_weak_ptr : vehicle->sensors) {
+                        const auto sensor = sensor_weak_ptr.lock();
+                        const auto log_sensor = log_header.add_sensors();
+                        log_sensor->set_sensor_id(sensor->sensor_id);
+                        *log_sensor->mutable_init_message() = *sensor->data;
                     }
+
+                    whisker::MessageLogWriterOptions log_options;
+                    log_options.max_buffered_bytes = observation_log_max_buffered_bytes;
+                    log_options.compression_thread_pool = log_thread_pool;
+                    vehicle->observation_log =
+                            std::make_shared<VehicleObservationLog>(log_file_path, log_header, std::move(log_options));
                 }
             }
         }
@@ -289,9 +373,7 @@ class ServerTasks final {
         std::unique_lock lock(data_mutex);
         const auto vehicle = vehicles.find(vehicle_id);
         if (vehicle != vehicles.end()) {
-            for (const auto& sensor_weak_ptr : vehicle->second->sensors) {
-                QueueForDeletion(std::move(sensor_weak_ptr.lock()->observation_log));
-            }
+            QueueForDeletion(std::move(vehicle->second->observation_log));
         }
     }
 
@@ -301,9 +383,118 @@ class ServerTasks final {
     struct Sensor;
 
     struct Map {
-        Map(const std::string& map_id, const Json::Value& config, bool use_overlapping_trimmer)
-                : map_id(map_id), map_interface(map_id, config, use_overlapping_trimmer) {}
+        Map(const std::string& map_id,
+            const Json::Value& config,
+            bool use_overlapping_trimmer,
+            std::shared_ptr<whisker::ThreadPool> thread_pool,
+            std::shared_ptr<whisker::ThreadPool> texture_thread_pool,
+            std::shared_ptr<SubmapTextureCache> texture_cache,
+            CartographerMap::ObservationConsumedCallback observation_consumed_callback)
+                : map_id(map_id),
+                  map_interface(map_id,
+                                config,
+                                use_overlapping_trimmer,
+                                std::move(thread_pool),
+                                std::move(texture_thread_pool),
+                                std::move(texture_cache),
+                                false,
+                                std::move(observation_consumed_callback)) {}
+
+        void Subscribe(whisker::ClientConnection& connection, const std::string& console_id) {
+            // catch up the new subscriber with the complete map state, after which it shares the published updates
+            const auto send_func = [&connection, console_id](const auto& msg) {
+                connection.SendMessage(msg, console_id);
+            };
+            map_interface.GetMapData(0, send_func);
+            map_interface.GetVehiclePoses(send_func);
+            std::lock_guard lock(subscribers_mutex);
+            if (subscribers.empty()) {
+                // textures are only worth rendering ahead of time while a console may ask for them
+                map_interface.SetSubmapTexturePrerendering(true);
+            }
+            subscribers[&connection].emplace(console_id);
+        }
+
+        void Unsubscribe(whisker::ClientConnection& connection, const std::string& console_id) {
+            std::lock_guard lock(subscribers_mutex);
+            const auto it = subscribers.find(&connection);
+            if (it != subscribers.end()) {
+                it->second.erase(console_id);
+                if (it->second.empty()) {
+                    subscribers.erase(it);
+                    if (subscribers.empty()) {
+                        map_interface.SetSubmapTexturePrerendering(false);
+                    }
+                }
+            }
+        }
+
+        // each update is computed once and sent to every subscriber, so the cost of publishing doesn't depend on the
+        // number of consoles viewing the map
+        void PublishUpdates(bool include_map_data) {
+            {
+                std::lock_guard lock(subscribers_mutex);
+                if (subscribers.empty()) {
+                    return;
+                }
+            }
+
+            // don't pile up more requests if the map's read queue hasn't gotten to the previous ones yet
+            if (num_pending_publishes > 0) {
+                return;
+            }
+            num_pending_publishes += include_map_data ? 2 : 1;
+
+            map_interface.GetVehiclePoses([this](const whisker::proto::VehiclePosesMessage& msg) {
+                auto serialized_msg = msg.SerializeAsString();
+                if (serialized_msg != published_vehicle_poses) {
+                    published_vehicle_poses = std::move(serialized_msg);
+                    SendToSubscribers(msg);
+                }
+                --num_pending_publishes;
+            });
+
+            if (include_map_data) {
+                map_interface.GetMapData(published_map_version, [this](const whisker::proto::MapDataMessage& msg) {
+                    if (msg.is_new_map_version() || HasSubmapChanges(msg)) {
+                        if (msg.is_new_map_version()) {
+                            published_map_version = msg.map_version();
+                        }
+                        published_submaps = msg.submaps();
+                        SendToSubscribers(msg);
+                    }
+                    --num_pending_publishes;
+                });
+            }
+        }
+
+        bool HasSubmapChanges(const whisker::proto::MapDataMessage& msg) const {
+            return !std::equal(msg.submaps().begin(), msg.submaps().end(), published_submaps.begin(),
+                               published_submaps.end(), [](const auto& a, const auto& b) {
+                                   return (a.submap_id().trajectory_id() == b.submap_id().trajectory_id()) &&
+                                          (a.submap_id().index() == b.submap_id().index()) &&
+                                          (a.version() == b.version());
+                               });
+        }
+
+        void SendToSubscribers(const google::protobuf::MessageLite& message) {
+            std::lock_guard lock(subscribers_mutex);
+            for (const auto& [connection, console_ids] : subscribers) {
+                connection->MulticastMessage(message, console_ids);
+            }
+        }
+
         std::string map_id;
+        std::unordered_map<whisker::ClientConnection*, std::unordered_set<std::string>> subscribers;
+        std::mutex subscribers_mutex;
+
+        // last published state, only accessed from the map's read queue (apart from the version)
+        std::atomic_uint published_map_version = 0;
+        google::protobuf::RepeatedPtrField<whisker::proto::MapDataMessage::Submap> published_submaps;
+        std::string published_vehicle_poses;
+        std::atomic_uint num_pending_publishes = 0;
+
+        // declared last so that its queues are drained before the state above is destroyed
         CartographerMap map_interface;
     };
 
@@ -317,21 +508,32 @@ class ServerTasks final {
 
         std::shared_ptr<Map> map;                    // Map that this Vehicle is assigned to (or null)
         std::vector<std::weak_ptr<Sensor>> sensors;  // Sensors that belong to this Vehicle
+        std::shared_ptr<VehicleObservationLog> observation_log;
     };
 
     struct Sensor {
         std::string sensor_id;
         std::shared_ptr<const whisker::proto::SensorClientInitMessage> data;
         std::function<void()> request_observation_func;
-        std::shared_ptr<whisker::MessageLogWriter> observation_log;
-        std::atomic_bool pending_observation = false;
+        std::function<void(unsigned int)> grant_observation_credits_func;
+        std::atomic_bool pending_observation = false;  // only used when the sensor doesn't stream observations
+
+        // only used when the sensor streams observations: the credits held by the sensor plus its observations waiting
+        // to be consumed by the map never exceed 'observation_stream_credits'
+        unsigned int num_granted_credits = 0;
+        unsigned int num_queued_observations = 0;
+        std::mutex credits_mutex;
 
         std::shared_ptr<Vehicle> vehicle;  // Vehicle that this Sensor is on
     };
 
     bool AddMap(const std::string& map_id, bool use_overlapping_trimmer) {
         if (!map_id.empty() && (maps.count(map_id) == 0)) {
-            maps.try_emplace(map_id, std::make_shared<Map>(map_id, config["cartographer"], use_overlapping_trimmer));
+            maps.try_emplace(map_id, std::make_shared<Map>(map_id, config["cartographer"], use_overlapping_trimmer,
+                                                           map_thread_pool, texture_thread_pool, texture_cache,
+                                                           [this](const std::string& sensor_id) {
+                                                               ReplenishObservationCredits(sensor_id);
+                                                           }));
             return true;
         }
         return false;
@@ -345,16 +547,19 @@ class ServerTasks final {
         return it->second;
     }
 
-    template <typename RequestObservationFunc>
+    template <typename RequestObservationFunc, typename GrantObservationCreditsFunc>
     std::shared_ptr<Sensor> AddSensor(const std::string& sensor_id,
                                       const whisker::proto::SensorClientInitMessage& init_message,
-                                      RequestObservationFunc&& request_observation_func) {
+                                      RequestObservationFunc&& request_observation_func,
+                                      GrantObservationCreditsFunc&& grant_observation_credits_func) {
         const auto [it, emplaced] = sensors.try_emplace(sensor_id, std::make_shared<Sensor>());
         if (emplaced) {
             const auto& sensor = it->second;
             sensor->sensor_id = sensor_id;
             sensor->data = std::make_shared<const whisker::proto::SensorClientInitMessage>(init_message);
             sensor->request_observation_func = std::forward<RequestObservationFunc>(request_observation_func);
+            sensor->grant_observation_credits_func =
+                    std::forward<GrantObservationCreditsFunc>(grant_observation_credits_func);
             sensor->vehicle = AddVehicle(init_message.vehicle_id());
             sensor->vehicle->keep_out_radius =
                     std::max(sensor->vehicle->keep_out_radius, init_message.keep_out_radius());
@@ -381,22 +586,105 @@ class ServerTasks final {
         return resource_path.string();
     }
 
+    void PublishMapUpdates() {
+        auto next_publish_time = std::chrono::steady_clock::now();
+        unsigned int num_publishes = 0;
+
+        std::unique_lock publish_lock(publish_mutex);
+        while (true) {
+            // don't try to catch up on missed periods if publishing falls behind
+            next_publish_time = std::max(next_publish_time + vehicle_poses_publish_period,
+                                         std::chrono::steady_clock::now());
+            if (publish_cv.wait_until(publish_lock, next_publish_time, [this] { return stop_publishing; })) {
+                break;
+            }
+
+            const auto include_map_data = (++num_publishes % map_data_publish_interval) == 0;
+            std::shared_lock lock(data_mutex);
+            for (const auto& [map_id, map] : maps) {
+                map->PublishUpdates(include_map_data);
+            }
+        }
+    }
+
+    void ReplenishObservationCredits(const std::string& sensor_id) {
+        std::shared_lock lock(data_mutex);
+        const auto it = sensors.find(sensor_id);
+        if (it != sensors.end()) {
+            const auto& sensor = it->second;
+            if (sensor->data->use_streaming()) {
+                {
+                    std::scoped_lock credits_lock(sensor->credits_mutex);
+                    if (sensor->num_queued_observations > 0) {
+                        --sensor->num_queued_observations;
+                    }
+                }
+                if (sensor->vehicle->map) {
+                    GrantObservationCredits(sensor);
+                }
+            }
+        }
+    }
+
+    // 'force' indicates that the sensor client (re)connected, so any observation requests or credits it had are gone
     static void RequestObservation(const std::shared_ptr<Sensor>& sensor, bool force) {
-        const auto already_pending = sensor->pending_observation.exchange(true);
-        if (!already_pending || force) {
-            sensor->request_observation_func();
+        if (sensor->data->use_streaming()) {
+            if (force) {
+                std::scoped_lock credits_lock(sensor->credits_mutex);
+                sensor->num_granted_credits = 0;
+            }
+            GrantObservationCredits(sensor);
+        } else {
+            const auto already_pending = sensor->pending_observation.exchange(true);
+            if (!already_pending || force) {
+                sensor->request_observation_func();
+            }
+        }
+    }
+
+    // tops up the sensor's credits so that it can have up to 'observation_stream_credits' observations in flight,
+    // counting those that the map hasn't consumed yet (so each consumed observation is replaced by exactly one credit)
+    static void GrantObservationCredits(const std::shared_ptr<Sensor>& sensor) {
+        unsigned int num_new_credits = 0;
+        {
+            std::scoped_lock credits_lock(sensor->credits_mutex);
+            const auto num_in_flight = sensor->num_granted_credits + sensor->num_queued_observations;
+            if (num_in_flight < observation_stream_credits) {
+                num_new_credits = observation_stream_credits - num_in_flight;
+                sensor->num_granted_credits += num_new_credits;
+            }
+        }
+        if (num_new_credits > 0) {
+            sensor->grant_observation_credits_func(num_new_credits);
         }
     }
 
     static constexpr std::string_view saved_map_extension = ".pbstream";
     static constexpr std::string_view observation_log_extension = ".obslog";
+    static constexpr std::size_t observation_log_max_buffered_bytes = 64 * 1024 * 1024;  // per vehicle
+    static constexpr std::chrono::milliseconds vehicle_poses_publish_period{50};
+    static constexpr unsigned int map_data_publish_interval = 4;  // map data is published every 4th vehicle pose period
+    // enough for a 40 Hz lidar to stream over a link with a 200 ms round trip without waiting for credits
+    static constexpr unsigned int observation_stream_credits = 8;
 
     std::unordered_map<std::string, std::shared_ptr<Map>> maps;
     std::unordered_map<std::string, std::shared_ptr<Vehicle>> vehicles;
     std::unordered_map<std::string, std::shared_ptr<Sensor>> sensors;
     std::shared_mutex data_mutex;
     const Json::Value config;
+    const std::shared_ptr<whisker::ThreadPool> map_thread_pool = std::make_shared<whisker::ThreadPool>();
+    const std::shared_ptr<whisker::ThreadPool> log_thread_pool = std::make_shared<whisker::ThreadPool>();
+    // half of the processors at most, so that consoles requesting many submap textures can't stall SLAM
+    const std::shared_ptr<whisker::ThreadPool> texture_thread_pool =
+            std::make_shared<whisker::ThreadPool>(std::max(1u, std::thread::hardware_concurrency() / 2));
+    // shared by all maps so that the number of maps doesn't multiply the memory used by submap textures
+    const std::shared_ptr<SubmapTextureCache> texture_cache =
+            std::make_shared<SubmapTextureCache>(config["submap_texture_cache_bytes"].asUInt64());
     whisker::TaskQueue low_priority_task_queue;
+    std::mutex publish_mutex;
+    std::condition_variable publish_cv;
+    bool stop_publishing = false;
+    std::thread publish_thread;  // declared last so that it starts after everything it accesses is initialized
 };
 
 #endif  // WHISKER_SERVER_TASKS_H
@@ -0,0 +1,48 @@
+#include "submap_texture.h"
+#include <array>
+#include <cstddef>
+#include <vector>
+#include <cartographer/mapping/probability_values.h>
+#include <cartographer/mapping/submaps.h>
+
+namespace {
+
+// Grid2D doesn't expose its raw cells publicly, but a pointer to the protected accessor can be formed through a
+// derived class and then applied to any grid
+struct GridCellsAccess : cartographer::mapping::Grid2D {
+    static const std::vector<std::uint16_t>& Get(const cartographer::mapping::Grid2D& grid) {
+        return (grid.*(&GridCellsAccess::correspondence_cost_cells))();
+    }
+};
+
+// maps a probability grid's raw cell values (with the update marker bit masked off) to the log odds bytes of the
+// submap texture, without any per-cell float math; unknown cells map to 0
+const std::array<std::uint8_t, cartographer::mapping::kUpdateMarker>& GetCellValueToTextureTable() {
+    static const auto table = [] {
+        std::array<std::uint8_t, cartographer::mapping::kUpdateMarker> table{};
+        for (std::size_t value = 1; value < table.size(); ++value) {
+            table[value] = cartographer::mapping::ProbabilityToLogOddsInteger(
+                    1 - cartographer::mapping::ValueToCorrespondenceCost(value));
+        }
+        return table;
+    }();
+    return table;
+}
+
+}  // namespace
+
+void RasterizeSubmapTexture(const cartographer::mapping::Grid2D& grid,
+                            const Eigen::Array2i& offset,
+                            const cartographer::mapping::CellLimits& limits,
+                            std::uint8_t* pixels) {
+    // the grid's cells are stored row by row (y major), which is also the texture's layout
+    const auto& cells = GridCellsAccess::Get(grid);
+    const auto& cell_value_to_texture = GetCellValueToTextureTable();
+    const auto grid_width = grid.limits().cell_limits().num_x_cells;
+    for (int y = 0; y < limits.num_y_cells; ++y) {
+        const auto row = cells.data() + ((offset.y() + y) * grid_width) + offset.x();
+        for (int x = 0; x < limits.num_x_cells; ++x) {
+            *(pixels++) = cell_value_to_texture[row[x] & (cartographer::mapping::kUpdateMarker - 1)];
+        }
+    }
+}
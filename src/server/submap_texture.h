@@ -0,0 +1,18 @@
+#ifndef WHISKER_SUBMAP_TEXTURE_H
+#define WHISKER_SUBMAP_TEXTURE_H
+
+#include <cstdint>
+#include <cartographer/mapping/2d/grid_2d.h>
+#include <cartographer/mapping/2d/map_limits.h>
+#include <Eigen/Core>
+
+// Writes the submap texture pixels of the grid's cells within 'limits' starting at 'offset' to 'pixels', one byte
+// per cell and row by row.  Each known cell's pixel is the log odds of it being occupied (as produced by Cartographer's
+// ProbabilityToLogOddsInteger()), and unknown cells are 0.
+
+void RasterizeSubmapTexture(const cartographer::mapping::Grid2D& grid,
+                            const Eigen::Array2i& offset,
+                            const cartographer::mapping::CellLimits& limits,
+                            std::uint8_t* pixels);
+
+#endif  // WHISKER_SUBMAP_TEXTURE_H
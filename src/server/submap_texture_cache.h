@@ -0,0 +1,140 @@
+#ifndef WHISKER_SUBMAP_TEXTURE_CACHE_H
+#define WHISKER_SUBMAP_TEXTURE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <cartographer/mapping/id.h>
+#include <console.pb.h>
+
+// Keeps the most recently used submap textures of all maps within a total memory budget.
+//
+// Each map gets a partition of the cache from AddMap(), which is also used to track how much of the budget the map is
+// using.  When the budget is exceeded, the least recently used textures are evicted regardless of which map they
+// belong to, and have to be rendered again the next time they're requested.
+
+class SubmapTextureCache final {
+  public:
+    using MapHandle = std::uint64_t;
+
+    struct MapStats {
+        std::size_t num_textures = 0;
+        std::size_t num_bytes = 0;
+    };
+
+    // max_bytes = 0 means no limit
+    explicit SubmapTextureCache(std::size_t max_bytes) : max_bytes(max_bytes) {}
+
+    SubmapTextureCache(const SubmapTextureCache&) = delete;
+    SubmapTextureCache& operator=(const SubmapTextureCache&) = delete;
+
+    MapHandle AddMap() {
+        std::scoped_lock lock(cache_mutex);
+        map_stats.try_emplace(next_map_handle);
+        return next_map_handle++;
+    }
+
+    void RemoveMap(MapHandle map) {
+        std::scoped_lock lock(cache_mutex);
+        for (auto entry = lru_entries.begin(); entry != lru_entries.end();) {
+            entry = (entry->key.first == map) ? EraseEntry(entry) : std::next(entry);
+        }
+        map_stats.erase(map);
+    }
+
+    // returns null if the submap's texture isn't cached
+    std::shared_ptr<const whisker::proto::SubmapTextureMessage> Get(MapHandle map,
+                                                                    const cartographer::mapping::SubmapId& submap_id) {
+        std::scoped_lock lock(cache_mutex);
+        const auto entry = entries.find({map, submap_id});
+        if (entry == entries.end()) {
+            return nullptr;
+        }
+        lru_entries.splice(lru_entries.begin(), lru_entries, entry->second);
+        return entry->second->texture_msg;
+    }
+
+    // a cached texture is only replaced by one of a newer version of the submap
+    void Put(MapHandle map,
+             const cartographer::mapping::SubmapId& submap_id,
+             std::shared_ptr<const whisker::proto::SubmapTextureMessage> texture_msg) {
+        std::scoped_lock lock(cache_mutex);
+        const auto [entry, emplaced] = entries.try_emplace({map, submap_id});
+        if (!emplaced) {
+            if (entry->second->texture_msg->version() >= texture_msg->version()) {
+                return;
+            }
+            auto& stats = map_stats[map];
+            stats.num_bytes -= entry->second->num_bytes;
+            --stats.num_textures;
+            total_bytes -= entry->second->num_bytes;
+            lru_entries.erase(entry->second);
+        }
+
+        // the PNG data accounts for nearly all of a texture's memory
+        const auto num_bytes = sizeof(whisker::proto::SubmapTextureMessage) + texture_msg->texture().capacity();
+        entry->second = lru_entries.insert(lru_entries.begin(), Entry{entry->first, std::move(texture_msg), num_bytes});
+        auto& stats = map_stats[map];
+        stats.num_bytes += num_bytes;
+        ++stats.num_textures;
+        total_bytes += num_bytes;
+
+        while ((max_bytes > 0) && (total_bytes > max_bytes)) {
+            EraseEntry(std::prev(lru_entries.end()));
+        }
+    }
+
+    void Erase(MapHandle map, const cartographer::mapping::SubmapId& submap_id) {
+        std::scoped_lock lock(cache_mutex);
+        const auto entry = entries.find({map, submap_id});
+        if (entry != entries.end()) {
+            EraseEntry(entry->second);
+        }
+    }
+
+    MapStats GetMapStats(MapHandle map) {
+        std::scoped_lock lock(cache_mutex);
+        const auto stats = map_stats.find(map);
+        return (stats != map_stats.end()) ? stats->second : MapStats{};
+    }
+
+  private:
+    using Key = std::pair<MapHandle, cartographer::mapping::SubmapId>;
+
+    struct KeyHash {
+        std::size_t operator()(const Key& key) const {
+            return std::hash<MapHandle>{}(key.first) ^ (std::hash<cartographer::mapping::SubmapId>{}(key.second) << 1);
+        }
+    };
+
+    struct Entry {
+        Key key;
+        std::shared_ptr<const whisker::proto::SubmapTextureMessage> texture_msg;
+        std::size_t num_bytes;
+    };
+
+    std::list<Entry>::iterator EraseEntry(std::list<Entry>::iterator entry) {
+        auto& stats = map_stats[entry->key.first];
+        stats.num_bytes -= entry->num_bytes;
+        --stats.num_textures;
+        total_bytes -= entry->num_bytes;
+        entries.erase(entry->key);
+        return lru_entries.erase(entry);
+    }
+
+    const std::size_t max_bytes;
+    std::list<Entry> lru_entries;  // most recently used first
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> entries;
+    std::unordered_map<MapHandle, MapStats> map_stats;
+    std::size_t total_bytes = 0;
+    MapHandle next_map_handle = 0;
+    std::mutex cache_mutex;
+};
+
+#endif  // WHISKER_SUBMAP_TEXTURE_CACHE_H
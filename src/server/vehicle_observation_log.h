@@ -0,0 +1,102 @@
+#ifndef WHISKER_VEHICLE_OBSERVATION_LOG_H
+#define WHISKER_VEHICLE_OBSERVATION_LOG_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <glog/logging.h>
+#include <whisker/message_log.h>
+#include <client.pb.h>
+
+// Records the observations from all of a vehicle's sensors to a single log file.
+//
+// The log starts with a VehicleObservationLogHeader listing the sensors, followed by their observations interleaved
+// in timestamp order.  Since observations from different sensors don't arrive in exactly the order that they were
+// acquired, they're held back for 'reorder_window' before being written.  An observation that arrives later than
+// that is still written, just out of order.
+
+class VehicleObservationLog final {
+  public:
+    VehicleObservationLog(const std::string& log_file_path,
+                          const whisker::proto::VehicleObservationLogHeader& header,
+                          whisker::MessageLogWriterOptions options)
+            : vehicle_id(header.vehicle_id()),
+              log_writer(whisker::MessageLogWriter::CreateInstance(
+                      log_file_path, whisker::vehicle_observation_log_header, std::move(options))) {
+        for (int i = 0; i < header.sensors_size(); ++i) {
+            sensor_indices.try_emplace(header.sensors(i).sensor_id(), i);
+        }
+        log_writer->Write(std::make_shared<whisker::proto::VehicleObservationLogHeader>(header));
+    }
+
+    ~VehicleObservationLog() {
+        // nothing is waiting on the remaining observations, so there's no need to drop any of them
+        std::scoped_lock lock(pending_mutex);
+        for (; !pending_entries.empty(); pending_entries.pop()) {
+            log_writer->Write(pending_entries.top().entry, pending_entries.top().timestamp);
+        }
+    }
+
+    VehicleObservationLog(const VehicleObservationLog&) = delete;
+    VehicleObservationLog& operator=(const VehicleObservationLog&) = delete;
+
+    // observations from sensors that weren't in the header are ignored
+    void Write(const std::string& sensor_id, const whisker::proto::ObservationMessage& observation) {
+        const auto sensor_index = sensor_indices.find(sensor_id);
+        if (sensor_index == sensor_indices.end()) {
+            return;
+        }
+
+        auto entry = std::make_shared<whisker::proto::VehicleObservationLogEntry>();
+        entry->set_sensor_index(sensor_index->second);
+        *entry->mutable_observation() = observation;
+
+        std::scoped_lock lock(pending_mutex);
+        latest_timestamp = std::max(latest_timestamp, observation.timestamp());
+        pending_entries.push({observation.timestamp(), next_sequence_number++, std::move(entry)});
+        while (pending_entries.top().timestamp + reorder_window.count() <= latest_timestamp) {
+            WriteOldestEntry();
+        }
+    }
+
+  private:
+    struct PendingEntry {
+        std::uint64_t timestamp;
+        std::uint64_t sequence_number;  // keeps observations with the same timestamp in arrival order
+        std::shared_ptr<const whisker::proto::VehicleObservationLogEntry> entry;
+
+        // orders 'pending_entries' with the oldest at the top
+        bool operator<(const PendingEntry& other) const {
+            return std::tie(timestamp, sequence_number) > std::tie(other.timestamp, other.sequence_number);
+        }
+    };
+
+    void WriteOldestEntry() {
+        const auto& oldest = pending_entries.top();
+        if (!log_writer->TryWrite(oldest.entry, oldest.timestamp)) {
+            // don't hold up observation handling if the disk can't keep up
+            LOG_EVERY_N(WARNING, 100) << "Observation log for vehicle '" << vehicle_id
+                                      << "' is falling behind, dropping observations";
+        }
+        pending_entries.pop();
+    }
+
+    static constexpr std::chrono::milliseconds reorder_window{500};
+
+    const std::string vehicle_id;
+    const std::shared_ptr<whisker::MessageLogWriter> log_writer;
+    std::unordered_map<std::string, unsigned int> sensor_indices;  // sensor ID -> index in the header's sensor table
+    std::priority_queue<PendingEntry> pending_entries;
+    std::uint64_t latest_timestamp = 0;
+    std::uint64_t next_sequence_number = 0;
+    std::mutex pending_mutex;
+};
+
+#endif  // WHISKER_VEHICLE_OBSERVATION_LOG_H
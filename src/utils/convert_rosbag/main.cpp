@@ -1,8 +1,15 @@
+#include <algorithm>
 #include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <sstream>
 #include <string>
-#include <thread>
 #include <utility>
+#include <vector>
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <rosbag/bag.h>
@@ -13,11 +20,19 @@
 #include <sensor_msgs/MultiEchoLaserScan.h>
 #include <whisker/init.h>
 #include <whisker/message_log.h>
+#include <whisker/thread_pool.h>
 #include <client.pb.h>
 
 DEFINE_string(in_bag, "input.bag", "Input ROS bag file");
-DEFINE_string(topic, "horizontal_lidar", "ROS topic (of Imu/LaserScan/MultiEchoLaserScan type) to convert");
-DEFINE_string(out_log, "output.obslog", "Output Whisker observation log file");
+DEFINE_string(topics, "horizontal_lidar",
+              "Comma-separated list of ROS topics (of Imu/LaserScan/MultiEchoLaserScan type) to convert");
+DEFINE_string(out_logs, "",
+              "Comma-separated list of output Whisker observation log files, one per topic (default: topic name with "
+              "'.obslog' extension in current directory)");
+DEFINE_uint32(threads, 0, "Number of threads on which to convert messages (0 = use the system's processor count)");
+
+// bags are read much faster than they can be converted, so limit how far reading can get ahead of conversion
+constexpr unsigned int max_pending_messages = 4096;
 
 void PopulateSensorProperties(const sensor_msgs::Imu& sensor_msg, whisker::proto::SensorClientInitMessage& proto_msg) {
     // no conversion required besides setting an empty IMU properties object in 'proto_msg'
@@ -80,70 +95,251 @@ void PopulateObservation(const sensor_msgs::MultiEchoLaserScan& sensor_msg,
     }
 }
 
-template <typename SensorMsgType>
-void ProcessBag(const rosbag::Bag& bag) {
-    rosbag::View input_view(bag, rosbag::TopicQuery{FLAGS_topic});
-    const auto output_log = whisker::MessageLogWriter::CreateInstance(FLAGS_out_log);
-    unsigned int num_processed = 0;
+class PendingMessageLimit final {
+  public:
+    // blocks while the limit is reached
+    void Add() {
+        std::unique_lock lock(pending_mutex);
+        pending_cv.wait(lock, [this] { return num_pending < max_pending_messages; });
+        ++num_pending;
+    }
 
-    for (const auto& input_message : input_view) {
+    void Remove() {
+        {
+            std::scoped_lock lock(pending_mutex);
+            --num_pending;
+        }
+        pending_cv.notify_one();
+    }
+
+  private:
+    unsigned int num_pending = 0;
+    std::mutex pending_mutex;
+    std::condition_variable pending_cv;
+};
+
+// Converts the messages of one topic and writes them to its observation log.
+//
+// Messages are deserialized on the thread reading the bag, since that reads from the bag file.  Converting them to
+// observations happens on the conversion thread pool, one task per message, so that the messages of a single topic
+// are converted in parallel with each other as well as with other topics' and with reading the bag.  Converted
+// observations are then written to the log in the order the messages were read, regardless of the order in which
+// they finish converting.
+
+class TopicConverter final {
+  public:
+    TopicConverter(const std::string& topic, const std::string& message_type, const std::string& out_log_path,
+                   const std::shared_ptr<whisker::ThreadPool>& conversion_thread_pool,
+                   const std::shared_ptr<whisker::ThreadPool>& compression_thread_pool,
+                   PendingMessageLimit& pending_limit)
+        : topic(topic), pending_limit(pending_limit), conversion_thread_pool(conversion_thread_pool) {
+        if (message_type == "sensor_msgs/Imu") {
+            convert = &TopicConverter::Convert<sensor_msgs::Imu>;
+        } else if (message_type == "sensor_msgs/LaserScan") {
+            convert = &TopicConverter::Convert<sensor_msgs::LaserScan>;
+        } else if (message_type == "sensor_msgs/MultiEchoLaserScan") {
+            convert = &TopicConverter::Convert<sensor_msgs::MultiEchoLaserScan>;
+        } else {
+            LOG(FATAL) << "Unsupported message type '" << message_type << "' in topic '" << topic << "'";
+        }
+
+        // the writers get their own pool because Write() blocks a conversion thread until blocks have been compressed
+        whisker::MessageLogWriterOptions options;
+        options.compression_thread_pool = compression_thread_pool;
+        output_log = whisker::MessageLogWriter::CreateInstance(out_log_path, whisker::message_log_default_header,
+                                                               std::move(options));
+    }
+
+    TopicConverter(const TopicConverter&) = delete;
+    TopicConverter& operator=(const TopicConverter&) = delete;
+
+    void AddMessage(const rosbag::MessageInstance& input_message) {
+        (this->*convert)(input_message);
+    }
+
+    // waits for all added messages to be converted and written
+    void Finish() {
+        {
+            std::unique_lock lock(pending_observations_mutex);
+            pending_observations_cv.wait(lock, [this] { return pending_observations.empty() && !is_writing; });
+        }
+        output_log.reset();
+
+        LOG(INFO) << "- " << topic << ": " << num_converted << " messages (" << num_bytes / 1'000'000.0 << " MB)";
+    }
+
+    std::size_t GetNumBytes() const { return num_bytes; }
+
+  private:
+    struct PendingObservation {
+        std::shared_ptr<whisker::proto::SensorClientInitMessage> init_message;  // only set for the topic's first
+        std::shared_ptr<whisker::proto::ObservationMessage> observation_message;
+        bool is_converted = false;  // guarded by 'pending_observations_mutex'
+    };
+
+    template <typename SensorMsgType>
+    void Convert(const rosbag::MessageInstance& input_message) {
         const auto msg = input_message.instantiate<SensorMsgType>();
-        CHECK(msg) << "Error instantiating sensor message";
+        CHECK(msg) << "Error instantiating sensor message in topic '" << topic << "'";
+
+        pending_limit.Add();
+        auto pending_observation = std::make_shared<PendingObservation>();
+        {
+            std::scoped_lock lock(pending_observations_mutex);
+            pending_observations.push_back(pending_observation);
+        }
 
         // the first message in the observation log is always the SensorClientInitMessage describing the sensor
-        if (num_processed == 0) {
+        if (!is_init_message_added) {
+            is_init_message_added = true;
             auto init_message = std::make_shared<whisker::proto::SensorClientInitMessage>();
             PopulateSensorProperties(*msg, *init_message);
-            init_message->set_keep_out_radius(0.5);  // this data's not in the bag so just assign a sane arbitrary value
-            output_log->Write(std::move(init_message));
+            init_message->set_keep_out_radius(0.5);  // this data's not in the bag so just assign a sane value
+            pending_observation->init_message = std::move(init_message);
         }
 
-        auto observation_message = std::make_shared<whisker::proto::ObservationMessage>();
-        observation_message->set_timestamp(msg->header.stamp.toNSec() / 1'000'000);
-        PopulateObservation(*msg, *observation_message);
-        output_log->Write(std::move(observation_message));
+        conversion_thread_pool->Schedule([this, msg, pending_observation = std::move(pending_observation)] {
+            auto observation_message = std::make_shared<whisker::proto::ObservationMessage>();
+            observation_message->set_timestamp(msg->header.stamp.toNSec() / 1'000'000);
+            PopulateObservation(*msg, *observation_message);
+            pending_observation->observation_message = std::move(observation_message);
 
-        ++num_processed;
-        LOG_EVERY_T(INFO, 5) << "Converted " << 100.0 * num_processed / input_view.size() << "%";
+            // the observation has to be marked and written in one critical section, since another thread that's
+            // writing could otherwise write it and let Finish() return before this task is done with the converter
+            std::unique_lock lock(pending_observations_mutex);
+            pending_observation->is_converted = true;
+            WriteConvertedObservations(lock);
+        });
+    }
+
+    // writes out the converted observations at the front of 'pending_observations' so that they reach the log in the
+    // order their messages were read ('lock' holds 'pending_observations_mutex')
+    void WriteConvertedObservations(std::unique_lock<std::mutex>& lock) {
+        if (is_writing) {
+            return;  // the thread that's writing will pick up any newly converted observations
+        }
+        is_writing = true;
+
+        while (!pending_observations.empty() && pending_observations.front()->is_converted) {
+            const auto pending_observation = std::move(pending_observations.front());
+            pending_observations.pop_front();
+            lock.unlock();
+
+            if (pending_observation->init_message) {
+                output_log->Write(std::move(pending_observation->init_message));
+            }
+            auto& observation_message = pending_observation->observation_message;
+            const auto timestamp = observation_message->timestamp();
+            num_bytes += observation_message->ByteSizeLong();
+            // blocks whenever the writer's buffer is full, so conversion proceeds as fast as the log can be written
+            output_log->Write(std::move(observation_message), timestamp);
 
-        if (output_log->GetNumPendingWrites() > 500) {
-            LOG(INFO) << "Pausing to allow MessageLogWriter queue to drain";
-            std::this_thread::sleep_for(std::chrono::seconds(2));
+            ++num_converted;
+            pending_limit.Remove();
+
+            lock.lock();
         }
+
+        is_writing = false;
+        pending_observations_cv.notify_all();
     }
 
-    LOG(INFO) << "Converted " << num_processed << " messages";
-}
+    const std::string topic;
+    PendingMessageLimit& pending_limit;
+    const std::shared_ptr<whisker::ThreadPool> conversion_thread_pool;
+    void (TopicConverter::*convert)(const rosbag::MessageInstance&) = nullptr;
+    std::shared_ptr<whisker::MessageLogWriter> output_log;
+    bool is_init_message_added = false;  // only accessed on the thread reading the bag
+
+    // only written by the thread that's writing ('is_writing') until Finish()
+    unsigned int num_converted = 0;
+    std::size_t num_bytes = 0;
+
+    std::deque<std::shared_ptr<PendingObservation>> pending_observations;  // in the order they were read
+    bool is_writing = false;
+    std::mutex pending_observations_mutex;
+    std::condition_variable pending_observations_cv;
+};
 
 int main(int argc, char* argv[]) {
     whisker::Init::InitLogging(&argc, &argv);
 
-    LOG(INFO) << "Converting sensor messages from topic '" << FLAGS_topic << "' in ROS bag file '" << FLAGS_in_bag
-              << "' to Whisker observation log file '" << FLAGS_out_log << "'";
+    std::map<std::string, std::string> out_log_paths;  // topic -> output log path
+    {
+        std::istringstream topics{FLAGS_topics};
+        std::istringstream out_logs{FLAGS_out_logs};
+        std::string topic;
+        std::string out_log;
+        while (std::getline(topics, topic, ',')) {
+            CHECK(!topic.empty()) << "Empty topic given";
+            if (!std::getline(out_logs, out_log, ',')) {
+                // turn e.g. '/robot/imu' into 'robot_imu.obslog'
+                const auto name_start = topic.find_first_not_of('/');
+                CHECK(name_start != std::string::npos)
+                        << "Topic '" << topic << "' has no name to derive an output log path from";
+                out_log = topic.substr(name_start);
+                std::replace(out_log.begin(), out_log.end(), '/', '_');
+                out_log += ".obslog";
+            }
+            CHECK(out_log_paths.emplace(topic, out_log).second) << "Topic '" << topic << "' given more than once";
+        }
+        CHECK(!std::getline(out_logs, out_log, ',')) << "More output logs than topics were given";
+    }
+    CHECK(!out_log_paths.empty()) << "No topics given";
 
     const rosbag::Bag input_bag(FLAGS_in_bag);
-    std::string message_type;
+    std::map<std::string, std::string> message_types;  // topic -> ROS message type
 
     LOG(INFO) << "ROS bag contains the following topics (types):";
     for (const auto connection : rosbag::View{input_bag}.getConnections()) {
         LOG(INFO) << "- " << connection->topic << " (" << connection->datatype << ")";
-        if (connection->topic == FLAGS_topic) {
+        if (out_log_paths.count(connection->topic)) {
             LOG(INFO) << "  ^ selected";
-            message_type = connection->datatype;
+            message_types[connection->topic] = connection->datatype;
         }
     }
 
-    if (message_type == "sensor_msgs/Imu") {
-        ProcessBag<sensor_msgs::Imu>(input_bag);
-    } else if (message_type == "sensor_msgs/LaserScan") {
-        ProcessBag<sensor_msgs::LaserScan>(input_bag);
-    } else if (message_type == "sensor_msgs/MultiEchoLaserScan") {
-        ProcessBag<sensor_msgs::MultiEchoLaserScan>(input_bag);
-    } else if (message_type.empty()) {
-        LOG(FATAL) << "Topic '" << FLAGS_topic << "' not found in bag";
-    } else {
-        LOG(FATAL) << "Unsupported message type '" << message_type << "' in given topic";
+    const auto conversion_thread_pool = std::make_shared<whisker::ThreadPool>(FLAGS_threads);
+    const auto compression_thread_pool = std::make_shared<whisker::ThreadPool>(FLAGS_threads);
+    PendingMessageLimit pending_limit;
+    std::map<std::string, std::unique_ptr<TopicConverter>> converters;  // topic -> converter
+
+    std::vector<std::string> topics;
+    for (const auto& [topic, out_log_path] : out_log_paths) {
+        const auto message_type = message_types.find(topic);
+        CHECK(message_type != message_types.end()) << "Topic '" << topic << "' not found in bag";
+
+        LOG(INFO) << "Converting sensor messages from topic '" << topic << "' in ROS bag file '" << FLAGS_in_bag
+                  << "' to Whisker observation log file '" << out_log_path << "'";
+        converters.emplace(topic, std::make_unique<TopicConverter>(topic, message_type->second, out_log_path,
+                                                                   conversion_thread_pool, compression_thread_pool,
+                                                                   pending_limit));
+        topics.push_back(topic);
+    }
+
+    const auto start_time = std::chrono::steady_clock::now();
+
+    // a single pass over the bag feeds all of the topics' converters
+    rosbag::View input_view(input_bag, rosbag::TopicQuery{topics});
+    unsigned int num_read = 0;
+    for (const auto& input_message : input_view) {
+        converters.at(input_message.getTopic())->AddMessage(input_message);
+
+        ++num_read;
+        LOG_EVERY_T(INFO, 5) << "Read " << 100.0 * num_read / input_view.size() << "%";
     }
 
+    LOG(INFO) << "Read " << num_read << " messages, finishing conversion of:";
+    std::size_t num_bytes = 0;
+    for (const auto& [topic, converter] : converters) {
+        converter->Finish();
+        num_bytes += converter->GetNumBytes();
+    }
+
+    const auto elapsed_seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    LOG(INFO) << "Conversion took " << elapsed_seconds << " s (" << num_bytes / elapsed_seconds / 1'000'000
+              << " MB/s)";
+
     return 0;
 }
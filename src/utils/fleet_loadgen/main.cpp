@@ -0,0 +1,458 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <whisker/init.h>
+#include <whisker/message_log.h>
+#include <whisker/server_connection.h>
+#include <whisker/zmq_connection.h>
+#include <client.pb.h>
+#include <console.pb.h>
+
+DEFINE_string(logs, "input.obslog", "Comma-separated list of observation log files that each vehicle plays back");
+DEFINE_uint32(vehicles, 1, "Number of virtual vehicles to simulate");
+DEFINE_string(server_address, "tcp://localhost:9000", "Address of the server's ZeroMQ client service");
+DEFINE_string(console_address, "tcp://localhost:9003",
+              "Address of the server's ZeroMQ console service, used to assign vehicles to maps (empty = don't assign)");
+DEFINE_uint32(vehicles_per_map, 1, "Number of vehicles to assign to each map that is created");
+DEFINE_uint64(stagger, 5000, "Milliseconds of log time between the starting points of consecutive vehicles");
+DEFINE_double(rate, 1, "Speed of playback relative to the rate at which observations were recorded");
+DEFINE_uint32(report_interval, 10, "Seconds between reports of each vehicle's observation rate and latency");
+
+// All of the logs' observations, merged into one timeline that each vehicle plays back from its own starting point.
+// Observations are kept in memory so that reading the logs doesn't affect the measurements.
+struct Timeline {
+    struct Entry {
+        std::uint64_t timestamp;
+        std::size_t sensor_index;
+        std::shared_ptr<const whisker::proto::ObservationMessage> observation;
+    };
+
+    std::vector<whisker::proto::SensorClientInitMessage> sensors;
+    std::vector<Entry> entries;
+    std::uint64_t duration = 0;  // time from the first entry until the timeline repeats, in milliseconds
+};
+
+Timeline LoadTimeline(const std::string& log_file_names) {
+    Timeline timeline;
+    std::istringstream log_file_name_stream{log_file_names};
+    std::string log_file_name;
+
+    while (std::getline(log_file_name_stream, log_file_name, ',')) {
+        const auto sensor_index_offset = timeline.sensors.size();
+        const auto is_vehicle_log =
+                whisker::MessageLogReader::ReadMagicHeader(log_file_name) == whisker::vehicle_observation_log_header;
+        const auto log_reader = whisker::MessageLogReader::CreateInstance(
+                log_file_name,
+                is_vehicle_log ? whisker::vehicle_observation_log_header : whisker::message_log_default_header);
+
+        if (is_vehicle_log) {
+            whisker::proto::VehicleObservationLogHeader log_header;
+            CHECK(log_reader->Read(log_header)) << "Error reading VehicleObservationLogHeader from observation log";
+            for (const auto& log_sensor : log_header.sensors()) {
+                timeline.sensors.push_back(log_sensor.init_message());
+            }
+
+            whisker::proto::VehicleObservationLogEntry log_entry;
+            while (log_reader->Read(log_entry)) {
+                CHECK_LT(log_entry.sensor_index(), static_cast<std::uint32_t>(log_header.sensors_size()))
+                        << "Observation from unknown sensor in observation log";
+                const auto observation = std::make_shared<whisker::proto::ObservationMessage>();
+                observation->Swap(log_entry.mutable_observation());
+                timeline.entries.push_back(
+                        {observation->timestamp(), sensor_index_offset + log_entry.sensor_index(), observation});
+            }
+        } else {
+            CHECK(log_reader->Read(timeline.sensors.emplace_back()))
+                    << "Error reading SensorClientInitMessage from observation log";
+
+            auto observation = std::make_shared<whisker::proto::ObservationMessage>();
+            while (log_reader->Read(*observation)) {
+                timeline.entries.push_back({observation->timestamp(), sensor_index_offset, observation});
+                observation = std::make_shared<whisker::proto::ObservationMessage>();
+            }
+        }
+    }
+
+    CHECK(!timeline.entries.empty()) << "No observation messages in logs";
+
+    std::stable_sort(timeline.entries.begin(), timeline.entries.end(),
+                     [](const auto& a, const auto& b) { return a.timestamp < b.timestamp; });
+    // leave a gap between repetitions so that the time between the last and first observations isn't zero
+    timeline.duration = timeline.entries.back().timestamp - timeline.entries.front().timestamp + 1000;
+
+    LOG(INFO) << "Loaded " << timeline.entries.size() << " observations from " << timeline.sensors.size()
+              << " sensors, " << timeline.duration / 1000.0 << " s per repetition";
+    return timeline;
+}
+
+// Plays back the timeline as a number of virtual vehicles.
+//
+// Each vehicle starts playing back once the server first grants it credits, which happens when it's assigned to a
+// map.  A single thread sends every vehicle's observations, taking them from a queue ordered by when they're due.  A
+// vehicle that is due to send an observation from a sensor that has run out of credits is set aside until the server
+// grants that sensor more credits.  The time between sending an observation and receiving the credit that replaces
+// it (i.e. until the server's map has consumed the observation) is recorded as the server's response latency.
+
+class LoadGenerator final {
+  public:
+    explicit LoadGenerator(Timeline&& timeline) : timeline(std::move(timeline)) {
+        std::vector<std::pair<std::string, whisker::ServerEventHandlers>> sensor_clients;
+        for (unsigned int i = 0; i < FLAGS_vehicles; ++i) {
+            auto& vehicle = *vehicles.emplace_back(std::make_unique<Vehicle>());
+            vehicle.vehicle_id = "loadgen" + std::to_string(i);
+
+            // start each vehicle from a different point in the timeline so that they don't all send the same
+            // observations at the same time
+            const auto start_timestamp =
+                    this->timeline.entries.front().timestamp + (i * FLAGS_stagger) % this->timeline.duration;
+            vehicle.next_entry = std::lower_bound(this->timeline.entries.begin(), this->timeline.entries.end(),
+                                                  start_timestamp,
+                                                  [](const auto& entry, auto timestamp) {
+                                                      return entry.timestamp < timestamp;
+                                                  }) -
+                                 this->timeline.entries.begin();
+            if (vehicle.next_entry == this->timeline.entries.size()) {
+                // the starting point is in the gap between repetitions
+                vehicle.next_entry = 0;
+                vehicle.num_repetitions = 1;
+            }
+            vehicle.playback_start_timestamp = start_timestamp;
+
+            for (std::size_t sensor_index = 0; sensor_index < this->timeline.sensors.size(); ++sensor_index) {
+                sensor_clients.push_back(AddSensor(vehicle, sensor_index));
+            }
+        }
+
+        // every virtual sensor needs its own connection to be a separate client of the server, but they all share one
+        // thread that handles their messages, so the number of threads doesn't grow with the number of vehicles
+        auto server_connections =
+                whisker::ZmqConnection::CreateServerConnections(FLAGS_server_address, std::move(sensor_clients));
+        auto server_connection = server_connections.begin();
+        for (const auto& vehicle : vehicles) {
+            for (const auto& sensor : vehicle->sensors) {
+                sensor->server_connection = std::move(*(server_connection++));
+                sensor->server_connection->SendMessage(sensor->init_msg);
+            }
+        }
+
+        sender_thread = std::thread{&LoadGenerator::SendObservations, this};
+        report_thread = std::thread{&LoadGenerator::ReportPeriodically, this};
+    }
+
+    ~LoadGenerator() {
+        {
+            std::scoped_lock lock(loadgen_mutex);
+            is_stopped = true;
+        }
+        loadgen_cv.notify_all();
+        sender_thread.join();
+        report_thread.join();
+
+        for (const auto& vehicle : vehicles) {
+            for (const auto& sensor : vehicle->sensors) {
+                sensor->server_connection->StopMessageHandling();
+            }
+        }
+
+        Report();
+    }
+
+    LoadGenerator(const LoadGenerator&) = delete;
+    LoadGenerator& operator=(const LoadGenerator&) = delete;
+
+    std::vector<std::string> GetVehicleIds() const {
+        std::vector<std::string> vehicle_ids;
+        for (const auto& vehicle : vehicles) {
+            vehicle_ids.push_back(vehicle->vehicle_id);
+        }
+        return vehicle_ids;
+    }
+
+  private:
+    struct Sensor {
+        whisker::proto::SensorClientInitMessage init_msg;
+        unsigned int num_credits = 0;
+        std::deque<std::chrono::steady_clock::time_point> send_times;  // of observations waiting to be consumed
+        std::shared_ptr<whisker::ServerConnection> server_connection;  // declared last to be destroyed first
+    };
+
+    struct Vehicle {
+        std::string vehicle_id;
+        std::vector<std::unique_ptr<Sensor>> sensors;  // indexed the same as Timeline::sensors
+
+        std::size_t next_entry = 0;
+        std::uint64_t num_repetitions = 0;  // of the timeline, which offsets the timestamps of later repetitions
+        std::uint64_t playback_start_timestamp = 0;  // timeline timestamp that is played back at 'playback_start'
+        std::chrono::steady_clock::time_point playback_start;  // when the server first granted credits
+        bool is_started = false;
+        bool is_waiting_for_credits = true;
+
+        // since the last report
+        std::uint64_t num_sent = 0;
+        std::vector<double> latencies;  // milliseconds
+    };
+
+    using ScheduledVehicle = std::pair<std::chrono::steady_clock::time_point, std::size_t>;  // due time, vehicle index
+
+    // returns the client ID and event handlers of the sensor's connection, which is created along with every other
+    // sensor's
+    std::pair<std::string, whisker::ServerEventHandlers> AddSensor(Vehicle& vehicle, std::size_t sensor_index) {
+        auto& sensor = *vehicle.sensors.emplace_back(std::make_unique<Sensor>());
+
+        sensor.init_msg = timeline.sensors[sensor_index];
+        sensor.init_msg.set_vehicle_id(vehicle.vehicle_id);
+        sensor.init_msg.set_use_streaming(true);
+
+        whisker::ServerEventHandlers event_handlers;
+        event_handlers.disconnect_handler = [this, &sensor](auto& connection) {
+            {
+                // the server issues a new set of credits when the sensor reconnects
+                std::scoped_lock lock(loadgen_mutex);
+                sensor.num_credits = 0;
+                sensor.send_times.clear();
+            }
+            // enqueue init msg to send when reconnected
+            connection.SendMessage(sensor.init_msg);
+        };
+        event_handlers.SetMessageHandler<whisker::proto::GrantObservationCreditsMessage>(
+                [this, &vehicle, &sensor, vehicle_index = vehicles.size() - 1](auto&& message, auto& connection) {
+                    const auto now = std::chrono::steady_clock::now();
+                    {
+                        std::scoped_lock lock(loadgen_mutex);
+                        sensor.num_credits += message.num_credits();
+                        // apart from the initial grant (when nothing has been sent yet), the server grants exactly one
+                        // credit for each of the sensor's observations that its map has consumed, in the order they
+                        // were sent
+                        for (auto i = message.num_credits(); (i > 0) && !sensor.send_times.empty(); --i) {
+                            vehicle.latencies.push_back(
+                                    std::chrono::duration<double, std::milli>(now - sensor.send_times.front())
+                                            .count());
+                            sensor.send_times.pop_front();
+                        }
+                        if (!vehicle.is_waiting_for_credits) {
+                            return;
+                        }
+                        if (!vehicle.is_started) {
+                            // the vehicle's timing starts once it's been assigned to a map
+                            vehicle.is_started = true;
+                            vehicle.playback_start = now;
+                        }
+                        vehicle.is_waiting_for_credits = false;
+                        ScheduleNextObservation(vehicle_index);
+                    }
+                    loadgen_cv.notify_all();
+                });
+
+        return {vehicle.vehicle_id + "sensor" + std::to_string(sensor_index), std::move(event_handlers)};
+    }
+
+    // must be called with 'loadgen_mutex' held
+    void ScheduleNextObservation(std::size_t vehicle_index) {
+        const auto& vehicle = *vehicles[vehicle_index];
+        const auto timestamp =
+                timeline.entries[vehicle.next_entry].timestamp + vehicle.num_repetitions * timeline.duration;
+        const auto due_time = vehicle.playback_start +
+                              std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                      std::chrono::duration<double, std::milli>(timestamp -
+                                                                                vehicle.playback_start_timestamp) /
+                                      FLAGS_rate);
+        scheduled_vehicles.emplace(due_time, vehicle_index);
+    }
+
+    void SendObservations() {
+        std::unique_lock lock(loadgen_mutex);
+
+        while (true) {
+            loadgen_cv.wait(lock, [this] { return is_stopped || !scheduled_vehicles.empty(); });
+            if (is_stopped) {
+                return;
+            }
+
+            const auto [due_time, vehicle_index] = scheduled_vehicles.top();
+            if (std::chrono::steady_clock::now() < due_time) {
+                // an earlier observation may be scheduled while waiting
+                loadgen_cv.wait_until(lock, due_time);
+                continue;
+            }
+            scheduled_vehicles.pop();
+
+            auto& vehicle = *vehicles[vehicle_index];
+            const auto& entry = timeline.entries[vehicle.next_entry];
+            auto& sensor = *vehicle.sensors[entry.sensor_index];
+            if (sensor.num_credits == 0) {
+                // the sensor's credit handler puts the vehicle back on schedule
+                vehicle.is_waiting_for_credits = true;
+                continue;
+            }
+            --sensor.num_credits;
+            sensor.send_times.push_back(std::chrono::steady_clock::now());
+            ++vehicle.num_sent;
+
+            const auto observation = CreateObservation(entry, vehicle.num_repetitions * timeline.duration);
+            if (++vehicle.next_entry == timeline.entries.size()) {
+                vehicle.next_entry = 0;
+                ++vehicle.num_repetitions;
+            }
+            ScheduleNextObservation(vehicle_index);
+
+            lock.unlock();
+            sensor.server_connection->SendMessage(*observation);
+            lock.lock();
+        }
+    }
+
+    // shifts the observation's timestamps so that they keep increasing when the timeline repeats
+    static std::shared_ptr<const whisker::proto::ObservationMessage> CreateObservation(const Timeline::Entry& entry,
+                                                                                      std::uint64_t time_shift) {
+        if (time_shift == 0) {
+            return entry.observation;
+        }
+        auto observation = std::make_shared<whisker::proto::ObservationMessage>(*entry.observation);
+        observation->set_timestamp(observation->timestamp() + time_shift);
+        if (observation->has_imu_batch_observation()) {
+            const auto imu_batch = observation->mutable_imu_batch_observation();
+            imu_batch->set_start_timestamp(imu_batch->start_timestamp() + time_shift * 1000);
+        }
+        return observation;
+    }
+
+    void ReportPeriodically() {
+        std::unique_lock lock(loadgen_mutex);
+        while (!loadgen_cv.wait_for(lock, std::chrono::seconds{FLAGS_report_interval}, [this] { return is_stopped; })) {
+            lock.unlock();
+            Report();
+            lock.lock();
+        }
+    }
+
+    void Report() {
+        const auto now = std::chrono::steady_clock::now();
+        const auto target_rate = FLAGS_rate * timeline.entries.size() * 1000 / timeline.duration;
+        std::uint64_t total_sent = 0;
+        std::vector<double> all_latencies;
+
+        std::scoped_lock lock(loadgen_mutex);
+        const auto elapsed_seconds = std::chrono::duration<double>(now - last_report_time).count();
+        last_report_time = now;
+
+        LOG(INFO) << "Observation rate (target " << target_rate << "/s) and latency percentiles over the last "
+                  << elapsed_seconds << " s:";
+        for (const auto& vehicle : vehicles) {
+            LOG(INFO) << "- " << vehicle->vehicle_id << ": " << vehicle->num_sent / elapsed_seconds << "/s, "
+                      << FormatLatencies(vehicle->latencies)
+                      << (!vehicle->is_started ? " (not assigned to a map)"
+                                                : vehicle->is_waiting_for_credits ? " (waiting for server)" : "");
+            total_sent += vehicle->num_sent;
+            all_latencies.insert(all_latencies.end(), vehicle->latencies.begin(), vehicle->latencies.end());
+            vehicle->num_sent = 0;
+            vehicle->latencies.clear();
+        }
+        LOG(INFO) << "- all vehicles: " << total_sent / elapsed_seconds << "/s, " << FormatLatencies(all_latencies);
+    }
+
+    static std::string FormatLatencies(std::vector<double>& latencies) {
+        if (latencies.empty()) {
+            return "no observations consumed";
+        }
+        std::ostringstream output;
+        output << "latency";
+        for (const auto percentile : {50, 90, 99, 100}) {
+            const auto nth = latencies.begin() + (latencies.size() - 1) * percentile / 100;
+            std::nth_element(latencies.begin(), nth, latencies.end());
+            output << " p" << percentile << " " << *nth << " ms";
+        }
+        return output.str();
+    }
+
+    const Timeline timeline;
+    std::vector<std::unique_ptr<Vehicle>> vehicles;
+    std::priority_queue<ScheduledVehicle, std::vector<ScheduledVehicle>, std::greater<>> scheduled_vehicles;
+    std::chrono::steady_clock::time_point last_report_time = std::chrono::steady_clock::now();
+    bool is_stopped = false;
+    std::mutex loadgen_mutex;
+    std::condition_variable loadgen_cv;
+    std::thread sender_thread;
+    std::thread report_thread;
+};
+
+// Creates maps for the vehicles and assigns them once the server reports that they've connected.
+std::shared_ptr<whisker::ServerConnection> AssignVehiclesToMaps(const std::vector<std::string>& vehicle_ids) {
+    struct AssignmentState {
+        std::unordered_set<std::string> requested_vehicle_ids;
+        std::unordered_set<std::string> requested_map_ids;
+    };
+
+    whisker::ServerEventHandlers event_handlers;
+    event_handlers.SetMessageHandler<whisker::proto::ServerStateMessage>(
+            [vehicle_ids, state = std::make_shared<AssignmentState>()](auto&& message, auto& connection) {
+                auto& [requested_vehicle_ids, requested_map_ids] = *state;
+                for (std::size_t i = 0; i < vehicle_ids.size(); ++i) {
+                    const auto& vehicle_id = vehicle_ids[i];
+                    if (!message.vehicles().count(vehicle_id) || requested_vehicle_ids.count(vehicle_id)) {
+                        continue;
+                    }
+
+                    const auto map_id = "loadgen_map" + std::to_string(i / FLAGS_vehicles_per_map);
+                    if (requested_map_ids.insert(map_id).second &&
+                        (std::find(message.map_ids().begin(), message.map_ids().end(), map_id) ==
+                         message.map_ids().end())) {
+                        whisker::proto::RequestCreateMapMessage create_map_msg;
+                        create_map_msg.set_map_id(map_id);
+                        connection.SendMessage(create_map_msg);
+                    }
+
+                    LOG(INFO) << "Assigning vehicle '" << vehicle_id << "' to map '" << map_id << "'";
+                    whisker::proto::RequestAssignVehicleToMapMessage assign_msg;
+                    assign_msg.set_vehicle_id(vehicle_id);
+                    assign_msg.set_map_id(map_id);
+                    connection.SendMessage(assign_msg);
+                    requested_vehicle_ids.insert(vehicle_id);
+                }
+            });
+
+    return whisker::ZmqConnection::CreateServerConnection(FLAGS_console_address, "loadgen_console",
+                                                          std::move(event_handlers));
+}
+
+int main(int argc, char* argv[]) {
+    whisker::Init::InitLogging(&argc, &argv);
+    whisker::Init::EnableExitSignalHandler();
+
+    CHECK_GT(FLAGS_vehicles, 0) << "At least one vehicle is required";
+    CHECK_GT(FLAGS_vehicles_per_map, 0) << "At least one vehicle per map is required";
+    CHECK_GT(FLAGS_rate, 0) << "Playback rate must be positive";
+
+    LoadGenerator load_generator{LoadTimeline(FLAGS_logs)};
+
+    std::shared_ptr<whisker::ServerConnection> console_connection;
+    if (!FLAGS_console_address.empty()) {
+        // a vehicle is assigned as soon as it appears in the server's state, so give the server time to register all
+        // of its sensors first
+        std::this_thread::sleep_for(std::chrono::seconds{1});
+        console_connection = AssignVehiclesToMaps(load_generator.GetVehicleIds());
+    }
+
+    whisker::Init::WaitForExitSignal();
+
+    if (console_connection) {
+        console_connection->StopMessageHandling();
+    }
+
+    return 0;
+}
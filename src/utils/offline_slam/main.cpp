@@ -0,0 +1,208 @@
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <json/json.h>
+#include <whisker/init.h>
+#include <whisker/message_log.h>
+#include <whisker/thread_pool.h>
+#include <client.pb.h>
+#include "../../server/cartographer_map.h"
+
+DECLARE_string(config);
+DEFINE_string(logs, "input.obslog", "Comma-separated list of observation log files to build the map from");
+DEFINE_string(out_map, "output.pbstream", "Output map file");
+DEFINE_string(vehicle_id, "offline", "Vehicle ID to use for logs that were recorded for a single sensor");
+DEFINE_bool(overlapping_trimmer, false, "Whether to use Cartographer's overlapping submaps trimmer");
+
+// enough to keep all of the map's threads busy without buffering a large part of the logs
+constexpr unsigned int max_pending_observations = 256;
+
+// One of the observation logs, from which the observation with the earliest timestamp is taken next.
+//
+// Observations from logs recorded for a whole vehicle are submitted for that vehicle, while those from logs recorded
+// for a single sensor are all submitted for the vehicle given by --vehicle_id.
+
+class LogSource final {
+  public:
+    struct Sensor {
+        std::string sensor_id;
+        std::shared_ptr<const whisker::proto::SensorClientInitMessage> sensor_data;
+    };
+
+    LogSource(const std::string& log_file_path, std::size_t log_index) {
+        is_vehicle_log =
+                whisker::MessageLogReader::ReadMagicHeader(log_file_path) == whisker::vehicle_observation_log_header;
+
+        if (is_vehicle_log) {
+            log_reader = whisker::MessageLogReader::CreateInstance(log_file_path,
+                                                                   whisker::vehicle_observation_log_header);
+            whisker::proto::VehicleObservationLogHeader log_header;
+            CHECK(log_reader->Read(log_header)) << "Error reading VehicleObservationLogHeader from observation log";
+            for (const auto& log_sensor : log_header.sensors()) {
+                auto sensor_data = std::make_shared<whisker::proto::SensorClientInitMessage>(log_sensor.init_message());
+                sensor_data->set_vehicle_id(log_header.vehicle_id());
+                sensors.push_back({log_sensor.sensor_id(), std::move(sensor_data)});
+            }
+        } else {
+            log_reader = whisker::MessageLogReader::CreateInstance(log_file_path);
+            auto sensor_data = std::make_shared<whisker::proto::SensorClientInitMessage>();
+            CHECK(log_reader->Read(*sensor_data)) << "Error reading SensorClientInitMessage from observation log";
+            sensor_data->set_vehicle_id(FLAGS_vehicle_id);
+            sensors.push_back({"sensor" + std::to_string(log_index), std::move(sensor_data)});
+        }
+
+        ReadNextObservation();
+    }
+
+    LogSource(const LogSource&) = delete;
+    LogSource& operator=(const LogSource&) = delete;
+
+    const std::vector<Sensor>& GetSensors() const { return sensors; }
+
+    bool HasObservation() const { return next_observation != nullptr; }
+
+    std::uint64_t GetNextTimestamp() const { return next_observation->timestamp(); }
+
+    // returns the index of the observation's sensor in GetSensors()
+    std::size_t TakeObservation(std::shared_ptr<const whisker::proto::ObservationMessage>& observation) {
+        const auto sensor_index = next_sensor_index;
+        observation = std::move(next_observation);
+        ReadNextObservation();
+        return sensor_index;
+    }
+
+  private:
+    void ReadNextObservation() {
+        auto observation = std::make_shared<whisker::proto::ObservationMessage>();
+        if (is_vehicle_log) {
+            if (log_reader->Read(log_entry)) {
+                CHECK_LT(log_entry.sensor_index(), sensors.size()) << "Observation from unknown sensor in log";
+                next_sensor_index = log_entry.sensor_index();
+                observation->Swap(log_entry.mutable_observation());
+                next_observation = std::move(observation);
+            }
+        } else if (log_reader->Read(*observation)) {
+            next_observation = std::move(observation);
+        }
+    }
+
+    std::shared_ptr<whisker::MessageLogReader> log_reader;
+    bool is_vehicle_log;
+    std::vector<Sensor> sensors;
+    whisker::proto::VehicleObservationLogEntry log_entry;
+    std::size_t next_sensor_index = 0;
+    std::shared_ptr<const whisker::proto::ObservationMessage> next_observation;  // null at the end of the log
+};
+
+int main(int argc, char* argv[]) {
+    whisker::Init::InitLogging(&argc, &argv);
+
+    LOG(INFO) << "Building map from observation logs '" << FLAGS_logs << "' with config file "
+              << std::filesystem::absolute(FLAGS_config).lexically_normal();
+
+    std::ifstream config_file(FLAGS_config);
+    CHECK(config_file) << "Error opening config file";
+    Json::Value config;
+    config_file >> config;
+
+    std::vector<std::unique_ptr<LogSource>> log_sources;
+    std::map<std::string, std::vector<CartographerMap::SensorIdAndType>> vehicle_sensors;  // vehicle ID -> sensors
+    {
+        std::istringstream log_file_names{FLAGS_logs};
+        std::string log_file_name;
+        while (std::getline(log_file_names, log_file_name, ',')) {
+            const auto& log_source =
+                    log_sources.emplace_back(std::make_unique<LogSource>(log_file_name, log_sources.size()));
+            for (const auto& sensor : log_source->GetSensors()) {
+                vehicle_sensors[sensor.sensor_data->vehicle_id()].emplace_back(
+                        sensor.sensor_id, sensor.sensor_data->sensor_type_case());
+            }
+        }
+    }
+
+    std::mutex pending_mutex;
+    std::condition_variable pending_cv;
+    unsigned int num_pending = 0;
+
+    const auto thread_pool = std::make_shared<whisker::ThreadPool>();
+    auto map = std::make_unique<CartographerMap>(
+            "offline", config["server"]["cartographer"], FLAGS_overlapping_trimmer, thread_pool, thread_pool,
+            std::make_shared<SubmapTextureCache>(0), false,
+            [&pending_mutex, &pending_cv, &num_pending](const auto& sensor_id) {
+                {
+                    std::scoped_lock lock(pending_mutex);
+                    --num_pending;
+                }
+                pending_cv.notify_one();
+            });
+
+    for (auto& [vehicle_id, sensor_ids] : vehicle_sensors) {
+        map->AddVehicle(vehicle_id, std::move(sensor_ids), {}, false, false);
+    }
+
+    const auto start_time = std::chrono::steady_clock::now();
+    std::uint64_t num_observations = 0;
+    std::uint64_t num_scans = 0;
+
+    // merge the logs by always submitting the earliest of their next observations, with the map consuming them as
+    // fast as it can
+    while (true) {
+        LogSource* earliest_source = nullptr;
+        for (const auto& log_source : log_sources) {
+            if (log_source->HasObservation() &&
+                (!earliest_source || (log_source->GetNextTimestamp() < earliest_source->GetNextTimestamp()))) {
+                earliest_source = log_source.get();
+            }
+        }
+        if (!earliest_source) {
+            break;
+        }
+
+        std::shared_ptr<const whisker::proto::ObservationMessage> observation;
+        const auto& sensor = earliest_source->GetSensors()[earliest_source->TakeObservation(observation)];
+        if (observation->has_lidar_observation()) {
+            ++num_scans;
+        }
+        ++num_observations;
+
+        {
+            std::unique_lock lock(pending_mutex);
+            pending_cv.wait(lock, [&num_pending] { return num_pending < max_pending_observations; });
+            ++num_pending;
+        }
+        map->SubmitObservation(sensor.sensor_id, sensor.sensor_data, std::move(observation));
+
+        LOG_EVERY_T(INFO, 10) << "Submitted " << num_observations << " observations";
+    }
+
+    {
+        std::unique_lock lock(pending_mutex);
+        pending_cv.wait(lock, [&num_pending] { return num_pending == 0; });
+    }
+
+    const auto elapsed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    LOG(INFO) << "Processed " << num_observations << " observations (" << num_scans << " scans) in " << elapsed_seconds
+              << " s, " << num_scans / elapsed_seconds << " scans/s";
+
+    // the map finishes its trajectories and runs the final optimization before saving, and waits for saving to
+    // complete before it's destroyed
+    const auto save_start_time = std::chrono::steady_clock::now();
+    map->SaveState(FLAGS_out_map);
+    map.reset();
+    LOG(INFO) << "Optimized and saved map in "
+              << std::chrono::duration<double>(std::chrono::steady_clock::now() - save_start_time).count() << " s";
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+#ifndef WHISKER_TESTS_BASELINE_OVERWRITING_BUFFER_H
+#define WHISKER_TESTS_BASELINE_OVERWRITING_BUFFER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace whisker::baseline {
+
+// OverwritingBuffer as it was before it was made a lock-free triple buffer (slot indices guarded by a mutex), kept so
+// that benchmarks can compare against it.  TryRead() and GetNumOverwritten() didn't exist then and are added in the
+// same style so that the same benchmarks can run on both.
+template <typename T>
+class OverwritingBuffer final {
+  public:
+    OverwritingBuffer() = default;
+
+    OverwritingBuffer(const OverwritingBuffer&) = delete;
+    OverwritingBuffer& operator=(const OverwritingBuffer&) = delete;
+
+    // this will block until there is data available to be read
+    template <typename Reader>
+    void Read(const Reader& reader) {
+        std::unique_lock lock(index_mutex);
+        wait_cv.wait(lock, [this] { return index_newest != -1 && index_reading == -1; });
+
+        index_reading = index_newest;
+        index_newest = -1;
+        lock.unlock();
+
+        reader(&buffer[index_reading]);
+
+        lock.lock();
+        index_reading = -1;
+    }
+
+    template <typename Reader>
+    bool TryRead(const Reader& reader) {
+        std::unique_lock lock(index_mutex);
+        if (index_newest == -1 || index_reading != -1) {
+            return false;
+        }
+
+        index_reading = index_newest;
+        index_newest = -1;
+        lock.unlock();
+
+        reader(&buffer[index_reading]);
+
+        lock.lock();
+        index_reading = -1;
+        return true;
+    }
+
+    template <typename Writer>
+    void Write(const Writer& writer) {
+        std::unique_lock lock(index_mutex);
+        for (auto i = 0; i < num_slots; ++i) {
+            if (i != index_newest && i != index_reading && index_writing == -1) {
+                index_writing = i;
+                lock.unlock();
+
+                writer(&buffer[i]);
+
+                lock.lock();
+                if (index_newest != -1) {
+                    ++num_overwritten;
+                }
+                index_newest = i;
+                index_writing = -1;
+                wait_cv.notify_one();
+
+                return;
+            }
+        }
+    }
+
+    std::uint64_t GetNumOverwritten() {
+        std::scoped_lock lock(index_mutex);
+        return num_overwritten;
+    }
+
+  private:
+    static constexpr unsigned short num_slots = 3;
+    const std::unique_ptr<T[]> buffer = std::make_unique<T[]>(num_slots);
+    short index_newest = -1;
+    short index_reading = -1;
+    short index_writing = -1;
+    std::uint64_t num_overwritten = 0;
+    std::mutex index_mutex;
+    std::condition_variable wait_cv;
+};
+
+}  // namespace whisker::baseline
+
+#endif  // WHISKER_TESTS_BASELINE_OVERWRITING_BUFFER_H
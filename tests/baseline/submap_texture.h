@@ -0,0 +1,31 @@
+#ifndef WHISKER_TESTS_BASELINE_SUBMAP_TEXTURE_H
+#define WHISKER_TESTS_BASELINE_SUBMAP_TEXTURE_H
+
+#include <cstdint>
+#include <cartographer/mapping/submaps.h>
+#include <cartographer/mapping/2d/grid_2d.h>
+#include <cartographer/mapping/2d/map_limits.h>
+#include <cartographer/mapping/2d/xy_index.h>
+#include <Eigen/Core>
+
+namespace whisker::baseline {
+
+// RasterizeSubmapTexture() as it was before it read the grid's raw cells through a lookup table (a bounds checked
+// lookup and float log odds math for every cell), kept so that tests and benchmarks can compare against it
+inline void RasterizeSubmapTexture(const cartographer::mapping::Grid2D& grid,
+                                   const Eigen::Array2i& offset,
+                                   const cartographer::mapping::CellLimits& limits,
+                                   std::uint8_t* pixels) {
+    for (const auto& cropped_index : cartographer::mapping::XYIndexRangeIterator(limits)) {
+        const auto cell = offset + cropped_index;
+        if (grid.IsKnown(cell)) {
+            *(pixels++) = cartographer::mapping::ProbabilityToLogOddsInteger(1 - grid.GetCorrespondenceCost(cell));
+        } else {
+            *(pixels++) = 0;
+        }
+    }
+}
+
+}  // namespace whisker::baseline
+
+#endif  // WHISKER_TESTS_BASELINE_SUBMAP_TEXTURE_H
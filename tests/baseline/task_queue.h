@@ -0,0 +1,81 @@
+#ifndef WHISKER_TESTS_BASELINE_TASK_QUEUE_H
+#define WHISKER_TESTS_BASELINE_TASK_QUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+
+namespace whisker::baseline {
+
+// TaskQueue as it was before it was made lock-free (a mutex and condition variable around a queue of heap-allocated
+// std::functions), kept so that benchmarks can compare against it
+class TaskQueue final {
+  public:
+    using Task = std::function<void()>;
+
+    TaskQueue() {
+        work_thread = std::thread{&TaskQueue::ProcessTasks, this};
+    }
+
+    ~TaskQueue() {
+        if (run_work_thread) {
+            FinishQueueSync();
+        }
+    }
+
+    TaskQueue(const TaskQueue&) = delete;
+    TaskQueue& operator=(const TaskQueue&) = delete;
+
+    template <typename T>
+    void AddTask(T&& task) {
+        std::scoped_lock lock(task_queue_mutex);
+        task_queue.emplace(std::make_unique<Task>(std::forward<T>(task)));
+        task_queue_cv.notify_one();
+    }
+
+    std::size_t GetNumTasks() {
+        std::scoped_lock lock(task_queue_mutex);
+        return task_queue.size();
+    }
+
+    void FinishQueueSync() {
+        run_work_thread = false;
+        {
+            // unlike the original, notify under the lock so that a benchmark can't hang on a missed wakeup here
+            std::scoped_lock lock(task_queue_mutex);
+            task_queue_cv.notify_one();
+        }
+        work_thread.join();
+    }
+
+  private:
+    void ProcessTasks() {
+        const auto should_proceed = [this] { return !task_queue.empty() || !run_work_thread; };
+        while (true) {
+            std::unique_lock lock(task_queue_mutex);
+            task_queue_cv.wait(lock, should_proceed);
+            if (task_queue.empty() && !run_work_thread) {
+                return;
+            }
+            const auto task_ptr = std::move(task_queue.front());
+            task_queue.pop();
+            lock.unlock();
+            (*task_ptr)();
+        }
+    }
+
+    std::queue<std::unique_ptr<Task>> task_queue;
+    std::mutex task_queue_mutex;
+    std::condition_variable task_queue_cv;
+    std::thread work_thread;
+    std::atomic_bool run_work_thread = true;
+};
+
+}  // namespace whisker::baseline
+
+#endif  // WHISKER_TESTS_BASELINE_TASK_QUEUE_H
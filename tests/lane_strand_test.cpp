@@ -0,0 +1,121 @@
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include <whisker/lane_strand.h>
+#include <whisker/thread_pool.h>
+
+namespace {
+
+TEST(LaneStrandTest, TasksInDifferentLanesRunConcurrently) {
+    const auto thread_pool = std::make_shared<whisker::ThreadPool>(2);
+    whisker::LaneStrand strand(thread_pool);
+
+    // each lane's task only finishes once the other lane's task has started, so running them serially hangs
+    std::promise<void> first_started;
+    std::promise<void> second_started;
+    std::atomic_bool are_both_started = true;
+    const auto wait_for = [&are_both_started](std::promise<void>& started) {
+        if (started.get_future().wait_for(std::chrono::seconds(10)) != std::future_status::ready) {
+            are_both_started = false;
+        }
+    };
+    strand.AddLaneTask("first", [&] {
+        first_started.set_value();
+        wait_for(second_started);
+    });
+    strand.AddLaneTask("second", [&] {
+        second_started.set_value();
+        wait_for(first_started);
+    });
+    strand.FinishQueueSync();
+
+    EXPECT_TRUE(are_both_started);
+}
+
+// a random mix of lane tasks and exclusive tasks, each checking on start that everything that had to run before it
+// has finished and nothing that had to run after it has started
+TEST(LaneStrandTest, RandomTasksKeepLaneOrderAndExclusivity) {
+    constexpr int num_tasks = 20000;
+    constexpr int num_lanes = 8;
+    const auto thread_pool = std::make_shared<whisker::ThreadPool>(4);
+
+    std::atomic_int num_started = 0;
+    std::atomic_int num_finished = 0;
+    std::atomic_int last_finished_exclusive_task = -1;
+    std::vector<int> last_lane_tasks(num_lanes, -1);  // only accessed by the lane's own tasks
+    std::atomic_int num_errors = 0;
+
+    std::mt19937 random(1);
+    std::uniform_int_distribution<int> lane_distribution(0, num_lanes);  // 'num_lanes' means an exclusive task
+    std::bernoulli_distribution exclusive_distribution(0.02);
+    std::bernoulli_distribution pause_distribution(0.001);
+
+    whisker::LaneStrand strand(thread_pool);
+    auto last_exclusive_task = -1;
+    for (int task = 0; task < num_tasks; ++task) {
+        if (exclusive_distribution(random)) {
+            strand.AddTask([&, task] {
+                // everything added before has finished and nothing added after has started
+                if ((num_finished != task) || (num_started++ != task)) {
+                    ++num_errors;
+                }
+                std::this_thread::yield();
+                last_finished_exclusive_task = task;
+                ++num_finished;
+            });
+            last_exclusive_task = task;
+        } else {
+            const auto lane = lane_distribution(random) % num_lanes;
+            strand.AddLaneTask("lane" + std::to_string(lane), [&, task, lane, last_exclusive_task] {
+                ++num_started;
+                // the exclusive task added most recently before this one has finished, and the next hasn't started
+                if (last_finished_exclusive_task != last_exclusive_task) {
+                    ++num_errors;
+                }
+                if (last_lane_tasks[lane] >= task) {
+                    ++num_errors;
+                }
+                last_lane_tasks[lane] = task;
+                ++num_finished;
+            });
+        }
+
+        if (pause_distribution(random)) {
+            // let the strand go idle so that tasks are also added to an empty strand
+            strand.FinishQueueSync();
+        }
+    }
+    strand.FinishQueueSync();
+
+    EXPECT_EQ(num_errors, 0);
+    EXPECT_EQ(num_finished, num_tasks);
+    EXPECT_EQ(strand.GetNumTasks(), 0u);
+}
+
+// lanes are dropped while an exclusive task runs, and tasks for those lane IDs afterwards still run in order
+TEST(LaneStrandTest, LanesAreReusableAfterExclusiveTask) {
+    const auto thread_pool = std::make_shared<whisker::ThreadPool>(2);
+    std::vector<int> order;
+    {
+        whisker::LaneStrand strand(thread_pool);
+        for (int i = 0; i < 100; ++i) {
+            strand.AddLaneTask("lane", [&order, i] { order.push_back(i); });
+            if (i % 10 == 0) {
+                strand.AddTask([] {});
+            }
+        }
+    }
+
+    ASSERT_EQ(order.size(), 100u);
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(order[i], i);
+    }
+}
+
+}  // namespace
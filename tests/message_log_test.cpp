@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include <zlib.h>
+#include <whisker/message_log.h>
+#include <whisker/thread_pool.h>
+#include <common.pb.h>
+
+namespace {
+
+constexpr std::uint64_t test_log_header = 0x3130676F6C747374;  // little-endian 'tstlog01'
+
+// messages of varying size, with the message's ordinal in 'capability' and its timestamp 10 times the ordinal
+std::shared_ptr<whisker::proto::InvokeCapabilityMessage> MakeMessage(int index) {
+    auto message = std::make_shared<whisker::proto::InvokeCapabilityMessage>();
+    message->set_capability(std::to_string(index));
+    message->set_input(std::string((index * 37) % 500 + 1, static_cast<char>('a' + index % 26)));
+    return message;
+}
+
+std::uint64_t GetTimestamp(int index) {
+    return index * 10;
+}
+
+class MessageLogTest : public testing::Test {
+  protected:
+    MessageLogTest() {
+        // parameterized tests have slashes in their names
+        const auto test_info = testing::UnitTest::GetInstance()->current_test_info();
+        auto file_name = std::string{"whisker_"} + test_info->test_suite_name() + "_" + test_info->name() + ".log";
+        std::replace(file_name.begin(), file_name.end(), '/', '_');
+        log_file_path = (std::filesystem::temp_directory_path() / file_name).string();
+    }
+
+    ~MessageLogTest() override {
+        std::filesystem::remove(log_file_path);
+    }
+
+    // small buffers so that the log is split into many blocks
+    void WriteLog(int num_messages, whisker::MessageLogCompression compression = whisker::MessageLogCompression::zlib) {
+        whisker::MessageLogWriterOptions options;
+        options.compression = compression;
+        options.max_buffered_bytes = 64 * 1024;
+        const auto writer = whisker::MessageLogWriter::CreateInstance(log_file_path, test_log_header, options);
+        for (int i = 0; i < num_messages; ++i) {
+            writer->Write(MakeMessage(i), GetTimestamp(i));
+        }
+    }
+
+    // returns the ordinals of the messages read until the end of the log
+    static std::vector<int> ReadToEnd(whisker::MessageLogReader& reader) {
+        std::vector<int> indexes;
+        whisker::proto::InvokeCapabilityMessage message;
+        while (reader.Read(message)) {
+            const auto index = std::stoi(message.capability());
+            EXPECT_EQ(message.input(), MakeMessage(index)->input()) << "at message " << index;
+            indexes.push_back(index);
+        }
+        return indexes;
+    }
+
+    static int ReadIndex(whisker::MessageLogReader& reader) {
+        whisker::proto::InvokeCapabilityMessage message;
+        return reader.Read(message) ? std::stoi(message.capability()) : -1;
+    }
+
+    static std::vector<int> Iota(int first, int last) {
+        std::vector<int> values;
+        for (auto i = first; i < last; ++i) {
+            values.push_back(i);
+        }
+        return values;
+    }
+
+    std::string log_file_path;
+};
+
+class MessageLogRoundTripTest : public MessageLogTest,
+                                public testing::WithParamInterface<whisker::MessageLogCompression> {};
+
+TEST_P(MessageLogRoundTripTest, ReadsBackEveryMessage) {
+    WriteLog(2000, GetParam());
+    EXPECT_EQ(whisker::MessageLogReader::ReadMagicHeader(log_file_path), test_log_header);
+
+    const auto reader = whisker::MessageLogReader::CreateInstance(log_file_path, test_log_header);
+    EXPECT_EQ(ReadToEnd(*reader), Iota(0, 2000));
+    EXPECT_FLOAT_EQ(reader->GetReadPercent(), 1);
+}
+
+TEST_P(MessageLogRoundTripTest, EmptyLog) {
+    WriteLog(0, GetParam());
+
+    const auto reader = whisker::MessageLogReader::CreateInstance(log_file_path, test_log_header);
+    EXPECT_TRUE(ReadToEnd(*reader).empty());
+    EXPECT_FALSE(reader->SeekToIndex(0));
+    EXPECT_FALSE(reader->SeekToTimestamp(0));
+}
+
+INSTANTIATE_TEST_SUITE_P(Compression,
+                         MessageLogRoundTripTest,
+                         testing::Values(whisker::MessageLogCompression::none, whisker::MessageLogCompression::zlib));
+
+TEST_F(MessageLogTest, SeekToIndex) {
+    WriteLog(2000);
+    const auto reader = whisker::MessageLogReader::CreateInstance(log_file_path, test_log_header);
+
+    ASSERT_TRUE(reader->SeekToIndex(1999));
+    EXPECT_EQ(ReadToEnd(*reader), std::vector<int>{1999});
+
+    ASSERT_TRUE(reader->SeekToIndex(0));
+    EXPECT_EQ(ReadIndex(*reader), 0);
+
+    // seeking backwards within and across blocks
+    ASSERT_TRUE(reader->SeekToIndex(1234));
+    EXPECT_EQ(ReadIndex(*reader), 1234);
+    ASSERT_TRUE(reader->SeekToIndex(17));
+    EXPECT_EQ(ReadToEnd(*reader), Iota(17, 2000));
+
+    EXPECT_FALSE(reader->SeekToIndex(2000));
+    EXPECT_FALSE(reader->SeekToIndex(UINT64_MAX));
+}
+
+TEST_F(MessageLogTest, SeekToTimestamp) {
+    WriteLog(2000);
+    const auto reader = whisker::MessageLogReader::CreateInstance(log_file_path, test_log_header);
+
+    ASSERT_TRUE(reader->SeekToTimestamp(GetTimestamp(1999)));
+    EXPECT_EQ(ReadToEnd(*reader), std::vector<int>{1999});
+
+    ASSERT_TRUE(reader->SeekToTimestamp(0));
+    EXPECT_EQ(ReadIndex(*reader), 0);
+
+    // between two messages' timestamps
+    ASSERT_TRUE(reader->SeekToTimestamp(GetTimestamp(999) + 5));
+    EXPECT_EQ(ReadIndex(*reader), 1000);
+
+    EXPECT_FALSE(reader->SeekToTimestamp(GetTimestamp(1999) + 1));
+}
+
+// a log that wasn't closed cleanly has its index rebuilt from the blocks that were completely written
+TEST_F(MessageLogTest, ReadsTruncatedLogWithoutIndex) {
+    WriteLog(2000);
+    std::filesystem::resize_file(log_file_path, std::filesystem::file_size(log_file_path) * 3 / 4);
+
+    const auto reader = whisker::MessageLogReader::CreateInstance(log_file_path, test_log_header);
+    const auto indexes = ReadToEnd(*reader);
+    ASSERT_FALSE(indexes.empty());
+    EXPECT_LT(indexes.size(), 2000u);
+    EXPECT_EQ(indexes, Iota(0, static_cast<int>(indexes.size())));
+
+    const auto last_index = static_cast<std::uint64_t>(indexes.size() - 1);
+    ASSERT_TRUE(reader->SeekToIndex(last_index));
+    EXPECT_EQ(ReadIndex(*reader), indexes.back());
+    EXPECT_FALSE(reader->SeekToIndex(last_index + 1));
+}
+
+// only the index is lost, so every message is still readable
+TEST_F(MessageLogTest, ReadsLogWithCorruptTrailer) {
+    WriteLog(2000);
+    std::filesystem::resize_file(log_file_path, std::filesystem::file_size(log_file_path) - 1);
+
+    const auto reader = whisker::MessageLogReader::CreateInstance(log_file_path, test_log_header);
+    ASSERT_TRUE(reader->SeekToTimestamp(GetTimestamp(1500)));
+    EXPECT_EQ(ReadToEnd(*reader), Iota(1500, 2000));
+}
+
+TEST_F(MessageLogTest, ReadsV1Log) {
+    // v1 is a gzip stream of the magic header followed by size-prefixed messages
+    const auto log_file = gzopen(log_file_path.c_str(), "wb");
+    ASSERT_TRUE(log_file);
+    const auto write_value = [log_file](auto value) {
+        unsigned char buf[sizeof(value)];
+        for (unsigned int i = 0; i < sizeof(value); ++i) {
+            buf[i] = static_cast<unsigned char>((value >> (i * 8)) & 0xff);
+        }
+        gzwrite(log_file, buf, sizeof(buf));
+    };
+    write_value(test_log_header);
+    for (int i = 0; i < 100; ++i) {
+        const auto data = MakeMessage(i)->SerializeAsString();
+        write_value(static_cast<std::uint32_t>(data.size()));
+        gzwrite(log_file, data.data(), static_cast<unsigned int>(data.size()));
+    }
+    ASSERT_EQ(gzclose(log_file), Z_OK);
+
+    EXPECT_EQ(whisker::MessageLogReader::ReadMagicHeader(log_file_path), test_log_header);
+    const auto reader = whisker::MessageLogReader::CreateInstance(log_file_path, test_log_header);
+    EXPECT_FALSE(reader->SeekToIndex(0));
+    EXPECT_FALSE(reader->SeekToTimestamp(0));
+    EXPECT_EQ(ReadToEnd(*reader), Iota(0, 100));
+}
+
+// with compression stalled, nothing reaches the disk, so the buffer limit stays reached
+TEST_F(MessageLogTest, TryWriteFailsWhenBufferIsFull) {
+    const auto thread_pool = std::make_shared<whisker::ThreadPool>(1);
+    std::promise<void> release_pool;
+    thread_pool->Schedule([future = release_pool.get_future()] { future.wait(); });
+
+    std::atomic_int num_written = 0;
+    const auto count_written = [&num_written](bool is_written) {
+        EXPECT_TRUE(is_written);
+        ++num_written;
+    };
+
+    int num_accepted = 0;
+    {
+        whisker::MessageLogWriterOptions options;
+        options.max_buffered_bytes = 16 * 1024;
+        options.compression_thread_pool = thread_pool;
+        const auto writer = whisker::MessageLogWriter::CreateInstance(log_file_path, test_log_header, options);
+
+        while (writer->TryWrite(MakeMessage(num_accepted), GetTimestamp(num_accepted), count_written)) {
+            ++num_accepted;
+            ASSERT_LE(num_accepted, 1000) << "TryWrite() never failed";
+        }
+        EXPECT_GT(num_accepted, 0);
+        EXPECT_EQ(writer->GetNumPendingWrites(), static_cast<std::size_t>(num_accepted));
+        EXPECT_EQ(writer->GetNumDroppedWrites(), 0u);
+        EXPECT_EQ(num_written, 0);
+
+        release_pool.set_value();
+    }
+
+    EXPECT_EQ(num_written, num_accepted);
+    const auto reader = whisker::MessageLogReader::CreateInstance(log_file_path, test_log_header);
+    EXPECT_EQ(ReadToEnd(*reader), Iota(0, num_accepted));
+}
+
+TEST_F(MessageLogTest, WriteDropsWhenBufferIsFull) {
+    const auto thread_pool = std::make_shared<whisker::ThreadPool>(1);
+    std::promise<void> release_pool;
+    thread_pool->Schedule([future = release_pool.get_future()] { future.wait(); });
+
+    whisker::MessageLogWriterOptions options;
+    options.max_buffered_bytes = 16 * 1024;
+    options.drop_when_full = true;
+    options.compression_thread_pool = thread_pool;
+    const auto writer = whisker::MessageLogWriter::CreateInstance(log_file_path, test_log_header, options);
+
+    std::atomic_int num_dropped = 0;
+    for (int i = 0; i < 1000; ++i) {
+        writer->Write(MakeMessage(i), GetTimestamp(i), [&num_dropped](bool is_written) {
+            if (!is_written) {
+                ++num_dropped;
+            }
+        });
+    }
+
+    EXPECT_GT(num_dropped, 0);
+    EXPECT_EQ(writer->GetNumDroppedWrites(), static_cast<std::uint64_t>(num_dropped));
+    EXPECT_EQ(writer->GetNumPendingWrites(), static_cast<std::size_t>(1000 - num_dropped));
+    release_pool.set_value();
+}
+
+}  // namespace
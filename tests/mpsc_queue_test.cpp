@@ -0,0 +1,76 @@
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <gtest/gtest.h>
+#include <whisker/mpsc_queue.h>
+
+namespace {
+
+TEST(MpscQueueTest, PopsInPushOrder) {
+    whisker::MpscQueue<int> queue;
+    int value = -1;
+    EXPECT_FALSE(queue.TryPop(value));
+
+    for (int i = 0; i < 1000; ++i) {
+        queue.Push(int{i});
+    }
+    for (int i = 0; i < 1000; ++i) {
+        ASSERT_TRUE(queue.TryPop(value));
+        EXPECT_EQ(value, i);
+    }
+    EXPECT_FALSE(queue.TryPop(value));
+}
+
+TEST(MpscQueueTest, DestructorFreesUnpoppedValues) {
+    const auto value = std::make_shared<int>(0);
+    {
+        whisker::MpscQueue<std::shared_ptr<int>> queue;
+        for (int i = 0; i < 10; ++i) {
+            queue.Push(std::shared_ptr<int>{value});
+        }
+        std::shared_ptr<int> popped;
+        ASSERT_TRUE(queue.TryPop(popped));
+    }
+    EXPECT_EQ(value.use_count(), 1);
+}
+
+// values from each producer are popped in the order that producer pushed them, with none lost or duplicated
+TEST(MpscQueueTest, ConcurrentProducersKeepTheirOrder) {
+    constexpr int num_producers = 4;
+    constexpr int num_values_per_producer = 200000;
+    whisker::MpscQueue<std::pair<int, int>> queue;
+
+    std::vector<std::thread> producers;
+    for (int producer = 0; producer < num_producers; ++producer) {
+        producers.emplace_back([&queue, producer] {
+            for (int i = 0; i < num_values_per_producer; ++i) {
+                queue.Push({producer, i});
+            }
+        });
+    }
+
+    std::vector<int> next_values(num_producers, 0);
+    int num_out_of_order = 0;
+    for (int num_popped = 0; num_popped < num_producers * num_values_per_producer;) {
+        std::pair<int, int> value;
+        if (!queue.TryPop(value)) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (value.second != next_values[value.first]) {
+            ++num_out_of_order;
+        }
+        next_values[value.first] = value.second + 1;
+        ++num_popped;
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+
+    EXPECT_EQ(num_out_of_order, 0);
+    std::pair<int, int> value;
+    EXPECT_FALSE(queue.TryPop(value));
+}
+
+}  // namespace
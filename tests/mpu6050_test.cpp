@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <json/json.h>
+#include <gtest/gtest.h>
+#include "mpu6050.h"
+
+namespace {
+
+constexpr unsigned char interrupt_status_register = 0x3a;
+constexpr unsigned char readings_register_base = 0x3b;
+constexpr unsigned char user_control_register = 0x6a;
+constexpr unsigned char fifo_count_register_base = 0x72;
+constexpr unsigned char fifo_data_register = 0x74;
+
+constexpr std::size_t frame_size = 14;
+constexpr std::size_t fifo_capacity = 1024;
+
+// simulates the MPU-6050's FIFO, which the test fills with frames whose raw X acceleration is a sequence number
+class FakeMpu6050 final : public I2cDevice {
+  public:
+    struct RegisterWrite {
+        unsigned char reg;
+        unsigned char value;
+    };
+
+    // 'register_writes' outlives the fake, which is owned by the Mpu6050 under test
+    explicit FakeMpu6050(std::shared_ptr<std::vector<RegisterWrite>> register_writes = {})
+            : register_writes(std::move(register_writes)) {}
+
+    void WriteRegister(unsigned char reg, unsigned char value) override {
+        std::scoped_lock lock(fake_mutex);
+        if (register_writes) {
+            register_writes->push_back({reg, value});
+        }
+        if ((reg == user_control_register) && (value & (1 << 2))) {
+            fifo.clear();
+            is_overflowed = false;
+            ++num_fifo_resets;
+        }
+    }
+
+    void ReadRegisters(unsigned char reg, unsigned char* buf, std::size_t length) override {
+        std::scoped_lock lock(fake_mutex);
+        switch (reg) {
+            case interrupt_status_register: {
+                // the overflow flag is cleared by reading the register
+                buf[0] = is_overflowed ? (1 << 4) : 0;
+                is_overflowed = false;
+            } break;
+
+            case fifo_count_register_base: {
+                buf[0] = fifo.size() >> 8;
+                buf[1] = fifo.size() & 0xff;
+            } break;
+
+            case fifo_data_register: {
+                ASSERT_LE(length, fifo.size());
+                std::copy_n(fifo.begin(), length, buf);
+                fifo.erase(fifo.begin(), fifo.begin() + length);
+            } break;
+
+            case readings_register_base: {
+                std::fill_n(buf, length, 0);
+            } break;
+
+            default:
+                FAIL() << "Unexpected read of register " << static_cast<int>(reg);
+        }
+    }
+
+    // appends 'num_bytes' bytes of consecutive frames, which may end partway through a frame
+    void PushFifoBytes(std::size_t num_bytes) {
+        std::scoped_lock lock(fake_mutex);
+        for (std::size_t i = 0; i < num_bytes; ++i, ++num_bytes_pushed) {
+            const auto sequence_number = num_bytes_pushed / frame_size;
+            const auto offset = num_bytes_pushed % frame_size;
+            const auto byte = (offset == 0) ? (sequence_number >> 8) : (offset == 1) ? sequence_number : offset;
+            fifo.push_back(static_cast<unsigned char>(byte));
+        }
+        if (fifo.size() > fifo_capacity) {
+            // like the real FIFO, the oldest bytes are overwritten, so it's no longer aligned to a frame boundary
+            fifo.erase(fifo.begin(), fifo.end() - fifo_capacity);
+            is_overflowed = true;
+        }
+    }
+
+    // after a reset the sensor starts over at a frame boundary, so the partial frame that was pushed is never finished
+    void StartNewFrame() {
+        std::scoped_lock lock(fake_mutex);
+        num_bytes_pushed = (num_bytes_pushed + frame_size - 1) / frame_size * frame_size;
+    }
+
+    bool IsFifoEmpty() {
+        std::scoped_lock lock(fake_mutex);
+        return fifo.empty();
+    }
+
+    unsigned int GetNumFifoResets() {
+        std::scoped_lock lock(fake_mutex);
+        return num_fifo_resets;
+    }
+
+  private:
+    std::deque<unsigned char> fifo;
+    std::size_t num_bytes_pushed = 0;
+    bool is_overflowed = false;
+    unsigned int num_fifo_resets = 0;
+    const std::shared_ptr<std::vector<RegisterWrite>> register_writes;
+    std::mutex fake_mutex;
+};
+
+struct BatchSample {
+    int sequence_number;
+    std::int64_t timestamp;  // microseconds
+};
+
+std::vector<BatchSample> GetBatchSamples(Mpu6050& mpu6050) {
+    const auto observation = mpu6050.GetObservationBatch();
+    const auto& batch = observation.imu_batch_observation();
+
+    std::vector<BatchSample> samples;
+    for (int i = 0; i < batch.time_offsets_size(); ++i) {
+        samples.push_back({static_cast<int>(std::lround(batch.linear_acceleration_x(i) * 16384 / 9.81)),
+                           static_cast<std::int64_t>(batch.start_timestamp() + batch.time_offsets(i))});
+    }
+    return samples;
+}
+
+template <typename Predicate>
+bool WaitFor(Predicate predicate) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!predicate()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+Json::Value MakeFifoConfig() {
+    Json::Value config;
+    config["fifo"]["dlpf_mode"] = 1;
+    config["fifo"]["sample_rate"] = 1000;
+    config["fifo"]["read_interval"] = 2;
+    return config;
+}
+
+class Mpu6050FifoTest : public testing::Test {
+  protected:
+    Mpu6050FifoTest() : fake(new FakeMpu6050), mpu6050(MakeFifoConfig(), std::unique_ptr<I2cDevice>{fake}) {}
+
+    void SetUp() override {
+        // anything pushed before the sensor thread first resets the FIFO would be lost
+        ASSERT_TRUE(WaitFor([this] { return fake->GetNumFifoResets() == 1; }));
+    }
+
+    FakeMpu6050* const fake;  // owned by 'mpu6050'
+    Mpu6050 mpu6050;
+};
+
+TEST_F(Mpu6050FifoTest, PartialFrameIsLeftForNextRead) {
+    fake->PushFifoBytes(frame_size + frame_size / 2);
+
+    auto samples = GetBatchSamples(mpu6050);
+    ASSERT_EQ(samples.size(), 1u);
+    EXPECT_EQ(samples[0].sequence_number, 0);
+
+    // completes the partial frame and adds another
+    fake->PushFifoBytes(frame_size / 2 + frame_size);
+    ASSERT_TRUE(WaitFor([this] { return fake->IsFifoEmpty(); }));
+
+    samples = GetBatchSamples(mpu6050);
+    ASSERT_EQ(samples.size(), 2u);
+    EXPECT_EQ(samples[0].sequence_number, 1);
+    EXPECT_EQ(samples[1].sequence_number, 2);
+    EXPECT_EQ(fake->GetNumFifoResets(), 1u);
+}
+
+TEST_F(Mpu6050FifoTest, OverflowResetsFifo) {
+    // the frames in the overflowed FIFO are discarded along with their partial first frame
+    fake->PushFifoBytes(fifo_capacity + frame_size / 2);
+    ASSERT_TRUE(WaitFor([this] { return fake->GetNumFifoResets() == 2; }));
+
+    fake->StartNewFrame();
+    fake->PushFifoBytes(2 * frame_size);
+    const auto samples = GetBatchSamples(mpu6050);
+    const auto first_sequence_number = static_cast<int>((fifo_capacity + frame_size - 1 + frame_size / 2) / frame_size);
+    ASSERT_EQ(samples.size(), 2u);
+    EXPECT_EQ(samples[0].sequence_number, first_sequence_number);
+    EXPECT_EQ(samples[1].sequence_number, first_sequence_number + 1);
+}
+
+TEST_F(Mpu6050FifoTest, TimestampsIncreaseAcrossReads) {
+    constexpr auto sample_period = std::chrono::microseconds(1000);
+    constexpr std::size_t num_frames = 500;
+
+    // the sensor fills its FIFO byte by byte in real time, so reads often end partway through a frame
+    std::thread sensor([this, sample_period] {
+        const auto start_time = std::chrono::steady_clock::now();
+        std::size_t num_bytes_pushed = 0;
+        while (num_bytes_pushed < num_frames * frame_size) {
+            std::this_thread::sleep_for(sample_period / 3);
+            const auto elapsed = std::chrono::steady_clock::now() - start_time;
+            const auto num_bytes_due =
+                    std::min<std::size_t>(elapsed * frame_size / sample_period, num_frames * frame_size);
+            fake->PushFifoBytes(num_bytes_due - num_bytes_pushed);
+            num_bytes_pushed = num_bytes_due;
+        }
+    });
+
+    std::vector<BatchSample> samples;
+    while (samples.size() < num_frames) {
+        const auto batch = GetBatchSamples(mpu6050);
+        samples.insert(samples.end(), batch.begin(), batch.end());
+    }
+    sensor.join();
+
+    EXPECT_EQ(fake->GetNumFifoResets(), 1u);
+    ASSERT_EQ(samples.size(), num_frames);
+    for (std::size_t i = 0; i < samples.size(); ++i) {
+        ASSERT_EQ(samples[i].sequence_number, static_cast<int>(i));
+        if (i > 0) {
+            EXPECT_GT(samples[i].timestamp, samples[i - 1].timestamp) << "at sample " << i;
+        }
+    }
+}
+
+TEST(Mpu6050Test, DestructorOnlyDisablesFifoInFifoMode) {
+    const auto is_fifo_disable = [](const FakeMpu6050::RegisterWrite& write) {
+        return (write.reg == user_control_register) && (write.value == 0);
+    };
+
+    auto register_writes = std::make_shared<std::vector<FakeMpu6050::RegisterWrite>>();
+    Mpu6050(Json::Value{}, std::make_unique<FakeMpu6050>(register_writes));
+    EXPECT_TRUE(std::none_of(register_writes->begin(), register_writes->end(), is_fifo_disable));
+
+    register_writes = std::make_shared<std::vector<FakeMpu6050::RegisterWrite>>();
+    Mpu6050(MakeFifoConfig(), std::make_unique<FakeMpu6050>(register_writes));
+    EXPECT_TRUE(std::any_of(register_writes->begin(), register_writes->end(), is_fifo_disable));
+}
+
+}  // namespace
@@ -0,0 +1,100 @@
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <benchmark/benchmark.h>
+#include <whisker/overwriting_buffer.h>
+#include "baseline/overwriting_buffer.h"
+
+// each benchmark runs against both the current triple buffer and the mutex-based buffer it replaced
+
+namespace {
+
+template <std::size_t Size>
+struct Payload {
+    std::array<char, Size> bytes;
+};
+
+template <template <typename> class Buffer, std::size_t Size>
+void BM_OverwritingBufferWrite(benchmark::State& state) {
+    Buffer<Payload<Size>> buffer;
+    char value = 0;
+    for (auto _ : state) {
+        buffer.Write([&value](Payload<Size>* payload) { payload->bytes.fill(++value); });
+    }
+    state.SetBytesProcessed(state.iterations() * Size);
+}
+BENCHMARK_TEMPLATE(BM_OverwritingBufferWrite, whisker::OverwritingBuffer, 64);
+BENCHMARK_TEMPLATE(BM_OverwritingBufferWrite, whisker::baseline::OverwritingBuffer, 64);
+BENCHMARK_TEMPLATE(BM_OverwritingBufferWrite, whisker::OverwritingBuffer, 4096);
+BENCHMARK_TEMPLATE(BM_OverwritingBufferWrite, whisker::baseline::OverwritingBuffer, 4096);
+
+template <template <typename> class Buffer, std::size_t Size>
+void BM_OverwritingBufferWriteThenRead(benchmark::State& state) {
+    Buffer<Payload<Size>> buffer;
+    char value = 0;
+    for (auto _ : state) {
+        buffer.Write([&value](Payload<Size>* payload) { payload->bytes.fill(++value); });
+        buffer.TryRead([](const Payload<Size>* payload) { benchmark::DoNotOptimize(payload->bytes[0]); });
+    }
+    state.SetBytesProcessed(state.iterations() * Size);
+}
+BENCHMARK_TEMPLATE(BM_OverwritingBufferWriteThenRead, whisker::OverwritingBuffer, 64);
+BENCHMARK_TEMPLATE(BM_OverwritingBufferWriteThenRead, whisker::baseline::OverwritingBuffer, 64);
+BENCHMARK_TEMPLATE(BM_OverwritingBufferWriteThenRead, whisker::OverwritingBuffer, 4096);
+BENCHMARK_TEMPLATE(BM_OverwritingBufferWriteThenRead, whisker::baseline::OverwritingBuffer, 4096);
+
+// writes while another thread reads as fast as it can, which is the case the triple buffer is meant for
+template <template <typename> class Buffer, std::size_t Size>
+void BM_OverwritingBufferWriteWithConcurrentReader(benchmark::State& state) {
+    Buffer<Payload<Size>> buffer;
+    std::atomic_bool stop_reader = false;
+    std::thread reader([&buffer, &stop_reader] {
+        while (!stop_reader.load(std::memory_order_relaxed)) {
+            buffer.TryRead([](const Payload<Size>* payload) { benchmark::DoNotOptimize(payload->bytes[0]); });
+        }
+    });
+
+    char value = 0;
+    for (auto _ : state) {
+        buffer.Write([&value](Payload<Size>* payload) { payload->bytes.fill(++value); });
+    }
+    state.SetBytesProcessed(state.iterations() * Size);
+    state.counters["overwritten"] = static_cast<double>(buffer.GetNumOverwritten());
+
+    stop_reader = true;
+    reader.join();
+}
+BENCHMARK_TEMPLATE(BM_OverwritingBufferWriteWithConcurrentReader, whisker::OverwritingBuffer, 64)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_OverwritingBufferWriteWithConcurrentReader, whisker::baseline::OverwritingBuffer, 64)
+        ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_OverwritingBufferWriteWithConcurrentReader, whisker::OverwritingBuffer, 4096)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_OverwritingBufferWriteWithConcurrentReader, whisker::baseline::OverwritingBuffer, 4096)
+        ->UseRealTime();
+
+// a write that wakes a reader blocked in Read() and waits for its reply, i.e. the latency of a handoff
+template <template <typename> class Buffer>
+void BM_OverwritingBufferRoundTrip(benchmark::State& state) {
+    Buffer<int> request;
+    Buffer<int> response;
+    std::thread responder([&request, &response] {
+        int value = 0;
+        while (value >= 0) {
+            request.Read([&value](const int* data) { value = *data; });
+            response.Write([value](int* data) { *data = value; });
+        }
+    });
+
+    int value = 0;
+    for (auto _ : state) {
+        request.Write([&value](int* data) { *data = value++; });
+        response.Read([](const int* data) { benchmark::DoNotOptimize(*data); });
+    }
+
+    request.Write([](int* data) { *data = -1; });
+    responder.join();
+}
+BENCHMARK_TEMPLATE(BM_OverwritingBufferRoundTrip, whisker::OverwritingBuffer)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_OverwritingBufferRoundTrip, whisker::baseline::OverwritingBuffer)->UseRealTime();
+
+}  // namespace
@@ -0,0 +1,116 @@
+#include <array>
+#include <cstdint>
+#include <thread>
+#include <gtest/gtest.h>
+#include <whisker/overwriting_buffer.h>
+
+namespace {
+
+// large enough that a torn read can't go unnoticed, and that copying it takes a while
+struct Payload {
+    std::array<std::uint64_t, 256> values;
+};
+
+void FillPayload(Payload* payload, std::uint64_t value) {
+    payload->values.fill(value);
+}
+
+bool IsPayloadConsistent(const Payload& payload) {
+    for (const auto value : payload.values) {
+        if (value != payload.values.front()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST(OverwritingBufferTest, TryReadReturnsOnlyUnreadData) {
+    whisker::OverwritingBuffer<int> buffer;
+    int value = 0;
+
+    EXPECT_FALSE(buffer.TryRead([&value](const int* data) { value = *data; }));
+
+    buffer.Write([](int* data) { *data = 1; });
+    EXPECT_TRUE(buffer.TryRead([&value](const int* data) { value = *data; }));
+    EXPECT_EQ(value, 1);
+    EXPECT_FALSE(buffer.TryRead([&value](const int* data) { value = *data; }));
+}
+
+TEST(OverwritingBufferTest, ReadGetsLatestWrite) {
+    whisker::OverwritingBuffer<int> buffer;
+    for (int i = 1; i <= 5; ++i) {
+        buffer.Write([i](int* data) { *data = i; });
+    }
+
+    int value = 0;
+    buffer.Read([&value](const int* data) { value = *data; });
+    EXPECT_EQ(value, 5);
+    EXPECT_EQ(buffer.GetNumOverwritten(), 4u);
+}
+
+// the writer never waits, so the reader sees an increasing subset of the writes, each of them whole
+TEST(OverwritingBufferTest, ConcurrentReadsAreNeverTorn) {
+    constexpr std::uint64_t num_writes = 200000;
+    whisker::OverwritingBuffer<Payload> buffer;
+
+    std::thread writer([&buffer] {
+        for (std::uint64_t i = 1; i <= num_writes; ++i) {
+            buffer.Write([i](Payload* payload) { FillPayload(payload, i); });
+        }
+    });
+
+    std::uint64_t num_reads = 0;
+    std::uint64_t num_torn_reads = 0;
+    std::uint64_t num_stale_reads = 0;
+    std::uint64_t last_value = 0;
+    while (last_value != num_writes) {
+        buffer.Read([&](const Payload* payload) {
+            if (!IsPayloadConsistent(*payload)) {
+                ++num_torn_reads;
+            }
+            if (payload->values.back() <= last_value) {
+                ++num_stale_reads;
+            }
+            last_value = payload->values.back();
+        });
+        ++num_reads;
+    }
+    writer.join();
+
+    EXPECT_EQ(num_torn_reads, 0u);
+    EXPECT_EQ(num_stale_reads, 0u);
+    // every write was either read or overwritten, and none twice
+    EXPECT_EQ(num_reads + buffer.GetNumOverwritten(), num_writes);
+}
+
+// each side blocks in Read() until the other has written, so a missed wakeup hangs the test
+TEST(OverwritingBufferTest, BlockedReaderIsAlwaysWoken) {
+    constexpr int num_round_trips = 100000;
+    whisker::OverwritingBuffer<int> request;
+    whisker::OverwritingBuffer<int> response;
+
+    std::thread responder([&request, &response] {
+        int value = 0;
+        while (value != num_round_trips) {
+            request.Read([&value](const int* data) { value = *data; });
+            response.Write([value](int* data) { *data = value; });
+        }
+    });
+
+    int num_mismatches = 0;
+    for (int i = 1; i <= num_round_trips; ++i) {
+        request.Write([i](int* data) { *data = i; });
+        response.Read([&num_mismatches, i](const int* data) {
+            if (*data != i) {
+                ++num_mismatches;
+            }
+        });
+    }
+    responder.join();
+
+    EXPECT_EQ(num_mismatches, 0);
+    EXPECT_EQ(request.GetNumOverwritten(), 0u);
+    EXPECT_EQ(response.GetNumOverwritten(), 0u);
+}
+
+}  // namespace
@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include <whisker/sample_ring.h>
+
+namespace {
+
+TEST(SampleRingTest, TryReadsReturnFalseWhenEmpty) {
+    whisker::SampleRing<int> ring(4);
+    std::vector<int> samples{1, 2, 3};
+    EXPECT_FALSE(ring.TryDrainAll(samples));
+    EXPECT_TRUE(samples.empty());
+
+    int sample = -1;
+    EXPECT_FALSE(ring.TryReadLatest(sample));
+    EXPECT_EQ(sample, -1);
+
+    // and again once everything written has been read
+    ring.Push(7);
+    ASSERT_TRUE(ring.TryReadLatest(sample));
+    EXPECT_FALSE(ring.TryReadLatest(sample));
+    EXPECT_FALSE(ring.TryDrainAll(samples));
+    EXPECT_EQ(sample, 7);
+}
+
+TEST(SampleRingTest, DrainsInOrderAcrossWrapAround) {
+    whisker::SampleRing<int> ring(4);
+    std::vector<int> samples;
+    for (int round = 0; round < 5; ++round) {
+        for (int i = 0; i < 3; ++i) {
+            EXPECT_EQ(ring.Push(round * 3 + i), 0u);
+        }
+        ASSERT_TRUE(ring.TryDrainAll(samples));
+        EXPECT_EQ(samples, (std::vector<int>{round * 3, round * 3 + 1, round * 3 + 2}));
+    }
+    EXPECT_EQ(ring.GetNumOverwritten(), 0u);
+}
+
+TEST(SampleRingTest, OverflowOverwritesOldestUnread) {
+    whisker::SampleRing<int> ring(4);
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_EQ(ring.Push(i), 0u);
+    }
+    EXPECT_EQ(ring.Push(4), 1u);
+    EXPECT_EQ(ring.Push(5), 1u);
+    EXPECT_EQ(ring.GetNumOverwritten(), 2u);
+
+    std::vector<int> samples;
+    ring.DrainAll(samples);
+    EXPECT_EQ(samples, (std::vector<int>{2, 3, 4, 5}));
+}
+
+TEST(SampleRingTest, BatchLargerThanCapacityKeepsItsNewestSamples) {
+    whisker::SampleRing<int> ring(4);
+    ring.Push(-1);
+
+    std::vector<int> batch(10);
+    std::iota(batch.begin(), batch.end(), 0);
+    EXPECT_EQ(ring.Push(batch.begin(), batch.end()), 7u);  // the unread -1 and the batch's first 6
+    EXPECT_EQ(ring.GetNumOverwritten(), 7u);
+
+    std::vector<int> samples;
+    ASSERT_TRUE(ring.TryDrainAll(samples));
+    EXPECT_EQ(samples, (std::vector<int>{6, 7, 8, 9}));
+}
+
+TEST(SampleRingTest, ReadLatestSkipsOlderSamples) {
+    whisker::SampleRing<int> ring(4);
+    ring.Push(1);
+    ring.Push(2);
+    ring.Push(3);
+
+    int sample = 0;
+    ring.ReadLatest(sample);
+    EXPECT_EQ(sample, 3);
+
+    // skipped samples aren't counted as overwritten
+    std::vector<int> samples;
+    EXPECT_FALSE(ring.TryDrainAll(samples));
+    EXPECT_EQ(ring.GetNumOverwritten(), 0u);
+}
+
+// a writer pushing batches of random sizes against a reader blocked in DrainAll(): every sample is either read, in
+// order, or counted as overwritten
+TEST(SampleRingTest, ConcurrentDrainSeesEverySampleOrCountsIt) {
+    constexpr int num_samples = 500000;
+    whisker::SampleRing<int> ring(64);
+
+    std::thread writer([&ring] {
+        std::mt19937 random(1);
+        std::uniform_int_distribution<int> batch_size_distribution(1, 100);
+        std::vector<int> batch;
+        for (int next = 0; next < num_samples;) {
+            batch.resize(std::min(batch_size_distribution(random), num_samples - next));
+            std::iota(batch.begin(), batch.end(), next);
+            next += static_cast<int>(batch.size());
+            ring.Push(batch.begin(), batch.end());
+        }
+    });
+
+    std::vector<int> samples;
+    int num_read = 0;
+    int num_out_of_order = 0;
+    for (int last = -1; last != num_samples - 1;) {
+        ring.DrainAll(samples);
+        for (const auto sample : samples) {
+            if (sample <= last) {
+                ++num_out_of_order;
+            }
+            last = sample;
+        }
+        num_read += static_cast<int>(samples.size());
+    }
+    writer.join();
+
+    EXPECT_EQ(num_out_of_order, 0);
+    EXPECT_EQ(num_read + ring.GetNumOverwritten(), static_cast<std::uint64_t>(num_samples));
+}
+
+}  // namespace
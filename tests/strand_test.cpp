@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include <whisker/strand.h>
+#include <whisker/thread_pool.h>
+
+namespace {
+
+// tasks from each producer run in the order that producer added them, never two at once, with none lost
+TEST(StrandTest, ConcurrentProducersKeepTheirOrder) {
+    constexpr int num_producers = 4;
+    constexpr int num_tasks_per_producer = 50000;
+    const auto thread_pool = std::make_shared<whisker::ThreadPool>(4);
+
+    std::vector<int> next_values(num_producers, 0);
+    int num_out_of_order = 0;
+    std::atomic_bool is_task_running = false;
+    std::atomic_int num_overlapping = 0;
+    {
+        whisker::Strand strand(thread_pool);
+        std::vector<std::thread> producers;
+        for (int producer = 0; producer < num_producers; ++producer) {
+            producers.emplace_back([&, producer] {
+                for (int i = 0; i < num_tasks_per_producer; ++i) {
+                    strand.AddTask([&, producer, value = std::make_unique<int>(i)] {
+                        if (is_task_running.exchange(true)) {
+                            ++num_overlapping;
+                        }
+                        if (*value != next_values[producer]) {
+                            ++num_out_of_order;
+                        }
+                        next_values[producer] = *value + 1;
+                        is_task_running = false;
+                    });
+                    if (i % 10000 == 0) {
+                        // let the strand run dry and give up its pool thread
+                        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                    }
+                }
+            });
+        }
+        for (auto& producer : producers) {
+            producer.join();
+        }
+    }
+
+    EXPECT_EQ(num_overlapping, 0);
+    EXPECT_EQ(num_out_of_order, 0);
+    for (const auto next_value : next_values) {
+        EXPECT_EQ(next_value, num_tasks_per_producer);
+    }
+}
+
+// a busy strand gives up its pool thread after a turn, so it can't starve another strand sharing a single thread
+TEST(StrandTest, BusyStrandYieldsPoolThread) {
+    constexpr int num_tasks = 1000;
+    const auto thread_pool = std::make_shared<whisker::ThreadPool>(1);
+
+    // hold the pool's only thread until both strands are full
+    std::promise<void> release_pool;
+    thread_pool->Schedule([future = release_pool.get_future()] { future.wait(); });
+
+    std::vector<int> order;  // 0 for the first strand's tasks, 1 for the second's
+    whisker::Strand first_strand(thread_pool);
+    whisker::Strand second_strand(thread_pool);
+    for (int i = 0; i < num_tasks; ++i) {
+        first_strand.AddTask([&order] { order.push_back(0); });
+        second_strand.AddTask([&order] { order.push_back(1); });
+    }
+    release_pool.set_value();
+    first_strand.FinishQueueSync();
+    second_strand.FinishQueueSync();
+
+    ASSERT_EQ(order.size(), 2u * num_tasks);
+    const auto first_of_second_strand = std::find(order.begin(), order.end(), 1) - order.begin();
+    EXPECT_LT(first_of_second_strand, num_tasks);
+}
+
+TEST(StrandTest, FinishQueueSyncWaitsForQueuedTasks) {
+    const auto thread_pool = std::make_shared<whisker::ThreadPool>(2);
+    whisker::Strand strand(thread_pool);
+    std::atomic_int num_run = 0;
+    for (int i = 0; i < 100; ++i) {
+        strand.AddTask([&num_run] {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            ++num_run;
+        });
+    }
+
+    strand.FinishQueueSync();
+    EXPECT_EQ(num_run, 100);
+    EXPECT_EQ(strand.GetNumTasks(), 0u);
+
+    // the strand is still usable afterwards
+    strand.AddTask([&num_run] { ++num_run; });
+    strand.FinishQueueSync();
+    EXPECT_EQ(num_run, 101);
+}
+
+// destroying a strand right after its last task was added races the pool thread's hand-off of that task, which
+// ThreadSanitizer reports as a use after free if the strand's members are touched after FinishQueueSync() returns
+TEST(StrandTest, DestructionRightAfterLastTask) {
+    const auto thread_pool = std::make_shared<whisker::ThreadPool>(4);
+    int num_run = 0;
+    for (int i = 0; i < 2000; ++i) {
+        whisker::Strand strand(thread_pool);
+        for (int j = 0; j < i % 4; ++j) {
+            strand.AddTask([&num_run] { ++num_run; });
+        }
+    }
+    EXPECT_EQ(num_run, 2000 / 4 * (0 + 1 + 2 + 3));
+}
+
+}  // namespace
@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <cartographer/io/proto_stream.h>
+#include <cartographer/io/proto_stream_deserializer.h>
+#include <cartographer/mapping/value_conversion_tables.h>
+#include <cartographer/mapping/2d/probability_grid.h>
+#include <cartographer/mapping/2d/probability_grid_range_data_inserter_2d.h>
+#include <cartographer/mapping/2d/submap_2d.h>
+#include <cartographer/mapping/proto/probability_grid_range_data_inserter_options_2d.pb.h>
+#include <cartographer/sensor/range_data.h>
+#include <Eigen/Core>
+#include <glog/logging.h>
+#include "baseline/submap_texture.h"
+#include "submap_texture.h"
+
+// Submap textures are rasterized from the 2D submaps of the .pbstream file at the path in the
+// WHISKER_BENCHMARK_PBSTREAM environment variable (e.g. one saved by the server).  Without it, submaps are simulated
+// by inserting scans of a room into probability grids the same way Cartographer's local SLAM builds them.
+
+namespace {
+
+constexpr int num_simulated_submaps = 8;
+constexpr int num_scans_per_simulated_submap = 90;  // Cartographer's default 'num_range_data'
+constexpr int num_rays_per_scan = 720;
+constexpr float max_range = 12;
+constexpr float room_half_width = 8;
+constexpr float room_half_height = 5;
+
+// distance from 'origin' (inside the room) along 'direction' to the room's walls
+float GetDistanceToWall(const Eigen::Vector2f& origin, const Eigen::Vector2f& direction) {
+    auto distance = max_range + 1;
+    for (int axis = 0; axis < 2; ++axis) {
+        const auto half_extent = (axis == 0) ? room_half_width : room_half_height;
+        if (direction[axis] != 0) {
+            const auto wall = std::copysign(half_extent, direction[axis]);
+            distance = std::min(distance, (wall - origin[axis]) / direction[axis]);
+        }
+    }
+    return distance;
+}
+
+std::vector<std::shared_ptr<const cartographer::mapping::Submap2D>> SimulateSubmaps(
+        cartographer::mapping::ValueConversionTables* conversion_tables) {
+    cartographer::mapping::proto::ProbabilityGridRangeDataInserterOptions2D inserter_options;
+    inserter_options.set_hit_probability(0.55);
+    inserter_options.set_miss_probability(0.49);
+    inserter_options.set_insert_free_space(true);
+    const cartographer::mapping::ProbabilityGridRangeDataInserter2D inserter(inserter_options);
+
+    std::vector<std::shared_ptr<const cartographer::mapping::Submap2D>> submaps;
+    for (int submap_index = 0; submap_index < num_simulated_submaps; ++submap_index) {
+        // the initial grid that a new submap starts with, which grows as scans are inserted
+        constexpr double resolution = 0.05;
+        constexpr int initial_size = 100;
+        const Eigen::Vector2f submap_origin(-room_half_width / 2 + submap_index, 0);
+        const cartographer::mapping::MapLimits initial_limits(
+                resolution, submap_origin.cast<double>() + (0.5 * initial_size * resolution * Eigen::Vector2d::Ones()),
+                cartographer::mapping::CellLimits(initial_size, initial_size));
+        auto grid = std::make_unique<cartographer::mapping::ProbabilityGrid>(initial_limits, conversion_tables);
+
+        // the vehicle drives across the room while the submap is being built
+        for (int scan_index = 0; scan_index < num_scans_per_simulated_submap; ++scan_index) {
+            const Eigen::Vector2f scan_origin =
+                    submap_origin + Eigen::Vector2f(scan_index * 0.05f, std::sin(scan_index * 0.1f));
+            std::vector<cartographer::sensor::RangefinderPoint> returns;
+            std::vector<cartographer::sensor::RangefinderPoint> misses;
+            for (int ray_index = 0; ray_index < num_rays_per_scan; ++ray_index) {
+                const auto angle = static_cast<float>(2 * M_PI * ray_index / num_rays_per_scan);
+                const Eigen::Vector2f direction(std::cos(angle), std::sin(angle));
+                const auto distance = GetDistanceToWall(scan_origin, direction);
+                const Eigen::Vector2f point = scan_origin + (std::min(distance, max_range) * direction);
+                ((distance <= max_range) ? returns : misses).push_back({Eigen::Vector3f(point.x(), point.y(), 0)});
+            }
+            const cartographer::sensor::RangeData range_data{Eigen::Vector3f(scan_origin.x(), scan_origin.y(), 0),
+                                                             cartographer::sensor::PointCloud(std::move(returns)),
+                                                             cartographer::sensor::PointCloud(std::move(misses))};
+            inserter.Insert(range_data, grid.get());
+        }
+
+        submaps.push_back(std::make_shared<cartographer::mapping::Submap2D>(submap_origin, std::move(grid),
+                                                                            conversion_tables));
+    }
+    return submaps;
+}
+
+std::vector<std::shared_ptr<const cartographer::mapping::Submap2D>> LoadSubmaps(
+        const char* pbstream_path,
+        cartographer::mapping::ValueConversionTables* conversion_tables) {
+    cartographer::io::ProtoStreamReader reader(pbstream_path);
+    cartographer::io::ProtoStreamDeserializer deserializer(&reader);
+
+    std::vector<std::shared_ptr<const cartographer::mapping::Submap2D>> submaps;
+    cartographer::mapping::proto::SerializedData data;
+    while (deserializer.ReadNextSerializedData(&data)) {
+        if (data.has_submap() && data.submap().has_submap_2d()) {
+            submaps.push_back(
+                    std::make_shared<cartographer::mapping::Submap2D>(data.submap().submap_2d(), conversion_tables));
+        }
+    }
+    CHECK(!submaps.empty()) << "No 2D submaps in " << pbstream_path;
+    return submaps;
+}
+
+struct SubmapGrid {
+    const cartographer::mapping::Grid2D* grid;
+    Eigen::Array2i cropped_offset;
+    cartographer::mapping::CellLimits cropped_limits;
+};
+
+// the submaps' grids with their cropped limits, as CreateSubmapTextureSnapshot() rasterizes them
+const std::vector<SubmapGrid>& GetSubmapGrids() {
+    static cartographer::mapping::ValueConversionTables conversion_tables;
+    static const auto submaps = [] {
+        const auto pbstream_path = std::getenv("WHISKER_BENCHMARK_PBSTREAM");
+        return pbstream_path ? LoadSubmaps(pbstream_path, &conversion_tables) : SimulateSubmaps(&conversion_tables);
+    }();
+    static const auto submap_grids = [] {
+        std::vector<SubmapGrid> submap_grids;
+        for (const auto& submap : submaps) {
+            auto& submap_grid = submap_grids.emplace_back();
+            submap_grid.grid = submap->grid();
+            submap_grid.grid->ComputeCroppedLimits(&submap_grid.cropped_offset, &submap_grid.cropped_limits);
+        }
+        return submap_grids;
+    }();
+    return submap_grids;
+}
+
+using RasterizeFunction = void (*)(const cartographer::mapping::Grid2D&,
+                                   const Eigen::Array2i&,
+                                   const cartographer::mapping::CellLimits&,
+                                   std::uint8_t*);
+
+// rasterizes every submap's texture per iteration
+template <RasterizeFunction Rasterize>
+void BM_RasterizeSubmapTexture(benchmark::State& state) {
+    const auto& submap_grids = GetSubmapGrids();
+    std::int64_t num_cells = 0;
+    for (const auto& submap_grid : submap_grids) {
+        num_cells += static_cast<std::int64_t>(submap_grid.cropped_limits.num_x_cells) *
+                     submap_grid.cropped_limits.num_y_cells;
+    }
+
+    std::vector<std::uint8_t> pixels;
+    for (auto _ : state) {
+        for (const auto& submap_grid : submap_grids) {
+            pixels.resize(submap_grid.cropped_limits.num_x_cells * submap_grid.cropped_limits.num_y_cells);
+            Rasterize(*submap_grid.grid, submap_grid.cropped_offset, submap_grid.cropped_limits, pixels.data());
+            benchmark::DoNotOptimize(pixels.data());
+            benchmark::ClobberMemory();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * num_cells);
+    state.counters["submaps"] = static_cast<double>(submap_grids.size());
+}
+BENCHMARK_TEMPLATE(BM_RasterizeSubmapTexture, RasterizeSubmapTexture)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_RasterizeSubmapTexture, whisker::baseline::RasterizeSubmapTexture)->Unit(benchmark::kMicrosecond);
+
+}  // namespace
@@ -0,0 +1,129 @@
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include <gtest/gtest.h>
+#include <cartographer/mapping/probability_values.h>
+#include <cartographer/mapping/value_conversion_tables.h>
+#include <cartographer/mapping/2d/map_limits.h>
+#include <cartographer/mapping/2d/probability_grid.h>
+#include <Eigen/Core>
+#include "baseline/submap_texture.h"
+#include "submap_texture.h"
+
+namespace {
+
+cartographer::mapping::MapLimits MakeLimits(int num_x_cells, int num_y_cells) {
+    return cartographer::mapping::MapLimits(0.05, Eigen::Vector2d(10, 10),
+                                            cartographer::mapping::CellLimits(num_x_cells, num_y_cells));
+}
+
+// a probability grid whose raw cell values can be set directly, including combinations that only come up midway
+// through an insertion
+class RawProbabilityGrid final : public cartographer::mapping::ProbabilityGrid {
+  public:
+    RawProbabilityGrid(const cartographer::mapping::MapLimits& limits,
+                       cartographer::mapping::ValueConversionTables* conversion_tables)
+            : ProbabilityGrid(limits, conversion_tables) {}
+
+    void SetRawValue(const Eigen::Array2i& cell, std::uint16_t value) {
+        (*mutable_correspondence_cost_cells())[ToFlatIndex(cell)] = value;
+        mutable_known_cells_box()->extend(cell.matrix());
+    }
+};
+
+// the texture has to be the same byte for byte as the one rasterized one cell at a time
+void ExpectSameTexture(const cartographer::mapping::Grid2D& grid,
+                       const Eigen::Array2i& offset,
+                       const cartographer::mapping::CellLimits& limits) {
+    const auto num_pixels = static_cast<std::size_t>(limits.num_x_cells) * limits.num_y_cells;
+
+    // different fill values so that a pixel that isn't written shows up as a difference
+    std::vector<std::uint8_t> pixels(num_pixels, 0xaa);
+    std::vector<std::uint8_t> baseline_pixels(num_pixels, 0x55);
+    RasterizeSubmapTexture(grid, offset, limits, pixels.data());
+    whisker::baseline::RasterizeSubmapTexture(grid, offset, limits, baseline_pixels.data());
+
+    for (std::size_t i = 0; i < num_pixels; ++i) {
+        const auto x = static_cast<int>(i % limits.num_x_cells);
+        const auto y = static_cast<int>(i / limits.num_x_cells);
+        ASSERT_EQ(pixels[i], baseline_pixels[i]) << "at cell (" << offset.x() + x << ", " << offset.y() + y << ")";
+    }
+}
+
+// every raw value a cell can hold, with and without the update marker bit
+TEST(SubmapTextureTest, MatchesBaselineForEveryCellValue) {
+    cartographer::mapping::ValueConversionTables conversion_tables;
+    RawProbabilityGrid grid(MakeLimits(256, 256), &conversion_tables);
+    for (int y = 0; y < 256; ++y) {
+        for (int x = 0; x < 256; ++x) {
+            const auto value = static_cast<std::uint16_t>(y * 256 + x);
+
+            // the update marker on its own would be an unknown cell that's been updated, but an update always makes
+            // the cell known, so that value is never stored in a grid (and the cell is left unknown instead)
+            if (value != cartographer::mapping::kUpdateMarker) {
+                grid.SetRawValue({x, y}, value);
+            }
+        }
+    }
+
+    ExpectSameTexture(grid, {0, 0}, grid.limits().cell_limits());
+
+    // a window that doesn't start at the grid's origin or span its whole width
+    ExpectSameTexture(grid, {37, 11}, cartographer::mapping::CellLimits(100, 200));
+}
+
+// a grid built through ProbabilityGrid's own interface, cropped the way submap textures are
+TEST(SubmapTextureTest, MatchesBaselineForCroppedGridBeingUpdated) {
+    cartographer::mapping::ValueConversionTables conversion_tables;
+    cartographer::mapping::ProbabilityGrid grid(MakeLimits(300, 200), &conversion_tables);
+    const auto hit_table = cartographer::mapping::ComputeLookupTableToApplyCorrespondenceCostOdds(
+            cartographer::mapping::Odds(0.55));
+    const auto miss_table = cartographer::mapping::ComputeLookupTableToApplyCorrespondenceCostOdds(
+            cartographer::mapping::Odds(0.49));
+
+    // a known area with unknown cells scattered through it and an unknown border around it
+    std::mt19937 random_engine(1);
+    std::bernoulli_distribution is_set_distribution(0.7);
+    std::uniform_real_distribution<float> probability_distribution(cartographer::mapping::kMinProbability,
+                                                                   cartographer::mapping::kMaxProbability);
+    for (int y = 30; y < 170; ++y) {
+        for (int x = 20; x < 260; ++x) {
+            if (is_set_distribution(random_engine)) {
+                grid.SetProbability({x, y}, probability_distribution(random_engine));
+            }
+        }
+    }
+
+    // a scan being inserted leaves the update marker set on the cells it touched until FinishUpdate()
+    std::bernoulli_distribution is_updated_distribution(0.2);
+    std::bernoulli_distribution is_hit_distribution(0.3);
+    for (int y = 10; y < 190; ++y) {
+        for (int x = 10; x < 280; ++x) {
+            if (is_updated_distribution(random_engine)) {
+                grid.ApplyLookupTable({x, y}, is_hit_distribution(random_engine) ? hit_table : miss_table);
+            }
+        }
+    }
+
+    Eigen::Array2i cropped_offset;
+    cartographer::mapping::CellLimits cropped_limits;
+    grid.ComputeCroppedLimits(&cropped_offset, &cropped_limits);
+    ExpectSameTexture(grid, cropped_offset, cropped_limits);
+
+    grid.FinishUpdate();
+    ExpectSameTexture(grid, cropped_offset, cropped_limits);
+}
+
+TEST(SubmapTextureTest, MatchesBaselineForUnknownGrid) {
+    cartographer::mapping::ValueConversionTables conversion_tables;
+    const cartographer::mapping::ProbabilityGrid grid(MakeLimits(100, 100), &conversion_tables);
+
+    Eigen::Array2i cropped_offset;
+    cartographer::mapping::CellLimits cropped_limits;
+    grid.ComputeCroppedLimits(&cropped_offset, &cropped_limits);
+    ExpectSameTexture(grid, cropped_offset, cropped_limits);
+    ExpectSameTexture(grid, {0, 0}, grid.limits().cell_limits());
+}
+
+}  // namespace
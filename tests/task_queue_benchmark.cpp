@@ -0,0 +1,86 @@
+#include <atomic>
+#include <thread>
+#include <benchmark/benchmark.h>
+#include <whisker/mpsc_queue.h>
+#include <whisker/task.h>
+#include <whisker/task_queue.h>
+#include "baseline/task_queue.h"
+
+// each TaskQueue benchmark runs against both the current queue and the mutex-based one it replaced
+
+namespace {
+
+void BM_MpscQueuePushThenPop(benchmark::State& state) {
+    whisker::MpscQueue<int> queue;
+    int value = 0;
+    for (auto _ : state) {
+        queue.Push(int{value});
+        queue.TryPop(value);
+        benchmark::DoNotOptimize(value);
+    }
+}
+BENCHMARK(BM_MpscQueuePushThenPop);
+
+// all of the benchmark's threads add tasks to one queue, whose work thread keeps draining it
+template <typename Queue>
+Queue* shared_task_queue = nullptr;
+
+template <typename Queue>
+void BM_TaskQueueAddTask(benchmark::State& state) {
+    if (state.thread_index() == 0) {
+        shared_task_queue<Queue> = new Queue;
+    }
+
+    std::atomic_int num_run = 0;
+    for (auto _ : state) {
+        shared_task_queue<Queue>->AddTask([&num_run] { num_run.fetch_add(1, std::memory_order_relaxed); });
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    // the queue can only be torn down after every thread has added its tasks, and 'num_run' outlives them
+    while (num_run.load(std::memory_order_relaxed) < state.iterations()) {
+        std::this_thread::yield();
+    }
+
+    if (state.thread_index() == 0) {
+        delete shared_task_queue<Queue>;
+    }
+}
+BENCHMARK_TEMPLATE(BM_TaskQueueAddTask, whisker::TaskQueue)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_TaskQueueAddTask, whisker::baseline::TaskQueue)->ThreadRange(1, 8)->UseRealTime();
+
+// adds a task that's too large to be stored inline in a Task
+template <typename Queue>
+void BM_TaskQueueAddLargeTask(benchmark::State& state) {
+    Queue queue;
+    std::atomic_int num_run = 0;
+    char padding[2 * whisker::Task::inline_capacity] = {};
+    for (auto _ : state) {
+        queue.AddTask([&num_run, padding] {
+            benchmark::DoNotOptimize(padding[0]);
+            num_run.fetch_add(1, std::memory_order_relaxed);
+        });
+    }
+    state.SetItemsProcessed(state.iterations());
+    queue.FinishQueueSync();
+}
+BENCHMARK_TEMPLATE(BM_TaskQueueAddLargeTask, whisker::TaskQueue)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_TaskQueueAddLargeTask, whisker::baseline::TaskQueue)->UseRealTime();
+
+// latency from adding a task until it has run, including waking the work thread if it has parked
+template <typename Queue>
+void BM_TaskQueueRoundTrip(benchmark::State& state) {
+    Queue queue;
+    std::atomic_bool is_run;
+    for (auto _ : state) {
+        is_run = false;
+        queue.AddTask([&is_run] { is_run.store(true, std::memory_order_release); });
+        while (!is_run.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+    }
+}
+BENCHMARK_TEMPLATE(BM_TaskQueueRoundTrip, whisker::TaskQueue)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_TaskQueueRoundTrip, whisker::baseline::TaskQueue)->UseRealTime();
+
+}  // namespace
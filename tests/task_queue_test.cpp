@@ -0,0 +1,103 @@
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include <whisker/task_queue.h>
+
+namespace {
+
+TEST(TaskQueueTest, RunsTasksInOrder) {
+    std::vector<int> order;
+    {
+        whisker::TaskQueue queue;
+        for (int i = 0; i < 1000; ++i) {
+            queue.AddTask([&order, i] { order.push_back(i); });
+        }
+    }
+
+    ASSERT_EQ(order.size(), 1000u);
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_EQ(order[i], i);
+    }
+}
+
+// tasks from each producer run in the order that producer added them, with move-only captures and none lost
+TEST(TaskQueueTest, ConcurrentProducersKeepTheirOrder) {
+    constexpr int num_producers = 4;
+    constexpr int num_tasks_per_producer = 200000;
+
+    std::vector<int> next_values(num_producers, 0);
+    int num_out_of_order = 0;
+    long long sum = 0;
+    {
+        whisker::TaskQueue queue;
+        std::vector<std::thread> producers;
+        for (int producer = 0; producer < num_producers; ++producer) {
+            producers.emplace_back([&, producer] {
+                for (int i = 0; i < num_tasks_per_producer; ++i) {
+                    queue.AddTask([&, producer, value = std::make_unique<int>(i)] {
+                        if (*value != next_values[producer]) {
+                            ++num_out_of_order;
+                        }
+                        next_values[producer] = *value + 1;
+                        sum += *value;
+                    });
+                    if (i % 50000 == 0) {
+                        // let the work thread run dry and park
+                        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                    }
+                }
+            });
+        }
+        for (auto& producer : producers) {
+            producer.join();
+        }
+    }
+
+    EXPECT_EQ(num_out_of_order, 0);
+    EXPECT_EQ(sum, static_cast<long long>(num_producers) * num_tasks_per_producer * (num_tasks_per_producer - 1) / 2);
+}
+
+TEST(TaskQueueTest, FinishQueueSyncDrainsQueuedTasks) {
+    whisker::TaskQueue queue;
+    std::atomic_int num_run = 0;
+    for (int i = 0; i < 100; ++i) {
+        queue.AddTask([&num_run] {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            ++num_run;
+        });
+    }
+
+    queue.FinishQueueSync();
+    EXPECT_EQ(num_run, 100);
+    EXPECT_EQ(queue.GetNumTasks(), 0u);
+}
+
+// a task added by a task that runs during shutdown is also run
+TEST(TaskQueueTest, DestructorDrainsTasksAddedWhileDraining) {
+    bool is_inner_task_run = false;
+    {
+        whisker::TaskQueue queue;
+        queue.AddTask([&queue, &is_inner_task_run] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            queue.AddTask([&is_inner_task_run] { is_inner_task_run = true; });
+        });
+    }
+    EXPECT_TRUE(is_inner_task_run);
+}
+
+// each task is added after the work thread has had time to park, so a missed wakeup hangs the test
+TEST(TaskQueueTest, ParkedWorkThreadIsAlwaysWoken) {
+    whisker::TaskQueue queue;
+    for (int i = 0; i < 200; ++i) {
+        std::this_thread::sleep_for(std::chrono::microseconds(i % 20 * 100));
+        std::promise<void> task_run;
+        queue.AddTask([&task_run] { task_run.set_value(); });
+        task_run.get_future().wait();
+    }
+}
+
+}  // namespace
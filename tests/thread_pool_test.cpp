@@ -0,0 +1,63 @@
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <gtest/gtest.h>
+#include <whisker/thread_pool.h>
+
+namespace {
+
+TEST(ThreadPoolTest, DestructorRunsScheduledTasks) {
+    std::atomic_int num_run = 0;
+    {
+        whisker::ThreadPool thread_pool(2);
+        for (int i = 0; i < 1000; ++i) {
+            thread_pool.Schedule([&num_run] { ++num_run; });
+        }
+    }
+    EXPECT_EQ(num_run, 1000);
+}
+
+// tasks scheduled from a worker go to that worker's own deque, so only stealing gets them onto the other workers
+TEST(ThreadPoolTest, IdleWorkersStealTasks) {
+    constexpr int num_tasks = 200;
+    whisker::ThreadPool thread_pool(4);
+
+    std::mutex thread_ids_mutex;
+    std::set<std::thread::id> thread_ids;
+    std::atomic_int num_run = 0;
+    std::promise<void> all_run;
+
+    thread_pool.Schedule([&] {
+        for (int i = 0; i < num_tasks; ++i) {
+            thread_pool.Schedule([&] {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                {
+                    std::scoped_lock lock(thread_ids_mutex);
+                    thread_ids.insert(std::this_thread::get_id());
+                }
+                if (++num_run == num_tasks) {
+                    all_run.set_value();
+                }
+            });
+        }
+    });
+
+    all_run.get_future().wait();
+    EXPECT_GT(thread_ids.size(), 1u);
+}
+
+// each task is scheduled after the workers have had time to park, so a missed wakeup hangs the test
+TEST(ThreadPoolTest, ParkedWorkersAreAlwaysWoken) {
+    whisker::ThreadPool thread_pool(2);
+    for (int i = 0; i < 200; ++i) {
+        std::this_thread::sleep_for(std::chrono::microseconds(i % 20 * 100));
+        std::promise<void> task_run;
+        thread_pool.Schedule([&task_run] { task_run.set_value(); });
+        task_run.get_future().wait();
+    }
+}
+
+}  // namespace
@@ -0,0 +1,141 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+#include <whisker/websocket_connection.h>
+#include <common.pb.h>
+
+namespace {
+
+constexpr unsigned short benchmark_port = 47291;
+constexpr std::size_t message_size = 500 * 1024;  // about the size of a large map data message
+
+// websocket client that connects to the benchmark's server and discards everything it receives
+class DrainingClient final {
+  public:
+    explicit DrainingClient(const std::string& client_id) {
+        socket_fd = socket(AF_INET, SOCK_STREAM, 0);
+        PCHECK(socket_fd >= 0) << "Error creating socket";
+
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(benchmark_port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        PCHECK(connect(socket_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0)
+                << "Error connecting to benchmark server";
+
+        const auto request = "GET /?client_id=" + client_id +
+                             " HTTP/1.1\r\n"
+                             "Host: localhost\r\n"
+                             "Upgrade: websocket\r\n"
+                             "Connection: Upgrade\r\n"
+                             "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                             "Sec-WebSocket-Version: 13\r\n"
+                             "Sec-WebSocket-Protocol: whisker\r\n\r\n";
+        PCHECK(send(socket_fd, request.data(), request.size(), 0) == static_cast<ssize_t>(request.size()))
+                << "Error sending websocket handshake";
+
+        // frames are never parsed, so the handshake response and everything after it is simply discarded
+        drain_thread = std::thread{[this] {
+            char buf[64 * 1024];
+            while (recv(socket_fd, buf, sizeof(buf), 0) > 0) {
+            }
+        }};
+    }
+
+    ~DrainingClient() {
+        shutdown(socket_fd, SHUT_RDWR);
+        drain_thread.join();
+        close(socket_fd);
+    }
+
+    DrainingClient(const DrainingClient&) = delete;
+    DrainingClient& operator=(const DrainingClient&) = delete;
+
+  private:
+    int socket_fd;
+    std::thread drain_thread;
+};
+
+// a websocket server with 'num_recipients' connected clients
+class MulticastFixture final {
+  public:
+    explicit MulticastFixture(int num_recipients) {
+        whisker::ClientEventHandlers event_handlers;
+        event_handlers.connection_state_handler = [this](whisker::ClientConnection&, std::string&&, bool connected) {
+            num_connected += connected ? 1 : -1;
+        };
+
+        // every message replaces the one queued before it, so queues stay bounded when clients fall behind
+        whisker::WebsocketOutgoingQueueOptions queue_options;
+        queue_options.coalescing_key_func = [](const google::protobuf::MessageLite&) {
+            return whisker::WebsocketOutgoingQueueOptions::CoalescingKey{"benchmark"};
+        };
+
+        connection = whisker::WebsocketConnection::CreateClientConnection(benchmark_port, "", std::move(event_handlers),
+                                                                          std::move(queue_options));
+
+        // client IDs are unique across fixtures so that a new client never takes over an old one's connection
+        static std::atomic_int next_client_index = 0;
+        for (int i = 0; i < num_recipients; ++i) {
+            const auto client_id = "benchmark" + std::to_string(next_client_index++);
+            clients.push_back(std::make_unique<DrainingClient>(client_id));
+            recipient_ids.insert(client_id);
+        }
+        while (num_connected < num_recipients) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        message.set_input(std::string(message_size, 'x'));
+    }
+
+    ~MulticastFixture() {
+        clients.clear();
+        connection->StopMessageHandling();
+    }
+
+    std::shared_ptr<whisker::ClientConnection> connection;
+    std::unordered_set<std::string> recipient_ids;
+    whisker::proto::InvokeCapabilityMessage message;
+
+  private:
+    std::atomic_int num_connected = 0;
+    std::vector<std::unique_ptr<DrainingClient>> clients;
+};
+
+// one serialization shared by every recipient's queue
+void BM_WebsocketMulticast(benchmark::State& state) {
+    MulticastFixture fixture(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        fixture.connection->MulticastMessage(fixture.message, fixture.recipient_ids);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * state.range(0) * message_size);
+}
+BENCHMARK(BM_WebsocketMulticast)->RangeMultiplier(2)->Range(1, 32);
+
+// baseline: one SendMessage() per recipient, which serializes and copies the message for each of them (as map
+// subscribers were sent to before MulticastMessage())
+void BM_WebsocketSendToEachRecipient(benchmark::State& state) {
+    MulticastFixture fixture(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        for (const auto& recipient_id : fixture.recipient_ids) {
+            fixture.connection->SendMessage(fixture.message, recipient_id);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * state.range(0) * message_size);
+}
+BENCHMARK(BM_WebsocketSendToEachRecipient)->RangeMultiplier(2)->Range(1, 32);
+
+}  // namespace
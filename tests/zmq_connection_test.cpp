@@ -0,0 +1,116 @@
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <gtest/gtest.h>
+#include <whisker/zmq_connection.h>
+#include <common.pb.h>
+
+namespace {
+
+constexpr auto test_address = "tcp://127.0.0.1:47292";
+
+// a server that echoes each message back to its sender, with the sender's ID in 'capability'
+std::shared_ptr<whisker::ClientConnection> CreateEchoServer() {
+    whisker::ClientEventHandlers event_handlers;
+    event_handlers.SetMessageHandler<whisker::proto::InvokeCapabilityMessage>(
+            [](auto&& message, auto& connection, auto&& sender_id) {
+                message.set_capability(sender_id);
+                connection.SendMessage(message, sender_id);
+            });
+    return whisker::ZmqConnection::CreateClientConnection(test_address, std::move(event_handlers));
+}
+
+// each connection is a separate client of the server, and gets only the replies to its own messages
+TEST(ZmqConnectionTest, GroupedServerConnectionsAreSeparateClients) {
+    constexpr int num_clients = 100;
+    constexpr int num_messages_per_client = 20;
+
+    const auto server = CreateEchoServer();
+
+    std::vector<std::atomic_int> num_replies(num_clients);
+    std::atomic_int num_misrouted = 0;
+    std::vector<std::pair<std::string, whisker::ServerEventHandlers>> clients;
+    for (int i = 0; i < num_clients; ++i) {
+        whisker::ServerEventHandlers event_handlers;
+        event_handlers.SetMessageHandler<whisker::proto::InvokeCapabilityMessage>(
+                [&num_replies, &num_misrouted, i](auto&& message, auto&) {
+                    if ((message.capability() == "client" + std::to_string(i)) &&
+                        (message.input() == std::to_string(i))) {
+                        ++num_replies[i];
+                    } else {
+                        ++num_misrouted;
+                    }
+                });
+        clients.emplace_back("client" + std::to_string(i), std::move(event_handlers));
+    }
+    const auto connections = whisker::ZmqConnection::CreateServerConnections(test_address, std::move(clients));
+    ASSERT_EQ(connections.size(), static_cast<std::size_t>(num_clients));
+
+    for (int n = 0; n < num_messages_per_client; ++n) {
+        for (int i = 0; i < num_clients; ++i) {
+            whisker::proto::InvokeCapabilityMessage message;
+            message.set_input(std::to_string(i));
+            connections[i]->SendMessage(message);
+        }
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{60};
+    const auto is_all_replied = [&num_replies] {
+        for (const auto& n : num_replies) {
+            if (n < num_messages_per_client) {
+                return false;
+            }
+        }
+        return true;
+    };
+    while (!is_all_replied() && (std::chrono::steady_clock::now() < deadline)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    for (int i = 0; i < num_clients; ++i) {
+        EXPECT_EQ(num_replies[i], num_messages_per_client) << "for client " << i;
+    }
+    EXPECT_EQ(num_misrouted, 0);
+
+    for (const auto& connection : connections) {
+        connection->StopMessageHandling();
+    }
+    server->StopMessageHandling();
+}
+
+// a stopped connection's handlers aren't called any more, while the others in its group keep getting messages
+TEST(ZmqConnectionTest, StoppedGroupedServerConnectionIsNotHandled) {
+    const auto server = CreateEchoServer();
+
+    std::atomic_int num_stopped_replies = 0;
+    std::atomic_int num_running_replies = 0;
+    std::vector<std::pair<std::string, whisker::ServerEventHandlers>> clients(2);
+    clients[0].first = "stopped";
+    clients[0].second.SetMessageHandler<whisker::proto::InvokeCapabilityMessage>(
+            [&num_stopped_replies](auto&&, auto&) { ++num_stopped_replies; });
+    clients[1].first = "running";
+    clients[1].second.SetMessageHandler<whisker::proto::InvokeCapabilityMessage>(
+            [&num_running_replies](auto&&, auto&) { ++num_running_replies; });
+    const auto connections = whisker::ZmqConnection::CreateServerConnections(test_address, std::move(clients));
+
+    connections[0]->StopMessageHandling();
+    whisker::proto::InvokeCapabilityMessage message;
+    connections[0]->SendMessage(message);
+    connections[1]->SendMessage(message);
+
+    // both replies are sent back right away, so the stopped connection's would have been handled by now
+    while (num_running_replies == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_EQ(num_stopped_replies, 0);
+
+    connections[1]->StopMessageHandling();
+    server->StopMessageHandling();
+}
+
+}  // namespace